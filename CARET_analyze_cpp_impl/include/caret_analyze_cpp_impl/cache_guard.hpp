@@ -0,0 +1,65 @@
+// Copyright 2021 Research Institute of Systems Planning, Inc.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#ifndef CARET_ANALYZE_CPP_IMPL__CACHE_GUARD_HPP_
+
+#include <atomic>
+#include <mutex>
+
+// Validity flag of a cache that const member functions rebuild on demand.
+// ensure() may be called from several threads reading the same object; the
+// rebuild then runs once while the other callers wait for it.
+// invalidate() and set_valid() are for non-const member functions only.
+// Copies take the validity of the source and get their own mutex.
+class CacheGuard
+{
+public:
+  explicit CacheGuard(bool is_valid = true);
+  CacheGuard(const CacheGuard & other);
+  CacheGuard & operator=(const CacheGuard & other);
+
+  bool is_valid() const;
+  void invalidate();
+  void set_valid();
+
+  template<typename RebuildT>
+  void ensure(RebuildT && rebuild) const
+  {
+    if (is_valid()) {
+      return;
+    }
+    std::lock_guard<std::mutex> lock(mutex_);
+    if (!is_valid_.load(std::memory_order_relaxed)) {
+      rebuild();
+      is_valid_.store(true, std::memory_order_release);
+    }
+  }
+
+private:
+  mutable std::atomic<bool> is_valid_;
+  mutable std::mutex mutex_;
+};
+
+// Mutex for caches that const member functions fill on demand.
+// Copies get their own mutex, so classes holding one keep their copy operations.
+class CacheMutex : public std::mutex
+{
+public:
+  CacheMutex() = default;
+  CacheMutex(const CacheMutex &);
+  CacheMutex & operator=(const CacheMutex &);
+};
+
+#endif  // CARET_ANALYZE_CPP_IMPL__CACHE_GUARD_HPP_
+#define CARET_ANALYZE_CPP_IMPL__CACHE_GUARD_HPP_
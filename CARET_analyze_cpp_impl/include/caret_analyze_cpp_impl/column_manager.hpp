@@ -14,10 +14,17 @@
 
 #ifndef CARET_ANALYZE_CPP_IMPL__COLUMN_MANAGER_HPP_
 
+#include <atomic>
+#include <mutex>
 #include <string>
 #include <memory>
-#include <unordered_map>
+#include <vector>
 
+#include "caret_analyze_cpp_impl/memory_usage.hpp"
+
+// Dictionary between column names and column hashes.
+// Lookups of registered columns are wait-free; registration is serialised.
+// Hashes never change once assigned.
 class ColumnManager
 {
 public:
@@ -28,15 +35,53 @@ public:
 
   static ColumnManager & get_instance();
 
-  void register_column(std::string column);
-  std::string get_column(size_t hash);
-  size_t get_hash(std::string column);
+  void register_column(const std::string & column);
+  // Returns an empty string for an unknown hash.
+  const std::string & get_column(size_t hash) const;
+  // Registers the column if needed.
+  size_t get_hash(const std::string & column);
+
+  MemoryUsage memory_usage() const;
 
 private:
-  ColumnManager() = default;
+  ColumnManager();
   ~ColumnManager() = default;
-  std::unordered_map<size_t, std::string> column_map_;
-  std::unordered_map<std::string, size_t> hash_map_;
+
+  struct Entry
+  {
+    std::string column;
+    size_t hash;
+  };
+
+  using SlotT = std::atomic<const Entry *>;
+
+  // Open addressing tables with linear probing. Slots are written once, from null
+  // to an entry, so readers can probe without locking. A table that becomes too
+  // full is replaced by a larger one; replaced tables are kept until destruction
+  // because readers may still be probing them.
+  struct Table
+  {
+    explicit Table(size_t capacity);
+
+    size_t mask;
+    // Keyed by std::hash of the column name.
+    std::unique_ptr<SlotT[]> by_column;
+    // Keyed by the column hash.
+    std::unique_ptr<SlotT[]> by_hash;
+  };
+
+  static const Entry * find_by_column(
+    const Table & table, const std::string & column, size_t name_hash);
+  static const Entry * find_by_hash(const Table & table, size_t hash);
+  static void insert(Table & table, const Entry * entry, size_t name_hash);
+  // Registers the column with mutex_ held.
+  const Entry * register_column_locked(const std::string & column, size_t name_hash);
+
+  std::atomic<Table *> table_;
+  mutable std::mutex mutex_;
+  // Guarded by mutex_.
+  std::vector<std::unique_ptr<Entry>> entries_;
+  std::vector<std::unique_ptr<Table>> tables_;
 };
 
 #endif  // CARET_ANALYZE_CPP_IMPL__COLUMN_MANAGER_HPP_
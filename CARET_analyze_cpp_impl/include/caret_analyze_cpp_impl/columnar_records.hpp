@@ -0,0 +1,85 @@
+// Copyright 2021 Research Institute of Systems Planning, Inc.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#ifndef CARET_ANALYZE_CPP_IMPL__COLUMNAR_RECORDS_HPP_
+
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "caret_analyze_cpp_impl/dictionary_column.hpp"
+#include "caret_analyze_cpp_impl/memory_usage.hpp"
+#include "caret_analyze_cpp_impl/packed_column.hpp"
+#include "caret_analyze_cpp_impl/records_base.hpp"
+#include "caret_analyze_cpp_impl/records_vector_impl.hpp"
+
+// Read-only copy of records stored column by column, for keeping large traces
+// resident. A record holds a hash table node per column; here a value takes 1 to 4
+// bytes in a dictionary-encoded column, its bit-packed offset in a packed column and
+// 8 bytes in a plain column, plus a presence bit. The source records can be released
+// once the copy is made, and to_records() or clip() rebuild records for analysis.
+class ColumnarRecords
+{
+public:
+  // Columns in encoded_columns are dictionary-encoded. They should take few
+  // distinct values, such as addresses and thread IDs. Columns in packed_columns
+  // are frame-of-reference compressed and suit timestamps.
+  ColumnarRecords(
+    const RecordsBase & records,
+    std::vector<std::string> encoded_columns,
+    std::vector<std::string> packed_columns = {});
+
+  size_t size() const;
+  std::vector<std::string> get_columns() const;
+  bool is_encoded(std::string column) const;
+  bool is_packed(std::string column) const;
+  bool has_value(size_t position, std::string column) const;
+  // Value at a position. UINT64_MAX when the record does not have the column.
+  uint64_t get(size_t position, std::string column) const;
+
+  std::unique_ptr<RecordsBase> to_records() const;
+  // Records with the column in [t_start, t_end], as RecordsBase::clip().
+  // Blocks of a packed column out of range are skipped without decoding.
+  std::unique_ptr<RecordsBase> clip(std::string column, uint64_t t_start, uint64_t t_end) const;
+
+  MemoryUsage memory_usage() const;
+
+private:
+  struct Column
+  {
+    size_t column_hash;
+    // Set for dictionary-encoded columns.
+    std::unique_ptr<DictionaryColumn> encoded;
+    // Set for packed columns.
+    std::unique_ptr<PackedColumn> packed;
+    // Values of a plain column. Missing values are UINT64_MAX.
+    std::vector<uint64_t> values;
+    // One bit per position of a plain column, set when the record has the column.
+    std::vector<uint64_t> present;
+  };
+
+  const Column & get_column(std::string column) const;
+  bool has_value(const Column & column, size_t position) const;
+  uint64_t get(const Column & column, size_t position) const;
+  void append_record(RecordsBase & records, size_t position) const;
+
+  std::vector<std::string> column_names_;
+  std::vector<Column> columns_;
+  std::string sorted_column_;
+  size_t size_ = 0;
+};
+
+#endif  // CARET_ANALYZE_CPP_IMPL__COLUMNAR_RECORDS_HPP_
+#define CARET_ANALYZE_CPP_IMPL__COLUMNAR_RECORDS_HPP_
@@ -14,7 +14,12 @@
 
 #ifndef CARET_ANALYZE_CPP_IMPL__COMMON_HPP_
 
+#include <algorithm>
+#include <thread>
 #include <unordered_set>
+#include <vector>
+
+#include "caret_analyze_cpp_impl/tracer.hpp"
 
 template<
   typename T,
@@ -32,5 +37,40 @@ ContainerT merge_set(const ContainerT & left, const ContainerT & right)
   return merged;
 }
 
+inline size_t get_parallel_chunk_count(size_t size, size_t min_chunk_size)
+{
+  size_t workers = std::max<size_t>(1, std::thread::hardware_concurrency());
+  size_t chunks = (size + min_chunk_size - 1) / min_chunk_size;
+  return std::max<size_t>(1, std::min(workers, chunks));
+}
+
+// Split [0, size) into chunk_count contiguous ranges and call
+// func(begin, end, chunk_index) for each range on its own thread.
+// func must not throw.
+template<typename FuncT>
+void parallel_for_chunks(size_t size, size_t chunk_count, FuncT func)
+{
+  if (chunk_count <= 1) {
+    func(0, size, 0);
+    return;
+  }
+
+  auto traced_func = [&func](size_t begin, size_t end, size_t chunk_index) {
+      TraceScope trace_scope("parallel_chunk");
+      func(begin, end, chunk_index);
+    };
+  size_t chunk_size = (size + chunk_count - 1) / chunk_count;
+  std::vector<std::thread> threads;
+  for (size_t i = 1; i < chunk_count; i++) {
+    size_t begin = std::min(size, i * chunk_size);
+    size_t end = std::min(size, begin + chunk_size);
+    threads.emplace_back(traced_func, begin, end, i);
+  }
+  traced_func(0, std::min(size, chunk_size), 0);
+  for (auto & thread : threads) {
+    thread.join();
+  }
+}
+
 #endif  // CARET_ANALYZE_CPP_IMPL__COMMON_HPP_"
 #define CARET_ANALYZE_CPP_IMPL__COMMON_HPP_
@@ -0,0 +1,83 @@
+// Copyright 2021 Research Institute of Systems Planning, Inc.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#ifndef CARET_ANALYZE_CPP_IMPL__DICTIONARY_COLUMN_HPP_
+
+#include <cstdint>
+#include <unordered_map>
+#include <vector>
+
+#include "caret_analyze_cpp_impl/record.hpp"
+
+// Values of a column stored as codes into a dictionary of its distinct values.
+// Codes are 8, 16 or 32 bits wide, widened as the dictionary grows.
+// Code 0 stands for records without the column.
+class DictionaryColumn
+{
+public:
+  static constexpr uint32_t missing_code = 0;
+
+  explicit DictionaryColumn(size_t column_hash);
+
+  // Adds the record at the next position.
+  void add(const Record & record);
+  // Removes every position, keeping the dictionary.
+  void clear_codes();
+  // Releases unused capacity once no more records are added.
+  void shrink_to_fit();
+
+  size_t get_column_hash() const;
+  size_t size() const;
+  // Number of codes, including the code for missing values.
+  size_t get_code_count() const;
+  // Width of the codes in bytes.
+  size_t get_code_width() const;
+  uint32_t get_code(size_t position) const;
+  // Value of a code. UINT64_MAX for missing_code.
+  uint64_t get_value(uint32_t code) const;
+
+  // Calls func with the vector of codes of the current width.
+  template<typename FuncT>
+  void visit_codes(FuncT func) const
+  {
+    switch (code_width_) {
+      case 1:
+        func(codes8_);
+        break;
+      case 2:
+        func(codes16_);
+        break;
+      default:
+        func(codes32_);
+        break;
+    }
+  }
+
+  size_t memory_usage() const;
+
+private:
+  uint32_t encode(uint64_t value);
+  void widen();
+
+  size_t column_hash_;
+  size_t code_width_ = 1;
+  std::vector<uint8_t> codes8_;
+  std::vector<uint16_t> codes16_;
+  std::vector<uint32_t> codes32_;
+  std::vector<uint64_t> values_;
+  std::unordered_map<uint64_t, uint32_t> to_code_;
+};
+
+#endif  // CARET_ANALYZE_CPP_IMPL__DICTIONARY_COLUMN_HPP_
+#define CARET_ANALYZE_CPP_IMPL__DICTIONARY_COLUMN_HPP_
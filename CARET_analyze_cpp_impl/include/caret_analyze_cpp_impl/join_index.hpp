@@ -0,0 +1,55 @@
+// Copyright 2021 Research Institute of Systems Planning, Inc.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#ifndef CARET_ANALYZE_CPP_IMPL__JOIN_INDEX_HPP_
+
+#include <utility>
+#include <vector>
+
+#include "caret_analyze_cpp_impl/cache_guard.hpp"
+#include "caret_analyze_cpp_impl/record.hpp"
+
+// Sorted index on one column of a records object.
+// Holds (value, position) entries ordered by value and then by position,
+// where position is the index of the record in iteration order.
+class JoinIndex
+{
+public:
+  using EntryT = std::pair<uint64_t, size_t>;
+
+  explicit JoinIndex(size_t column_hash);
+
+  // Adds the record at the given position. Positions must be added in increasing order.
+  void add(const Record & record, size_t position);
+
+  size_t get_column_hash() const;
+  const std::vector<EntryT> & get_entries() const;
+  // Positions of records without the column, in increasing order.
+  const std::vector<size_t> & get_missing_positions() const;
+
+  size_t memory_usage() const;
+
+private:
+  void flush() const;
+
+  size_t column_hash_;
+  // Entries added out of order are merged into entries_ on the next access.
+  mutable std::vector<EntryT> entries_;
+  mutable std::vector<EntryT> pending_;
+  CacheGuard is_flushed_;
+  std::vector<size_t> missing_positions_;
+};
+
+#endif  // CARET_ANALYZE_CPP_IMPL__JOIN_INDEX_HPP_
+#define CARET_ANALYZE_CPP_IMPL__JOIN_INDEX_HPP_
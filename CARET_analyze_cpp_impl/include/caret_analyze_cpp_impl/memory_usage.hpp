@@ -0,0 +1,123 @@
+// Copyright 2021 Research Institute of Systems Planning, Inc.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#ifndef CARET_ANALYZE_CPP_IMPL__MEMORY_USAGE_HPP_
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <string>
+
+// Breakdown of the bytes held by an object, as requested from the allocator.
+struct MemoryUsage
+{
+  // Column values (and their column hashes in records).
+  size_t values = 0;
+  // Hash table nodes and buckets, sort keys and the objects themselves.
+  size_t container_overhead = 0;
+  // Reserved but unused vector capacity.
+  size_t vector_slack = 0;
+  size_t column_names = 0;
+  size_t indexes = 0;
+
+  size_t total() const;
+  MemoryUsage & operator+=(const MemoryUsage & other);
+
+  // Heap bytes of a string outside the small string buffer.
+  static size_t get_string_heap_size(const std::string & str);
+};
+
+// Bytes currently allocated through CountingAllocator, with the peak since the last reset.
+// Each thread batches its counts locally and publishes them once they exceed flush_threshold
+// bytes, when it exits, or when it reads the counter, so the shared atomics are not touched on
+// every allocation. Counts of other running threads may lag by up to flush_threshold bytes each.
+// Memory freed by one thread before the allocating thread publishes can take the shared count
+// below zero for a while, so it is read as zero until then.
+class MemoryCounter
+{
+public:
+  MemoryCounter(const MemoryCounter &) = delete;
+  MemoryCounter & operator=(const MemoryCounter &) = delete;
+  MemoryCounter(MemoryCounter &&) = delete;
+  MemoryCounter & operator=(MemoryCounter &&) = delete;
+
+  static constexpr size_t flush_threshold = 64 * 1024;
+
+  static MemoryCounter & get_instance();
+
+  void add(size_t bytes);
+  void sub(size_t bytes);
+
+  size_t get_current();
+  size_t get_peak();
+  // Bytes allocated since start-up, regardless of deallocation.
+  size_t get_total_allocated();
+  void reset_peak();
+
+private:
+  friend struct ThreadMemoryCounter;
+
+  MemoryCounter() = default;
+  ~MemoryCounter() = default;
+
+  void publish(int64_t current_delta, size_t total_delta);
+  size_t load_current() const;
+
+  // Signed, as publications from different threads may arrive out of order.
+  std::atomic<int64_t> current_{0};
+  std::atomic<size_t> peak_{0};
+  std::atomic<size_t> total_{0};
+};
+
+template<typename T>
+class CountingAllocator
+{
+public:
+  using value_type = T;
+
+  CountingAllocator() noexcept = default;
+  template<typename U>
+  CountingAllocator(const CountingAllocator<U> &) noexcept  // NOLINT
+  {
+  }
+
+  T * allocate(size_t n)
+  {
+    auto p = std::allocator<T>().allocate(n);
+    MemoryCounter::get_instance().add(n * sizeof(T));
+    return p;
+  }
+
+  void deallocate(T * p, size_t n) noexcept
+  {
+    MemoryCounter::get_instance().sub(n * sizeof(T));
+    std::allocator<T>().deallocate(p, n);
+  }
+};
+
+template<typename T, typename U>
+bool operator==(const CountingAllocator<T> &, const CountingAllocator<U> &) noexcept
+{
+  return true;
+}
+
+template<typename T, typename U>
+bool operator!=(const CountingAllocator<T> &, const CountingAllocator<U> &) noexcept
+{
+  return false;
+}
+
+#endif  // CARET_ANALYZE_CPP_IMPL__MEMORY_USAGE_HPP_
+#define CARET_ANALYZE_CPP_IMPL__MEMORY_USAGE_HPP_
@@ -0,0 +1,60 @@
+// Copyright 2021 Research Institute of Systems Planning, Inc.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#ifndef CARET_ANALYZE_CPP_IMPL__MERGE_CACHE_HPP_
+
+#include <string>
+#include <memory>
+#include <vector>
+
+#include "caret_analyze_cpp_impl/records_base.hpp"
+
+// Persistent cache of merge results.
+// Results are stored in cache_dir, keyed by a fingerprint of the input records
+// (columns and contents) and the merge parameters.
+class MergeCache
+{
+public:
+  MergeCache(const MergeCache &) = delete;
+  MergeCache & operator=(const MergeCache &) = delete;
+  MergeCache(MergeCache &&) = delete;
+  MergeCache & operator=(MergeCache &&) = delete;
+
+  static MergeCache & get_instance();
+
+  void enable(std::string cache_dir);
+  void disable();
+  bool is_enabled() const;
+
+  std::string make_key(
+    std::string operation,
+    const std::vector<const RecordsBase *> & inputs,
+    const std::vector<std::string> & params) const;
+
+  // Returns nullptr when there is no valid entry for the key.
+  std::unique_ptr<RecordsBase> load(const std::string & key) const;
+  void store(const std::string & key, const RecordsBase & records) const;
+
+private:
+  MergeCache() = default;
+  ~MergeCache() = default;
+
+  std::string get_path(const std::string & key) const;
+
+  bool enabled_ = false;
+  std::string cache_dir_;
+};
+
+#endif  // CARET_ANALYZE_CPP_IMPL__MERGE_CACHE_HPP_
+#define CARET_ANALYZE_CPP_IMPL__MERGE_CACHE_HPP_
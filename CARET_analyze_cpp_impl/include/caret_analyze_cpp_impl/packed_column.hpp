@@ -0,0 +1,98 @@
+// Copyright 2021 Research Institute of Systems Planning, Inc.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#ifndef CARET_ANALYZE_CPP_IMPL__PACKED_COLUMN_HPP_
+
+#include <cstdint>
+#include <vector>
+
+#include "caret_analyze_cpp_impl/record.hpp"
+
+// Values of a column compressed with frame-of-reference encoding. Positions are
+// split into blocks of block_size; each block stores its minimum value and the
+// offsets from it, bit-packed with the width of the largest offset. Timestamps
+// of a block typically fit in 32 bits or less; blocks with wider offsets store
+// them unpacked. The last block is kept unpacked until it is full.
+//
+// Offsets are packed into lane_count interleaved 32-bit streams, position i in
+// stream i % lane_count, so that all lanes of a row share the same bit offset
+// and decoding vectorizes.
+class PackedColumn
+{
+public:
+  static constexpr size_t block_size = 128;
+  static constexpr size_t lane_count = 8;
+
+  struct BlockInfo
+  {
+    size_t count = 0;
+    // Range of the values in the block. min > max when no record has the column.
+    uint64_t min = UINT64_MAX;
+    uint64_t max = 0;
+    bool has_missing = false;
+  };
+
+  explicit PackedColumn(size_t column_hash);
+
+  // Adds the record at the next position.
+  void add(const Record & record);
+  // Removes every position.
+  void clear();
+  // Releases unused capacity once no more records are added.
+  void shrink_to_fit();
+
+  size_t get_column_hash() const;
+  size_t size() const;
+  size_t get_block_count() const;
+  BlockInfo get_block(size_t block) const;
+  // Whether the values are non-decreasing, with missing values taken as UINT64_MAX.
+  bool is_ascending() const;
+  bool has_value(size_t position) const;
+  // Value at a position. UINT64_MAX when the record does not have the column.
+  uint64_t get(size_t position) const;
+  // Writes the values of a block to values and returns their count.
+  // Missing values are written as UINT64_MAX.
+  size_t decode_block(size_t block, uint64_t * values) const;
+  // Appends every value to values, missing values as UINT64_MAX.
+  void decode(std::vector<uint64_t> & values) const;
+
+  size_t memory_usage() const;
+
+private:
+  struct Block
+  {
+    uint64_t base;
+    uint64_t max;
+    size_t offset;
+    // 0 to 32, or 64 for unpacked offsets.
+    uint8_t bit_width;
+    bool has_missing;
+  };
+
+  void pack_open_block();
+
+  size_t column_hash_;
+  std::vector<Block> blocks_;
+  // Offsets of the full blocks, bit-packed or unpacked by width.
+  std::vector<uint32_t> words_;
+  std::vector<uint64_t> wide_offsets_;
+  // One bit per position, set when the record has the column.
+  std::vector<uint64_t> present_;
+  std::vector<uint64_t> open_values_;
+  uint64_t last_value_ = 0;
+  bool ascending_ = true;
+};
+
+#endif  // CARET_ANALYZE_CPP_IMPL__PACKED_COLUMN_HPP_
+#define CARET_ANALYZE_CPP_IMPL__PACKED_COLUMN_HPP_
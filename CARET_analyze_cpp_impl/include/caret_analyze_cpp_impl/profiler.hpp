@@ -0,0 +1,105 @@
+// Copyright 2021 Research Institute of Systems Planning, Inc.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#ifndef CARET_ANALYZE_CPP_IMPL__PROFILER_HPP_
+
+#include <atomic>
+#include <chrono>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+#include "caret_analyze_cpp_impl/tracer.hpp"
+
+class RecordsBase;
+
+struct OperationStats
+{
+  uint64_t call_count = 0;
+  // Inclusive wall time [ns].
+  uint64_t wall_time = 0;
+  uint64_t rows_in = 0;
+  uint64_t rows_out = 0;
+  // Bytes allocated for records during the operation, counted by CountingAllocator
+  // on all threads.
+  uint64_t bytes_allocated = 0;
+
+  void merge(const OperationStats & other);
+};
+
+// Opt-in per-operation counters.
+// Each thread collects into its own table; get_stats() sums the tables of all threads.
+class Profiler
+{
+public:
+  Profiler(const Profiler &) = delete;
+  Profiler & operator=(const Profiler &) = delete;
+  Profiler(Profiler &&) = delete;
+  Profiler & operator=(Profiler &&) = delete;
+
+  static Profiler & get_instance();
+
+  void enable();
+  void disable();
+  bool is_enabled() const
+  {
+    return enabled_.load(std::memory_order_relaxed);
+  }
+
+  void add(const char * operation, const OperationStats & stats);
+  std::map<std::string, OperationStats> get_stats() const;
+  void reset_stats();
+
+private:
+  Profiler() = default;
+  ~Profiler() = default;
+
+  struct ThreadStats
+  {
+    std::mutex mutex;
+    std::unordered_map<std::string, OperationStats> stats;
+  };
+
+  ThreadStats & get_thread_stats();
+
+  std::atomic<bool> enabled_{false};
+  mutable std::mutex mutex_;
+  std::vector<std::shared_ptr<ThreadStats>> thread_stats_;
+};
+
+// Measures one call of an operation, and traces it as a span when the tracer is enabled.
+// Does nothing when both are disabled.
+class ProfileScope
+{
+public:
+  ProfileScope(const char * operation, size_t rows_in);
+  ~ProfileScope();
+
+  void set_output(const RecordsBase & records);
+  std::unique_ptr<RecordsBase> set_output(std::unique_ptr<RecordsBase> records);
+
+private:
+  const char * operation_;
+  bool enabled_;
+  OperationStats stats_;
+  size_t allocated_at_start_ = 0;
+  std::chrono::steady_clock::time_point start_;
+  TraceScope trace_scope_;
+};
+
+#endif  // CARET_ANALYZE_CPP_IMPL__PROFILER_HPP_
+#define CARET_ANALYZE_CPP_IMPL__PROFILER_HPP_
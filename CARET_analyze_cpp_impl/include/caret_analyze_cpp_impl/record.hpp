@@ -28,16 +28,31 @@
 #include <iterator>
 
 #include "caret_analyze_cpp_impl/column_manager.hpp"
+#include "caret_analyze_cpp_impl/memory_usage.hpp"
+#include "caret_analyze_cpp_impl/record_arena.hpp"
 
 
 class Record
 {
 public:
+  using AllocatorT = RecordAllocator<std::pair<const size_t, uint64_t>>;
+
   Record();
+  // Records allocated from an arena. A copy made with the copy constructor is
+  // allocated from the heap.
+  explicit Record(const AllocatorT & allocator);
+  Record(std::unordered_map<std::string, uint64_t> dict, const AllocatorT & allocator);
+  Record(const Record & record, const AllocatorT & allocator);
+  // Takes over the storage of record when it uses the same allocator.
+  Record(Record && record, const AllocatorT & allocator);
   explicit Record(std::unordered_map<std::string, uint64_t> dict);
   Record(const Record & record);
+  Record(Record && record) = default;
   ~Record() = default;
 
+  Record & operator=(const Record & record) = default;
+  Record & operator=(Record && record) = default;
+
   std::unordered_map<std::string, uint64_t> get_data() const;
   std::unordered_set<std::string> get_columns() const;
 
@@ -48,10 +63,30 @@ public:
   uint64_t get_with_default(std::string column, uint64_t default_value) const;
   void add(std::string column, uint64_t stamp);
   void drop_columns(std::vector<std::string> columns);
-  bool has_column(const std::string column);
+  bool has_column(const std::string column) const;
+
+  // Accessors by column hash (see ColumnManager::get_hash).
+  // These do not touch ColumnManager, so they can be used from worker threads.
+  uint64_t get(size_t column_hash) const;
+  uint64_t get_with_default(size_t column_hash, uint64_t default_value) const;
+  void add(size_t column_hash, uint64_t stamp);
+  bool has_column(size_t column_hash) const;
+
+  MemoryUsage memory_usage() const;
+
+  template<typename FuncT>
+  void for_each(FuncT func) const
+  {
+    for (auto & pair : data_) {
+      func(pair.first, pair.second);
+    }
+  }
 
 private:
-  std::unordered_map<size_t, uint64_t> data_;
+  using DataT = std::unordered_map<
+    size_t, uint64_t, std::hash<size_t>, std::equal_to<size_t>, AllocatorT>;
+
+  DataT data_;
 };
 
 
@@ -0,0 +1,131 @@
+// Copyright 2021 Research Institute of Systems Planning, Inc.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#ifndef CARET_ANALYZE_CPP_IMPL__RECORD_ARENA_HPP_
+
+#include <cstddef>
+#include <memory>
+#include <memory_resource>
+#include <mutex>
+#include <type_traits>
+
+#include "caret_analyze_cpp_impl/memory_usage.hpp"
+
+// Monotonic allocator for record storage. Memory is taken from the heap in large
+// blocks and is released all at once when the arena is destroyed; deallocation
+// is a no-op. Allocation is serialized by a mutex, so records sharing an arena
+// may be modified from different threads.
+class RecordArena
+{
+public:
+  RecordArena();
+  RecordArena(const RecordArena &) = delete;
+  RecordArena & operator=(const RecordArena &) = delete;
+  ~RecordArena();
+
+  void * allocate(size_t bytes, size_t alignment);
+
+  // Bytes taken from the heap, including the unused part of the current block.
+  size_t get_allocated_size() const;
+  // Bytes handed out to records.
+  size_t get_used_size() const;
+
+private:
+  // Heap resource which reports blocks to MemoryCounter.
+  class CountingResource : public std::pmr::memory_resource
+  {
+public:
+    size_t get_allocated_size() const;
+
+private:
+    void * do_allocate(size_t bytes, size_t alignment) override;
+    void do_deallocate(void * p, size_t bytes, size_t alignment) override;
+    bool do_is_equal(const std::pmr::memory_resource & other) const noexcept override;
+
+    size_t allocated_size_ = 0;
+  };
+
+  mutable std::mutex mutex_;
+  CountingResource upstream_;
+  std::pmr::monotonic_buffer_resource resource_;
+  size_t used_size_ = 0;
+};
+
+// Allocator of record hash tables. Allocates from an arena when given one and
+// from the heap otherwise. The arena is not owned: the records object that owns it
+// keeps it alive, and records leaving that object are copied to the heap.
+template<typename T>
+class RecordAllocator
+{
+public:
+  using value_type = T;
+  using propagate_on_container_move_assignment = std::true_type;
+  using propagate_on_container_swap = std::true_type;
+
+  RecordAllocator() noexcept = default;
+  explicit RecordAllocator(RecordArena * arena) noexcept
+  : arena_(arena)
+  {
+  }
+  template<typename U>
+  RecordAllocator(const RecordAllocator<U> & other) noexcept  // NOLINT
+  : arena_(other.get_arena())
+  {
+  }
+
+  T * allocate(size_t n)
+  {
+    if (arena_) {
+      return static_cast<T *>(arena_->allocate(n * sizeof(T), alignof(T)));
+    }
+    return CountingAllocator<T>().allocate(n);
+  }
+
+  void deallocate(T * p, size_t n) noexcept
+  {
+    if (!arena_) {
+      CountingAllocator<T>().deallocate(p, n);
+    }
+  }
+
+  // Copies of a record are allocated from the heap, so that a copy handed out
+  // does not depend on the arena.
+  RecordAllocator select_on_container_copy_construction() const
+  {
+    return RecordAllocator();
+  }
+
+  RecordArena * get_arena() const
+  {
+    return arena_;
+  }
+
+private:
+  RecordArena * arena_ = nullptr;
+};
+
+template<typename T, typename U>
+bool operator==(const RecordAllocator<T> & a, const RecordAllocator<U> & b) noexcept
+{
+  return a.get_arena() == b.get_arena();
+}
+
+template<typename T, typename U>
+bool operator!=(const RecordAllocator<T> & a, const RecordAllocator<U> & b) noexcept
+{
+  return !(a == b);
+}
+
+#endif  // CARET_ANALYZE_CPP_IMPL__RECORD_ARENA_HPP_
+#define CARET_ANALYZE_CPP_IMPL__RECORD_ARENA_HPP_
@@ -20,6 +20,11 @@
 #include "caret_analyze_cpp_impl/iterator_base.hpp"
 #include "caret_analyze_cpp_impl/iterator_vector_impl.hpp"
 #include "caret_analyze_cpp_impl/iterator_map_impl.hpp"
+#include "caret_analyze_cpp_impl/columnar_records.hpp"
+#include "caret_analyze_cpp_impl/merge_cache.hpp"
+#include "caret_analyze_cpp_impl/profiler.hpp"
+#include "caret_analyze_cpp_impl/spill_sorter.hpp"
+#include "caret_analyze_cpp_impl/tracer.hpp"
 
 #endif  // CARET_ANALYZE_CPP_IMPL__RECORDS_HPP_
 #define CARET_ANALYZE_CPP_IMPL__RECORDS_HPP_
@@ -26,11 +26,29 @@
 #include <utility>
 #include <iterator>
 
+#include "caret_analyze_cpp_impl/cache_guard.hpp"
 #include "caret_analyze_cpp_impl/column_manager.hpp"
 #include "caret_analyze_cpp_impl/record.hpp"
+#include "caret_analyze_cpp_impl/dictionary_column.hpp"
+#include "caret_analyze_cpp_impl/join_index.hpp"
+#include "caret_analyze_cpp_impl/packed_column.hpp"
 #include "caret_analyze_cpp_impl/iterator_base.hpp"
 
 
+// Statistics of the non-null values of a column, in iteration order.
+struct ColumnStats
+{
+  uint64_t min = UINT64_MAX;
+  uint64_t max = 0;
+  size_t count = 0;
+  bool ascending = true;
+  bool descending = true;
+  bool strict = true;  // no two consecutive values are equal
+  uint64_t last = 0;
+
+  void update(uint64_t value);
+};
+
 class RecordsBase
 {
 public:
@@ -47,16 +65,38 @@ public:
   virtual std::unique_ptr<ConstIteratorBase> cbegin() const;
   virtual std::unique_ptr<IteratorBase> rbegin();
   virtual std::unique_ptr<ConstIteratorBase> crbegin() const;
+  // Record at the given position in iteration order.
+  virtual const Record & at(size_t index) const;
 
   virtual std::unique_ptr<RecordsBase> clone() const;
   void append_column(const std::string column, const std::vector<uint64_t> values);
   void rename_columns(std::unordered_map<std::string, std::string> renames);
   virtual void append(const Record & record);
+  // Takes over the storage of record when it uses the allocator of these records.
+  virtual void append(Record && record);
+  void append(std::vector<Record> && records);
+  // Appends a record constructed from args, allocated like the other records.
+  template<typename ... ArgsT>
+  void emplace(ArgsT && ... args)
+  {
+    append(Record(std::forward<ArgsT>(args)..., get_record_allocator()));
+  }
+  virtual void reserve(size_t size);
+  virtual void shrink_to_fit();
+  // Moves the records out in iteration order, leaving these records empty.
+  virtual std::vector<Record> release_data();
   void drop_columns(std::vector<std::string> column_names);
 
   void concat(RecordsBase & other);
+  // Concatenates inputs in order. With a sort_key, the result is sorted on it: inputs that
+  // are all sorted on the key are combined by a k-way merge, otherwise the result is sorted.
+  static std::unique_ptr<RecordsBase> concat_many(
+    const std::vector<const RecordsBase *> & inputs, std::string sort_key);
   std::vector<std::unordered_map<std::string, uint64_t>> get_named_data() const;
 
+  void to_csv(std::string path, std::vector<std::string> columns) const;
+  static std::unique_ptr<RecordsBase> from_csv(std::string path);
+
   void set_columns(const std::vector<std::string> columns);
   virtual bool equals(const RecordsBase & other) const;
   virtual void filter_if(const std::function<bool(Record)> & f);
@@ -64,6 +104,39 @@ public:
   virtual void sort_column_order(bool ascending = true, bool put_none_at_top = true);
   virtual void bind_drop_as_delay();
 
+  // Records whose column value is in [t_start, t_end].
+  // Uses binary search when the records are known to be sorted on the column.
+  virtual std::unique_ptr<RecordsBase> clip(
+    std::string column, uint64_t t_start, uint64_t t_end) const;
+  std::string get_sorted_column() const;
+  ColumnStats get_column_stats(std::string column) const;
+  bool is_sorted_on(std::string column) const;
+
+  // Sorted index on a column, kept up to date by append() and dropped by other
+  // modifications. merge() uses indexes on the join keys and merge_sequential()
+  // uses indexes on the stamp keys.
+  void build_index(std::string column);
+  bool has_index(std::string column) const;
+  const JoinIndex * get_index(std::string column) const;
+
+  // Dictionary-encoded copy of a column, kept up to date by append() and re-encoded
+  // on the next access after other modifications. merge(), merge_sequential() and
+  // groupby() work on the codes when all of their key columns are encoded.
+  // The copy is held in addition to the records; ColumnarRecords stores records
+  // encoded in place of their hash tables.
+  void encode_column(std::string column);
+  bool has_encoded_column(std::string column) const;
+  const DictionaryColumn * get_encoded_column(std::string column) const;
+
+  // Frame-of-reference compressed copy of a column, maintained like an encoded
+  // column. clip() skips blocks out of range and merge_sequential() reads stamps
+  // from it block by block.
+  // Like an encoded column, it is held in addition to the records; ColumnarRecords
+  // stores packed columns in place of the record values.
+  void pack_column(std::string column);
+  bool has_packed_column(std::string column) const;
+  const PackedColumn * get_packed_column(std::string column) const;
+
   void reindex(std::vector<std::string> columns);
   std::map<std::tuple<uint64_t>, std::unique_ptr<RecordsBase>> groupby(
     std::string column0
@@ -96,6 +169,42 @@ public:
     std::string how
   );
 
+  // Joins on tuples of key columns. A record missing any of the key columns
+  // has no join key. An empty key list in merge_sequential() means no join key.
+  std::unique_ptr<RecordsBase> merge(
+    const RecordsBase & right_records,
+    std::vector<std::string> join_left_keys,
+    std::vector<std::string> join_right_keys,
+    std::vector<std::string> columns,
+    std::string how
+  );
+
+  std::unique_ptr<RecordsBase> merge_sequential(
+    const RecordsBase & right_records,
+    std::string left_stamp_key,
+    std::string right_stamp_key,
+    std::vector<std::string> join_left_keys,
+    std::vector<std::string> join_right_keys,
+    std::vector<std::string> columns,
+    std::string how
+  );
+
+  // For each left record, joins the right record whose right_stamp_key value is
+  // closest to its left_stamp_key value in the given direction:
+  // "backward" (last at or before), "forward" (first at or after) or "nearest".
+  // Only records with equal join key values are matched unless the keys are empty,
+  // and the distance must be at most tolerance. Every left record is kept, in order.
+  std::unique_ptr<RecordsBase> merge_asof(
+    const RecordsBase & right_records,
+    std::string left_stamp_key,
+    std::string right_stamp_key,
+    std::string join_left_key,
+    std::string join_right_key,
+    std::vector<std::string> columns,
+    std::string direction,
+    uint64_t tolerance
+  ) const;
+
   std::unique_ptr<RecordsBase> merge_sequential_for_addr_track(
     std::string source_stamp_key,
     std::string source_key,
@@ -108,7 +217,124 @@ public:
     std::string sink_from_key
   );
 
+  // Bytes held by the records, broken down by purpose.
+  virtual MemoryUsage memory_usage() const;
+
+  // Arena from which appended records are allocated; records are allocated from
+  // the heap when it is null. Must be set while there are no records.
+  // get_data() and release_data() return records allocated from the heap.
+  void set_arena(std::shared_ptr<RecordArena> arena);
+  std::shared_ptr<RecordArena> get_arena() const;
+
+protected:
+  // Memory of the members of RecordsBase: column names, sorted column, stats and indexes.
+  MemoryUsage get_base_memory_usage() const;
+  void set_sorted_column(std::string column);
+  void update_column_stats(const Record & record);
+  void invalidate_column_stats();
+  void update_indexes(const Record & record, size_t position);
+  void invalidate_indexes();
+  Record::AllocatorT get_record_allocator() const;
+
+  // Column on which the records are known to be sorted in ascending order.
+  // Empty when unknown.
+  std::string sorted_column_;
+  size_t sorted_column_hash_ = 0;
+
+  // Statistics computed on demand, keyed by column hash.
+  // Kept up to date by append() once computed.
+  mutable std::unordered_map<size_t, ColumnStats> column_stats_;
+  mutable CacheMutex column_stats_mutex_;
+
+  // Indexes keyed by column hash.
+  std::unordered_map<size_t, JoinIndex> indexes_;
+
+  // Encoded columns keyed by column hash. Their codes are rebuilt on access when stale.
+  mutable std::unordered_map<size_t, DictionaryColumn> encoded_columns_;
+  CacheGuard are_encoded_columns_valid_;
+
+  // Packed columns keyed by column hash. Rebuilt on access when stale.
+  mutable std::unordered_map<size_t, PackedColumn> packed_columns_;
+  CacheGuard are_packed_columns_valid_;
+
+  std::shared_ptr<RecordArena> arena_;
+
 private:
+  // Join key value of each record in iteration order.
+  // Values of records without a join key are UINT64_MAX.
+  struct JoinKeys
+  {
+    std::vector<uint64_t> values;
+    std::vector<uint8_t> is_valid;
+    // When nonzero, values other than UINT64_MAX are ranks below value_count,
+    // numbered on the values of both sides in value order.
+    uint64_t value_count = 0;
+  };
+
+  JoinKeys get_join_keys(std::string join_key) const;
+  // Join keys of both sides, ranked from the dictionaries when both keys are encoded.
+  static std::pair<JoinKeys, JoinKeys> get_join_keys(
+    const RecordsBase & left_records,
+    std::string join_left_key,
+    const RecordsBase & right_records,
+    std::string join_right_key);
+  static std::pair<JoinKeys, JoinKeys> get_encoded_join_keys(
+    const DictionaryColumn & left_column,
+    const DictionaryColumn & right_column);
+  // With max_as_none, tuples with a UINT64_MAX component get the join value UINT64_MAX,
+  // which merge_sequential() takes as None.
+  static std::pair<JoinKeys, JoinKeys> get_composite_join_keys(
+    const RecordsBase & left_records,
+    const std::vector<std::string> & join_left_keys,
+    const RecordsBase & right_records,
+    const std::vector<std::string> & join_right_keys,
+    bool max_as_none);
+
+  std::unique_ptr<RecordsBase> merge_impl(
+    const RecordsBase & right_records,
+    const JoinKeys & left_keys,
+    const JoinKeys & right_keys,
+    std::vector<std::string> columns,
+    std::string how
+  ) const;
+
+  std::unique_ptr<RecordsBase> merge_sequential_impl(
+    const RecordsBase & right_records,
+    std::string left_stamp_key,
+    std::string right_stamp_key,
+    const JoinKeys & left_keys,
+    const JoinKeys & right_keys,
+    std::vector<std::string> columns,
+    std::string how
+  ) const;
+
+  JoinIndex create_index(std::string column) const;
+  const DictionaryColumn * get_encoded_column(size_t column_hash) const;
+  const PackedColumn * get_packed_column(size_t column_hash) const;
+
+  // Splits the records into groups by the codes of the encoded columns.
+  // get_group_records is called with the first record of each group and returns the
+  // records to append the group to. Returns false when a column is not encoded.
+  bool groupby_encoded(
+    const std::vector<std::string> & columns,
+    const std::function<RecordsBase *(const Record &)> & get_group_records) const;
+
+  std::unique_ptr<RecordsBase> merge_with_index(
+    const RecordsBase & right_records,
+    const JoinIndex & left_index,
+    const JoinIndex & right_index,
+    std::vector<std::string> columns,
+    std::string how
+  ) const;
+
+  std::unique_ptr<RecordsBase> merge_out_of_core(
+    const RecordsBase & right_records,
+    std::string join_left_key,
+    std::string join_right_key,
+    std::vector<std::string> columns,
+    std::string how
+  ) const;
+
   std::vector<std::string> columns_;
 };
 
@@ -26,6 +26,7 @@
 #include <vector>
 #include <iterator>
 
+#include "caret_analyze_cpp_impl/cache_guard.hpp"
 #include "caret_analyze_cpp_impl/column_manager.hpp"
 #include "caret_analyze_cpp_impl/iterator_base.hpp"
 #include "caret_analyze_cpp_impl/records_base.hpp"
@@ -50,15 +51,25 @@ public:
 
   ~RecordsMapImpl() override;
 
-  using KeyT = std::tuple<std::uint64_t, uint64_t, uint64_t>;
-  using DataT = std::multimap<KeyT, Record>;
+  // Records are kept in an append buffer and stable-sorted by key on the first
+  // ordered access, which gives the same order as a multimap keyed by the key columns.
+  // Keys of any width are stored flat, key_columns.size() values per record.
+  // A record without a key column sorts as if the value were UINT64_MAX.
+  // sort() and sort_column_order() re-key the container in place; records appended
+  // afterwards are ordered by the new key.
+  using DataT = std::vector<Record, CountingAllocator<Record>>;
   using Iterator = DataT::iterator;
   using ConstIterator = DataT::const_iterator;
   using ReverseIterator = DataT::reverse_iterator;
   using ConstReverseIterator = DataT::const_reverse_iterator;
 
   std::vector<Record> get_data() const override;
+  std::vector<Record> release_data() override;
+  using RecordsBase::append;
   void append(const Record & record) override;
+  void append(Record && record) override;
+  void reserve(size_t size) override;
+  void shrink_to_fit() override;
   std::unique_ptr<RecordsBase> clone() const override;
 
   void filter_if(const std::function<bool(Record)> & f);
@@ -72,14 +83,25 @@ public:
   std::unique_ptr<ConstIteratorBase> cbegin() const override;
   std::unique_ptr<IteratorBase> rbegin() override;
   std::unique_ptr<ConstIteratorBase> crbegin() const override;
+  const Record & at(size_t index) const override;
+  MemoryUsage memory_usage() const override;
 
 private:
-  KeyT make_key(const Record & record);
+  void rekey(
+    const std::vector<std::string> & key_columns,
+    bool ascending,
+    uint64_t default_value);
+  void add_key(const Record & record);
+  bool key_less(size_t a, size_t b) const;
+  void sort_by_key() const;
 
   std::unique_ptr<DataT> data_;
+  mutable std::vector<uint64_t> keys_;
+  CacheGuard is_sorted_;
   std::vector<std::string> key_columns_;
-
-  const size_t max_key_size_ = 3;
+  std::vector<size_t> key_column_hashes_;
+  uint64_t key_mask_ = 0;
+  uint64_t key_default_value_ = UINT64_MAX;
 };
 
 
@@ -47,20 +47,27 @@ public:
 
   ~RecordsVectorImpl() override;
 
-  using DataT = std::vector<Record>;
+  using DataT = std::vector<Record, CountingAllocator<Record>>;
   using Iterator = DataT::iterator;
   using ConstIterator = DataT::const_iterator;
   using ReverseIterator = DataT::reverse_iterator;
   using ConstReverseIterator = DataT::const_reverse_iterator;
 
   std::vector<Record> get_data() const override;
+  std::vector<Record> release_data() override;
+  using RecordsBase::append;
   void append(const Record & record) override;
+  void append(Record && record) override;
+  void reserve(size_t size) override;
+  void shrink_to_fit() override;
   std::unique_ptr<RecordsBase> clone() const override;
 
   void filter_if(const std::function<bool(Record)> & f) override;
   void sort(std::string key, std::string sub_key = "", bool ascending = true);
   void sort_column_order(bool ascending = true, bool put_none_at_top = true);
   void bind_drop_as_delay();
+  std::unique_ptr<RecordsBase> clip(
+    std::string column, uint64_t t_start, uint64_t t_end) const override;
 
   std::size_t size() const override;
 
@@ -68,6 +75,8 @@ public:
   std::unique_ptr<ConstIteratorBase> cbegin() const override;
   std::unique_ptr<IteratorBase> rbegin() override;
   std::unique_ptr<ConstIteratorBase> crbegin() const override;
+  const Record & at(size_t index) const override;
+  MemoryUsage memory_usage() const override;
 
 private:
   std::unique_ptr<DataT> data_;
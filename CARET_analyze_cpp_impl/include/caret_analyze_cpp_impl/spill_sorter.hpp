@@ -0,0 +1,121 @@
+// Copyright 2021 Research Institute of Systems Planning, Inc.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#ifndef CARET_ANALYZE_CPP_IMPL__SPILL_SORTER_HPP_
+
+#include <fstream>
+#include <memory>
+#include <queue>
+#include <string>
+#include <tuple>
+#include <vector>
+
+#include "caret_analyze_cpp_impl/record.hpp"
+
+// Settings of the out-of-core execution mode.
+// When enabled, operations that support it keep at most memory_budget bytes of
+// intermediate records in memory and spill sorted runs to spill_dir.
+// memory_budget must be at least min_memory_budget bytes.
+class OutOfCoreConfig
+{
+public:
+  OutOfCoreConfig(const OutOfCoreConfig &) = delete;
+  OutOfCoreConfig & operator=(const OutOfCoreConfig &) = delete;
+  OutOfCoreConfig(OutOfCoreConfig &&) = delete;
+  OutOfCoreConfig & operator=(OutOfCoreConfig &&) = delete;
+
+  static const size_t min_memory_budget = 1 << 20;
+
+  static OutOfCoreConfig & get_instance();
+
+  void enable(size_t memory_budget, std::string spill_dir);
+  void disable();
+  bool is_enabled() const;
+  size_t get_memory_budget() const;
+  const std::string & get_spill_dir() const;
+
+private:
+  OutOfCoreConfig() = default;
+  ~OutOfCoreConfig() = default;
+
+  bool enabled_ = false;
+  size_t memory_budget_ = 0;
+  std::string spill_dir_;
+};
+
+// External stable sort of records by (key0, key1).
+// Each entry also carries a tag that is not used for ordering.
+// Usage: add() all entries, then call next() until it returns false.
+// Runs are merged in passes, with at most max_open_runs run files open at a time.
+class SpillSorter
+{
+public:
+  SpillSorter(size_t memory_budget, std::string spill_dir, size_t max_open_runs = 64);
+  ~SpillSorter();
+
+  void add(uint64_t key0, uint64_t key1, uint64_t tag, Record record);
+  bool next(uint64_t & key0, uint64_t & key1, uint64_t & tag, Record & record);
+
+  size_t get_run_count() const;
+
+private:
+  struct Entry
+  {
+    uint64_t key0;
+    uint64_t key1;
+    uint64_t seq;
+    uint64_t tag;
+    Record record;
+  };
+
+  class RunReader
+  {
+public:
+    explicit RunReader(std::string path);
+    bool read(Entry & entry);
+
+private:
+    std::ifstream ifs_;
+    std::vector<char> buffer_;
+  };
+
+  using HeapItemT = std::tuple<uint64_t, uint64_t, uint64_t, size_t>;
+
+  void spill();
+  void start_reading();
+  std::string create_run_path() const;
+  void write_entry(std::ofstream & ofs, const Entry & entry);
+  std::string merge_runs(size_t first, size_t last);
+
+  size_t memory_budget_;
+  std::string spill_dir_;
+  size_t max_open_runs_;
+  size_t run_count_ = 0;
+  std::vector<uint64_t> words_;
+
+  std::vector<Entry> buffer_;
+  size_t buffered_bytes_ = 0;
+  uint64_t seq_ = 0;
+
+  bool reading_ = false;
+  std::vector<size_t> order_;
+  size_t order_pos_ = 0;
+  std::vector<std::string> run_paths_;
+  std::vector<std::unique_ptr<RunReader>> readers_;
+  std::vector<Entry> heads_;
+  std::priority_queue<HeapItemT, std::vector<HeapItemT>, std::greater<HeapItemT>> heap_;
+};
+
+#endif  // CARET_ANALYZE_CPP_IMPL__SPILL_SORTER_HPP_
+#define CARET_ANALYZE_CPP_IMPL__SPILL_SORTER_HPP_
@@ -0,0 +1,66 @@
+// Copyright 2021 Research Institute of Systems Planning, Inc.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#ifndef CARET_ANALYZE_CPP_IMPL__TRACE_GENERATOR_HPP_
+
+#include <map>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "caret_analyze_cpp_impl/records.hpp"
+
+struct TraceGeneratorConfig
+{
+  // Node i publishes from a timer callback and node (i + 1) % node_count subscribes to it.
+  // Even-numbered publishers use intra-process communication.
+  size_t node_count = 10;
+  // Timer rate of each node [Hz].
+  double rate = 100.0;
+  // Trace length [ns].
+  uint64_t duration = 1000000000;
+  // Ratio of published messages that never reach the subscription callback.
+  double drop_ratio = 0.0;
+  // Number of message addresses each publisher cycles through.
+  size_t address_count = 16;
+  // Nodes are assigned to single-threaded executors in round robin.
+  size_t executor_count = 1;
+  uint64_t seed = 0;
+};
+
+// Generates CARET-like trace records: callback start/end, inter-process publish and
+// dispatch, and intra-process publish, buffer copies and dispatch, which form the
+// source/copy/sink inputs of merge_sequential_for_addr_track.
+// The output only depends on the config, including the seed.
+class TraceGenerator
+{
+public:
+  explicit TraceGenerator(TraceGeneratorConfig config);
+
+  std::vector<std::string> get_record_names() const;
+  const RecordsBase & get_records(std::string name) const;
+
+  // Writes <dir>/<name>.yaml for every record, readable by RecordsVectorImpl(file_path).
+  void write(std::string dir) const;
+
+private:
+  void generate();
+  RecordsVectorImpl & records(std::string name);
+
+  TraceGeneratorConfig config_;
+  std::map<std::string, std::unique_ptr<RecordsVectorImpl>> records_;
+};
+
+#endif  // CARET_ANALYZE_CPP_IMPL__TRACE_GENERATOR_HPP_
+#define CARET_ANALYZE_CPP_IMPL__TRACE_GENERATOR_HPP_
@@ -0,0 +1,97 @@
+// Copyright 2021 Research Institute of Systems Planning, Inc.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#ifndef CARET_ANALYZE_CPP_IMPL__TRACER_HPP_
+
+#include <atomic>
+#include <chrono>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
+
+// Timeline of internal operation spans in Chrome Trace Event JSON format,
+// which can be opened with Perfetto or chrome://tracing.
+// Spans are collected per thread and written to the file on disable() or flush().
+class Tracer
+{
+public:
+  Tracer(const Tracer &) = delete;
+  Tracer & operator=(const Tracer &) = delete;
+  Tracer(Tracer &&) = delete;
+  Tracer & operator=(Tracer &&) = delete;
+
+  static Tracer & get_instance();
+
+  void enable(std::string path);
+  void disable();
+  bool is_enabled() const
+  {
+    return enabled_.load(std::memory_order_relaxed);
+  }
+
+  // Writes the spans collected so far. Spans are kept until disable().
+  void flush() const;
+
+  // name must be a string literal.
+  void add_span(
+    const char * name, std::chrono::steady_clock::time_point begin,
+    std::chrono::steady_clock::time_point end);
+
+private:
+  Tracer() = default;
+  ~Tracer() = default;
+
+  struct Span
+  {
+    const char * name;
+    std::chrono::steady_clock::time_point begin;
+    std::chrono::steady_clock::time_point end;
+  };
+
+  struct ThreadSpans
+  {
+    std::mutex mutex;
+    size_t thread_id;
+    std::vector<Span> spans;
+  };
+
+  ThreadSpans & get_thread_spans();
+
+  std::atomic<bool> enabled_{false};
+  mutable std::mutex mutex_;
+  std::string path_;
+  size_t thread_count_ = 0;
+  std::chrono::steady_clock::time_point start_;
+  std::vector<std::shared_ptr<ThreadSpans>> thread_spans_;
+};
+
+// Span from construction until end() or destruction. Does nothing when the tracer is disabled.
+class TraceScope
+{
+public:
+  // name must be a string literal.
+  explicit TraceScope(const char * name);
+  ~TraceScope();
+
+  void end();
+
+private:
+  const char * name_;
+  bool enabled_;
+  std::chrono::steady_clock::time_point begin_;
+};
+
+#endif  // CARET_ANALYZE_CPP_IMPL__TRACER_HPP_
+#define CARET_ANALYZE_CPP_IMPL__TRACER_HPP_
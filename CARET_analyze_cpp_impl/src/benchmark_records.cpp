@@ -0,0 +1,329 @@
+// Copyright 2021 Research Institute of Systems Planning, Inc.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+// Benchmarks of the core record operations.
+// Results can be written as JSON for regression tracking:
+//   benchmark_records --benchmark_out=result.json --benchmark_out_format=json
+// Use --benchmark_filter to select operations or sizes.
+
+#include <benchmark/benchmark.h>
+
+#include <memory>
+#include <random>
+#include <sstream>
+#include <string>
+#include <vector>
+
+#include "caret_analyze_cpp_impl/file.hpp"
+#include "caret_analyze_cpp_impl/records.hpp"
+#include "caret_analyze_cpp_impl/trace_generator.hpp"
+
+namespace
+{
+
+const std::vector<std::string> hows = {"inner", "left", "right", "outer"};
+const std::vector<std::string> sequential_hows = {
+  "inner", "left", "right", "outer", "left_use_latest"};
+
+// Records with an increasing "stamp", a "key" in [0, key_range) and extra value columns.
+// Each value column is missing with probability missing_rate.
+std::unique_ptr<RecordsVectorImpl> make_records(
+  size_t size, std::string stamp, std::vector<std::string> value_columns,
+  uint64_t key_range = 1000, double missing_rate = 0.0, uint64_t seed = 0)
+{
+  std::vector<std::string> columns = {stamp, "key"};
+  columns.insert(columns.end(), value_columns.begin(), value_columns.end());
+  auto records = std::make_unique<RecordsVectorImpl>(columns);
+
+  std::mt19937_64 engine(seed);
+  std::uniform_real_distribution<double> missing(0.0, 1.0);
+  uint64_t stamp_value = 0;
+  for (size_t i = 0; i < size; i++) {
+    Record record;
+    stamp_value += 1 + engine() % 10;
+    record.add(stamp, stamp_value);
+    record.add("key", engine() % key_range);
+    for (auto & column : value_columns) {
+      if (missing(engine) >= missing_rate) {
+        record.add(column, engine());
+      }
+    }
+    records->append(record);
+  }
+  return records;
+}
+
+class YamlFile : public File
+{
+public:
+  explicit YamlFile(std::string data)
+  : data_(data)
+  {
+  }
+
+  const std::string & get_data() const override
+  {
+    return data_;
+  }
+
+private:
+  std::string data_;
+};
+
+void record_sizes(benchmark::internal::Benchmark * b)
+{
+  b->RangeMultiplier(10)->Range(1000, 10000000)->Unit(benchmark::kMillisecond);
+}
+
+// Operations that are quadratic-ish or very slow per row stop at a smaller size.
+void small_record_sizes(benchmark::internal::Benchmark * b)
+{
+  b->RangeMultiplier(10)->Range(1000, 100000)->Unit(benchmark::kMillisecond);
+}
+
+void record_sizes_with_how(benchmark::internal::Benchmark * b, size_t how_count)
+{
+  for (int64_t size = 1000; size <= 10000000; size *= 10) {
+    for (size_t how = 0; how < how_count; how++) {
+      b->Args({size, static_cast<int64_t>(how)});
+    }
+  }
+  b->Unit(benchmark::kMillisecond);
+}
+
+}  // namespace
+
+static void BM_RecordGet(benchmark::State & state)
+{
+  auto records = make_records(state.range(0), "stamp", {"a", "b", "c"});
+  auto data = records->get_data();
+  for (auto _ : state) {
+    uint64_t sum = 0;
+    for (auto & record : data) {
+      sum += record.get("a") + record.get("stamp");
+    }
+    benchmark::DoNotOptimize(sum);
+  }
+  state.SetItemsProcessed(state.iterations() * data.size() * 2);
+}
+BENCHMARK(BM_RecordGet)->Apply(record_sizes);
+
+static void BM_RecordAdd(benchmark::State & state)
+{
+  for (auto _ : state) {
+    std::vector<Record> data(state.range(0));
+    uint64_t i = 0;
+    for (auto & record : data) {
+      record.add("stamp", i);
+      record.add("key", i++);
+    }
+    benchmark::DoNotOptimize(data.data());
+  }
+  state.SetItemsProcessed(state.iterations() * state.range(0) * 2);
+}
+BENCHMARK(BM_RecordAdd)->Apply(record_sizes);
+
+static void BM_RecordMerge(benchmark::State & state)
+{
+  auto left = make_records(state.range(0), "stamp", {"a", "b"}, 1000, 0.0, 1)->get_data();
+  auto right = make_records(state.range(0), "sub_stamp", {"c", "d"}, 1000, 0.0, 2)->get_data();
+  for (auto _ : state) {
+    for (size_t i = 0; i < left.size(); i++) {
+      auto merged = left[i];
+      merged.merge(right[i]);
+      benchmark::DoNotOptimize(merged);
+    }
+  }
+  state.SetItemsProcessed(state.iterations() * state.range(0));
+}
+BENCHMARK(BM_RecordMerge)->Apply(record_sizes);
+
+static void BM_Append(benchmark::State & state)
+{
+  auto data = make_records(state.range(0), "stamp", {"a", "b", "c"})->get_data();
+  for (auto _ : state) {
+    RecordsVectorImpl records(std::vector<std::string>({"stamp", "key", "a", "b", "c"}));
+    for (auto & record : data) {
+      records.append(record);
+    }
+    benchmark::DoNotOptimize(records.size());
+  }
+  state.SetItemsProcessed(state.iterations() * state.range(0));
+}
+BENCHMARK(BM_Append)->Apply(record_sizes);
+
+static void BM_Clone(benchmark::State & state)
+{
+  auto records = make_records(state.range(0), "stamp", {"a", "b", "c"});
+  for (auto _ : state) {
+    auto copy = records->clone();
+    benchmark::DoNotOptimize(copy->size());
+  }
+  state.SetItemsProcessed(state.iterations() * state.range(0));
+}
+BENCHMARK(BM_Clone)->Apply(record_sizes);
+
+static void BM_Sort(benchmark::State & state)
+{
+  auto records = make_records(state.range(0), "stamp", {"a", "b"});
+  for (auto _ : state) {
+    state.PauseTiming();
+    auto copy = records->clone();
+    state.ResumeTiming();
+    copy->sort("key", "stamp", true);
+  }
+  state.SetItemsProcessed(state.iterations() * state.range(0));
+}
+BENCHMARK(BM_Sort)->Apply(record_sizes);
+
+static void BM_SortColumnOrder(benchmark::State & state)
+{
+  auto records = make_records(state.range(0), "stamp", {"a", "b"}, 1000, 0.2);
+  records->sort("key");
+  for (auto _ : state) {
+    state.PauseTiming();
+    auto copy = records->clone();
+    state.ResumeTiming();
+    copy->sort_column_order(true, true);
+  }
+  state.SetItemsProcessed(state.iterations() * state.range(0));
+}
+BENCHMARK(BM_SortColumnOrder)->Apply(record_sizes);
+
+static void BM_FilterIf(benchmark::State & state)
+{
+  auto records = make_records(state.range(0), "stamp", {"a", "b"});
+  for (auto _ : state) {
+    state.PauseTiming();
+    auto copy = records->clone();
+    state.ResumeTiming();
+    copy->filter_if([](Record record) {return record.get("key") % 2 == 0;});
+  }
+  state.SetItemsProcessed(state.iterations() * state.range(0));
+}
+BENCHMARK(BM_FilterIf)->Apply(record_sizes);
+
+static void BM_Groupby(benchmark::State & state)
+{
+  auto records = make_records(state.range(0), "stamp", {"a", "b"}, 100);
+  records->append_column("key2", std::vector<uint64_t>(records->size(), 1));
+  records->append_column("key3", std::vector<uint64_t>(records->size(), 2));
+  auto key_count = state.range(1);
+  for (auto _ : state) {
+    size_t group_count = 0;
+    if (key_count == 1) {
+      group_count = records->groupby("key").size();
+    } else if (key_count == 2) {
+      group_count = records->groupby("key", "key2").size();
+    } else {
+      group_count = records->groupby("key", "key2", "key3").size();
+    }
+    benchmark::DoNotOptimize(group_count);
+  }
+  state.SetItemsProcessed(state.iterations() * state.range(0));
+}
+BENCHMARK(BM_Groupby)
+->ArgsProduct({{1000, 10000, 100000, 1000000, 10000000}, {1, 2, 3}})
+->Unit(benchmark::kMillisecond);
+
+static void BM_Merge(benchmark::State & state)
+{
+  auto left = make_records(state.range(0), "stamp", {"a", "b"}, state.range(0), 0.0, 1);
+  auto right = make_records(state.range(0), "sub_stamp", {"c", "d"}, state.range(0), 0.0, 2);
+  auto how = hows[state.range(1)];
+  state.SetLabel(how);
+  for (auto _ : state) {
+    auto merged = left->merge(*right, "key", "key", {"stamp", "key", "a", "sub_stamp", "c"}, how);
+    benchmark::DoNotOptimize(merged->size());
+  }
+  state.SetItemsProcessed(state.iterations() * state.range(0) * 2);
+}
+BENCHMARK(BM_Merge)->Apply(
+  [](benchmark::internal::Benchmark * b) {record_sizes_with_how(b, hows.size());});
+
+static void BM_MergeSequential(benchmark::State & state)
+{
+  auto left = make_records(state.range(0), "stamp", {"a", "b"}, 100, 0.0, 1);
+  auto right = make_records(state.range(0), "sub_stamp", {"c", "d"}, 100, 0.0, 2);
+  auto how = sequential_hows[state.range(1)];
+  state.SetLabel(how);
+  for (auto _ : state) {
+    auto merged = left->merge_sequential(
+      *right, "stamp", "sub_stamp", "key", "key", {"stamp", "key", "a", "sub_stamp", "c"}, how);
+    benchmark::DoNotOptimize(merged->size());
+  }
+  state.SetItemsProcessed(state.iterations() * state.range(0) * 2);
+}
+BENCHMARK(BM_MergeSequential)->Apply(
+  [](benchmark::internal::Benchmark * b) {record_sizes_with_how(b, sequential_hows.size());});
+
+static void BM_MergeSequentialForAddrTrack(benchmark::State & state)
+{
+  // 10 nodes at 1 kHz give 5000 intra-process messages per second.
+  TraceGeneratorConfig config;
+  config.rate = 1000.0;
+  config.duration = state.range(0) * 200000;
+  config.executor_count = 4;
+  TraceGenerator generator(config);
+
+  auto source = generator.get_records("rclcpp_intra_publish").clone();
+  source->rename_columns({{"message", "source_message"}});
+  auto & copy = generator.get_records("message_construct");
+  auto & sink = generator.get_records("dispatch_intra_process_subscription_callback");
+  for (auto _ : state) {
+    auto merged = source->merge_sequential_for_addr_track(
+      "rclcpp_intra_publish_timestamp", "source_message",
+      copy, "message_construct_timestamp", "original_message", "constructed_message",
+      sink, "dispatch_intra_process_subscription_callback_timestamp", "message");
+    benchmark::DoNotOptimize(merged->size());
+  }
+  state.SetItemsProcessed(state.iterations() * source->size());
+}
+BENCHMARK(BM_MergeSequentialForAddrTrack)->Apply(small_record_sizes);
+
+static void BM_BindDropAsDelay(benchmark::State & state)
+{
+  auto records = make_records(state.range(0), "stamp", {"a", "b", "c"}, 1000, 0.3);
+  for (auto _ : state) {
+    state.PauseTiming();
+    auto copy = records->clone();
+    state.ResumeTiming();
+    copy->bind_drop_as_delay();
+  }
+  state.SetItemsProcessed(state.iterations() * state.range(0));
+}
+BENCHMARK(BM_BindDropAsDelay)->Apply(record_sizes);
+
+static void BM_LoadYaml(benchmark::State & state)
+{
+  std::stringstream ss;
+  for (auto & record : make_records(state.range(0), "stamp", {"a", "b"})->get_named_data()) {
+    ss << "- {";
+    bool is_first = true;
+    for (auto & pair : record) {
+      ss << (is_first ? "" : ", ") << pair.first << ": " << pair.second;
+      is_first = false;
+    }
+    ss << "}\n";
+  }
+  YamlFile file(ss.str());
+  for (auto _ : state) {
+    RecordsVectorImpl records(file);
+    benchmark::DoNotOptimize(records.size());
+  }
+  state.SetBytesProcessed(state.iterations() * file.get_data().size());
+}
+BENCHMARK(BM_LoadYaml)->Apply(small_record_sizes);
+
+BENCHMARK_MAIN();
@@ -0,0 +1,56 @@
+// Copyright 2021 Research Institute of Systems Planning, Inc.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "caret_analyze_cpp_impl/cache_guard.hpp"
+
+CacheGuard::CacheGuard(bool is_valid)
+: is_valid_(is_valid)
+{
+}
+
+CacheGuard::CacheGuard(const CacheGuard & other)
+: is_valid_(other.is_valid())
+{
+}
+
+CacheGuard & CacheGuard::operator=(const CacheGuard & other)
+{
+  is_valid_.store(other.is_valid(), std::memory_order_relaxed);
+  return *this;
+}
+
+bool CacheGuard::is_valid() const
+{
+  return is_valid_.load(std::memory_order_acquire);
+}
+
+void CacheGuard::invalidate()
+{
+  is_valid_.store(false, std::memory_order_relaxed);
+}
+
+void CacheGuard::set_valid()
+{
+  is_valid_.store(true, std::memory_order_relaxed);
+}
+
+CacheMutex::CacheMutex(const CacheMutex &)
+: std::mutex()
+{
+}
+
+CacheMutex & CacheMutex::operator=(const CacheMutex &)
+{
+  return *this;
+}
@@ -13,10 +13,34 @@
 // limitations under the License.
 
 #include <iostream>
+#include <functional>
+#include <memory>
+#include <mutex>
 #include <string>
 
 #include "caret_analyze_cpp_impl/column_manager.hpp"
 
+namespace
+{
+const size_t initial_capacity = 256;
+}  // namespace
+
+ColumnManager::Table::Table(size_t capacity)
+: mask(capacity - 1),
+  by_column(std::make_unique<SlotT[]>(capacity)),
+  by_hash(std::make_unique<SlotT[]>(capacity))
+{
+  for (size_t i = 0; i < capacity; i++) {
+    by_column[i].store(nullptr, std::memory_order_relaxed);
+    by_hash[i].store(nullptr, std::memory_order_relaxed);
+  }
+}
+
+ColumnManager::ColumnManager()
+{
+  tables_.push_back(std::make_unique<Table>(initial_capacity));
+  table_.store(tables_.back().get(), std::memory_order_release);
+}
 
 ColumnManager & ColumnManager::get_instance()
 {
@@ -24,29 +48,119 @@ ColumnManager & ColumnManager::get_instance()
   return instance;
 }
 
-std::string ColumnManager::get_column(size_t hash)
+const ColumnManager::Entry * ColumnManager::find_by_column(
+  const Table & table, const std::string & column, size_t name_hash)
+{
+  for (auto i = name_hash & table.mask; ; i = (i + 1) & table.mask) {
+    auto entry = table.by_column[i].load(std::memory_order_acquire);
+    if (entry == nullptr || entry->column == column) {
+      return entry;
+    }
+  }
+}
+
+const ColumnManager::Entry * ColumnManager::find_by_hash(const Table & table, size_t hash)
 {
-  if (column_map_.count(hash) == 0) {
+  for (auto i = hash & table.mask; ; i = (i + 1) & table.mask) {
+    auto entry = table.by_hash[i].load(std::memory_order_acquire);
+    if (entry == nullptr || entry->hash == hash) {
+      return entry;
+    }
+  }
+}
+
+void ColumnManager::insert(Table & table, const Entry * entry, size_t name_hash)
+{
+  auto i = name_hash & table.mask;
+  while (table.by_column[i].load(std::memory_order_relaxed) != nullptr) {
+    i = (i + 1) & table.mask;
+  }
+  table.by_column[i].store(entry, std::memory_order_release);
+
+  i = entry->hash & table.mask;
+  while (table.by_hash[i].load(std::memory_order_relaxed) != nullptr) {
+    i = (i + 1) & table.mask;
+  }
+  table.by_hash[i].store(entry, std::memory_order_release);
+}
+
+const std::string & ColumnManager::get_column(size_t hash) const
+{
+  static const std::string unknown_column;
+  auto entry = find_by_hash(*table_.load(std::memory_order_acquire), hash);
+  if (entry == nullptr) {
+    // The table may have been replaced after it was loaded.
+    std::lock_guard<std::mutex> lock(mutex_);
+    entry = find_by_hash(*table_.load(std::memory_order_relaxed), hash);
+  }
+  if (entry == nullptr) {
     std::cerr << "Unknown hash value" << std::endl;
+    return unknown_column;
   }
-  return column_map_[hash];
+  return entry->column;
 }
 
-size_t ColumnManager::get_hash(std::string column)
+size_t ColumnManager::get_hash(const std::string & column)
 {
-  if (hash_map_.count(column) == 0) {
-    register_column(column);
+  auto name_hash = std::hash<std::string>()(column);
+  auto entry = find_by_column(*table_.load(std::memory_order_acquire), column, name_hash);
+  if (entry == nullptr) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    entry = register_column_locked(column, name_hash);
   }
-  return hash_map_[column];
+  return entry->hash;
 }
 
-void ColumnManager::register_column(std::string column)
+void ColumnManager::register_column(const std::string & column)
 {
-  size_t hash;
-  hash = std::hash<std::string>()(column);
-  while (column_map_.count(hash) > 0) {
+  std::lock_guard<std::mutex> lock(mutex_);
+  register_column_locked(column, std::hash<std::string>()(column));
+}
+
+const ColumnManager::Entry * ColumnManager::register_column_locked(
+  const std::string & column, size_t name_hash)
+{
+  auto table = table_.load(std::memory_order_relaxed);
+  if (auto entry = find_by_column(*table, column, name_hash)) {
+    return entry;
+  }
+
+  // Colliding hashes are moved to the next free value.
+  auto hash = name_hash;
+  while (find_by_hash(*table, hash) != nullptr) {
     hash++;
   }
-  column_map_[hash] = column;
-  hash_map_[column] = hash;
+  entries_.push_back(std::make_unique<Entry>(Entry{column, hash}));
+  auto entry = entries_.back().get();
+
+  // Tables are kept at most half full.
+  if (entries_.size() * 2 > table->mask + 1) {
+    tables_.push_back(std::make_unique<Table>((table->mask + 1) * 2));
+    auto new_table = tables_.back().get();
+    for (auto & old_entry : entries_) {
+      insert(*new_table, old_entry.get(), std::hash<std::string>()(old_entry->column));
+    }
+    table_.store(new_table, std::memory_order_release);
+  } else {
+    insert(*table, entry, name_hash);
+  }
+  return entry;
+}
+
+MemoryUsage ColumnManager::memory_usage() const
+{
+  std::lock_guard<std::mutex> lock(mutex_);
+  MemoryUsage usage;
+  usage.values = entries_.size() * sizeof(size_t);
+  usage.column_names = entries_.size() * sizeof(std::string);
+  for (auto & entry : entries_) {
+    usage.column_names += MemoryUsage::get_string_heap_size(entry->column);
+  }
+  usage.container_overhead = sizeof(ColumnManager) +
+    entries_.capacity() * sizeof(std::unique_ptr<Entry>) +
+    tables_.capacity() * sizeof(std::unique_ptr<Table>);
+  for (auto & table : tables_) {
+    usage.container_overhead += sizeof(Table) + (table->mask + 1) * 2 * sizeof(SlotT);
+  }
+  return usage;
 }
@@ -0,0 +1,245 @@
+// Copyright 2021 Research Institute of Systems Planning, Inc.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include <algorithm>
+#include <iostream>
+#include <memory>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include "caret_analyze_cpp_impl/column_manager.hpp"
+#include "caret_analyze_cpp_impl/columnar_records.hpp"
+
+namespace
+{
+bool contains(const std::vector<std::string> & columns, const std::string & column)
+{
+  return std::find(columns.begin(), columns.end(), column) != columns.end();
+}
+}  // namespace
+
+ColumnarRecords::ColumnarRecords(
+  const RecordsBase & records,
+  std::vector<std::string> encoded_columns,
+  std::vector<std::string> packed_columns)
+: column_names_(records.get_columns()),
+  sorted_column_(records.get_sorted_column()),
+  size_(records.size())
+{
+  for (auto & columns : {encoded_columns, packed_columns}) {
+    for (auto & column : columns) {
+      if (!contains(column_names_, column)) {
+        std::cerr << "Unknown column: " << column << std::endl;
+        throw std::exception();
+      }
+    }
+  }
+  for (auto & column : encoded_columns) {
+    if (contains(packed_columns, column)) {
+      std::cerr << "Column is both encoded and packed: " << column << std::endl;
+      throw std::exception();
+    }
+  }
+
+  auto & column_manager = ColumnManager::get_instance();
+  columns_.resize(column_names_.size());
+  for (size_t i = 0; i < column_names_.size(); i++) {
+    auto & column = columns_[i];
+    column.column_hash = column_manager.get_hash(column_names_[i]);
+    if (contains(encoded_columns, column_names_[i])) {
+      column.encoded = std::make_unique<DictionaryColumn>(column.column_hash);
+    } else if (contains(packed_columns, column_names_[i])) {
+      column.packed = std::make_unique<PackedColumn>(column.column_hash);
+    } else {
+      column.values.reserve(size_);
+      column.present.resize((size_ + 63) / 64, 0);
+    }
+  }
+
+  size_t position = 0;
+  for (auto it = records.cbegin(); it->has_next(); it->next()) {
+    auto & record = it->get_record();
+    for (auto & column : columns_) {
+      if (column.encoded) {
+        column.encoded->add(record);
+      } else if (column.packed) {
+        column.packed->add(record);
+      } else if (record.has_column(column.column_hash)) {
+        column.values.push_back(record.get(column.column_hash));
+        column.present[position / 64] |= uint64_t(1) << (position % 64);
+      } else {
+        column.values.push_back(UINT64_MAX);
+      }
+    }
+    position++;
+  }
+
+  for (auto & column : columns_) {
+    if (column.encoded) {
+      column.encoded->shrink_to_fit();
+    } else if (column.packed) {
+      column.packed->shrink_to_fit();
+    }
+  }
+}
+
+size_t ColumnarRecords::size() const
+{
+  return size_;
+}
+
+std::vector<std::string> ColumnarRecords::get_columns() const
+{
+  return column_names_;
+}
+
+bool ColumnarRecords::is_encoded(std::string column) const
+{
+  return get_column(column).encoded != nullptr;
+}
+
+bool ColumnarRecords::is_packed(std::string column) const
+{
+  return get_column(column).packed != nullptr;
+}
+
+bool ColumnarRecords::has_value(size_t position, std::string column) const
+{
+  return has_value(get_column(column), position);
+}
+
+uint64_t ColumnarRecords::get(size_t position, std::string column) const
+{
+  return get(get_column(column), position);
+}
+
+const ColumnarRecords::Column & ColumnarRecords::get_column(std::string column) const
+{
+  auto it = std::find(column_names_.begin(), column_names_.end(), column);
+  if (it == column_names_.end()) {
+    std::cerr << "Unknown column: " << column << std::endl;
+    throw std::exception();
+  }
+  return columns_[it - column_names_.begin()];
+}
+
+bool ColumnarRecords::has_value(const Column & column, size_t position) const
+{
+  if (column.encoded) {
+    return column.encoded->get_code(position) != DictionaryColumn::missing_code;
+  }
+  if (column.packed) {
+    return column.packed->has_value(position);
+  }
+  return (column.present[position / 64] >> (position % 64)) & 1;
+}
+
+uint64_t ColumnarRecords::get(const Column & column, size_t position) const
+{
+  if (column.encoded) {
+    return column.encoded->get_value(column.encoded->get_code(position));
+  }
+  if (column.packed) {
+    return column.packed->get(position);
+  }
+  return column.values[position];
+}
+
+std::unique_ptr<RecordsBase> ColumnarRecords::to_records() const
+{
+  auto records = std::make_unique<RecordsVectorImpl>(column_names_);
+  records->reserve(size_);
+  for (size_t position = 0; position < size_; position++) {
+    append_record(*records, position);
+  }
+  // The records are already in order, so this only restores the sorted column.
+  if (sorted_column_ != "") {
+    records->sort(sorted_column_);
+  }
+  return records;
+}
+
+std::unique_ptr<RecordsBase> ColumnarRecords::clip(
+  std::string column, uint64_t t_start, uint64_t t_end) const
+{
+  auto & clipped_column = get_column(column);
+  auto clipped_records = std::make_unique<RecordsVectorImpl>(column_names_);
+  if (clipped_column.packed) {
+    auto & packed_column = *clipped_column.packed;
+    std::vector<uint64_t> values(PackedColumn::block_size);
+    size_t position = 0;
+    for (size_t block = 0; block < packed_column.get_block_count(); block++) {
+      auto info = packed_column.get_block(block);
+      if (info.max < t_start || t_end < info.min) {
+        position += info.count;
+        continue;
+      }
+      packed_column.decode_block(block, values.data());
+      for (size_t i = 0; i < info.count; i++, position++) {
+        auto value = values[i];
+        if (t_start <= value && value <= t_end &&
+          (value != UINT64_MAX || packed_column.has_value(position)))
+        {
+          append_record(*clipped_records, position);
+        }
+      }
+    }
+  } else {
+    for (size_t position = 0; position < size_; position++) {
+      auto value = get(clipped_column, position);
+      if (t_start <= value && value <= t_end && has_value(clipped_column, position)) {
+        append_record(*clipped_records, position);
+      }
+    }
+  }
+
+  if (column == sorted_column_) {
+    clipped_records->sort(sorted_column_);
+  }
+  return clipped_records;
+}
+
+void ColumnarRecords::append_record(RecordsBase & records, size_t position) const
+{
+  Record record;
+  for (auto & column : columns_) {
+    if (has_value(column, position)) {
+      record.add(column.column_hash, get(column, position));
+    }
+  }
+  records.append(std::move(record));
+}
+
+MemoryUsage ColumnarRecords::memory_usage() const
+{
+  MemoryUsage usage;
+  usage.container_overhead = sizeof(ColumnarRecords) + columns_.capacity() * sizeof(Column) +
+    column_names_.capacity() * sizeof(std::string) +
+    MemoryUsage::get_string_heap_size(sorted_column_);
+  for (auto & name : column_names_) {
+    usage.column_names += MemoryUsage::get_string_heap_size(name);
+  }
+  for (auto & column : columns_) {
+    if (column.encoded) {
+      usage.values += column.encoded->memory_usage();
+    } else if (column.packed) {
+      usage.values += column.packed->memory_usage();
+    } else {
+      usage.values += column.values.capacity() * sizeof(uint64_t) +
+        column.present.capacity() * sizeof(uint64_t);
+    }
+  }
+  return usage;
+}
@@ -0,0 +1,142 @@
+// Copyright 2021 Research Institute of Systems Planning, Inc.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include <iostream>
+#include <limits>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+#include "caret_analyze_cpp_impl/dictionary_column.hpp"
+
+DictionaryColumn::DictionaryColumn(size_t column_hash)
+: column_hash_(column_hash), values_({UINT64_MAX})
+{
+}
+
+void DictionaryColumn::add(const Record & record)
+{
+  auto code = record.has_column(column_hash_) ? encode(record.get(column_hash_)) : missing_code;
+  switch (code_width_) {
+    case 1:
+      codes8_.push_back(static_cast<uint8_t>(code));
+      break;
+    case 2:
+      codes16_.push_back(static_cast<uint16_t>(code));
+      break;
+    default:
+      codes32_.push_back(code);
+      break;
+  }
+}
+
+uint32_t DictionaryColumn::encode(uint64_t value)
+{
+  auto it = to_code_.find(value);
+  if (it != to_code_.end()) {
+    return it->second;
+  }
+
+  if (values_.size() > std::numeric_limits<uint32_t>::max()) {
+    std::cerr << "Too many distinct values to encode" << std::endl;
+    throw std::exception();
+  }
+  auto code = static_cast<uint32_t>(values_.size());
+  values_.push_back(value);
+  to_code_.emplace(value, code);
+  if ((code_width_ == 1 && code > std::numeric_limits<uint8_t>::max()) ||
+    (code_width_ == 2 && code > std::numeric_limits<uint16_t>::max()))
+  {
+    widen();
+  }
+  return code;
+}
+
+void DictionaryColumn::widen()
+{
+  if (code_width_ == 1) {
+    codes16_.assign(codes8_.begin(), codes8_.end());
+    std::vector<uint8_t>().swap(codes8_);
+    code_width_ = 2;
+  } else {
+    codes32_.assign(codes16_.begin(), codes16_.end());
+    std::vector<uint16_t>().swap(codes16_);
+    code_width_ = 4;
+  }
+}
+
+void DictionaryColumn::clear_codes()
+{
+  codes8_.clear();
+  codes16_.clear();
+  codes32_.clear();
+}
+
+void DictionaryColumn::shrink_to_fit()
+{
+  codes8_.shrink_to_fit();
+  codes16_.shrink_to_fit();
+  codes32_.shrink_to_fit();
+  values_.shrink_to_fit();
+}
+
+size_t DictionaryColumn::get_column_hash() const
+{
+  return column_hash_;
+}
+
+size_t DictionaryColumn::size() const
+{
+  size_t size = 0;
+  visit_codes(
+    [&size](const auto & codes) {
+      size = codes.size();
+    });
+  return size;
+}
+
+size_t DictionaryColumn::get_code_count() const
+{
+  return values_.size();
+}
+
+size_t DictionaryColumn::get_code_width() const
+{
+  return code_width_;
+}
+
+uint32_t DictionaryColumn::get_code(size_t position) const
+{
+  uint32_t code = missing_code;
+  visit_codes(
+    [&code, position](const auto & codes) {
+      code = codes[position];
+    });
+  return code;
+}
+
+uint64_t DictionaryColumn::get_value(uint32_t code) const
+{
+  return values_[code];
+}
+
+size_t DictionaryColumn::memory_usage() const
+{
+  // Hash table nodes hold a next pointer and the value; buckets are pointers.
+  return sizeof(DictionaryColumn) + codes8_.capacity() * sizeof(uint8_t) +
+         codes16_.capacity() * sizeof(uint16_t) + codes32_.capacity() * sizeof(uint32_t) +
+         values_.capacity() * sizeof(uint64_t) +
+         to_code_.size() * (sizeof(void *) + sizeof(std::pair<const uint64_t, uint32_t>)) +
+         to_code_.bucket_count() * sizeof(void *);
+}
@@ -45,9 +45,9 @@ MapIterator::MapIterator(RecordsMapImpl::ReverseIterator rit, RecordsMapImpl::Re
 Record & MapIterator::get_record() const
 {
   if (is_forward_) {
-    return (*it_).second;
+    return *it_;
   } else {
-    return (*rit_).second;
+    return *rit_;
   }
 }
 
@@ -87,9 +87,9 @@ MapConstIterator::MapConstIterator(
 const Record & MapConstIterator::get_record() const
 {
   if (is_forward_) {
-    return (*it_).second;
+    return *it_;
   } else {
-    return (*rit_).second;
+    return *rit_;
   }
 }
 
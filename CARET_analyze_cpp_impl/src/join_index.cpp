@@ -0,0 +1,74 @@
+// Copyright 2021 Research Institute of Systems Planning, Inc.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include <algorithm>
+#include <vector>
+
+#include "caret_analyze_cpp_impl/join_index.hpp"
+
+JoinIndex::JoinIndex(size_t column_hash)
+: column_hash_(column_hash)
+{
+}
+
+void JoinIndex::add(const Record & record, size_t position)
+{
+  if (!record.has_column(column_hash_)) {
+    missing_positions_.push_back(position);
+    return;
+  }
+
+  auto value = record.get(column_hash_);
+  if (pending_.size() == 0 && (entries_.size() == 0 || entries_.back().first <= value)) {
+    entries_.emplace_back(value, position);
+  } else {
+    pending_.emplace_back(value, position);
+    is_flushed_.invalidate();
+  }
+}
+
+void JoinIndex::flush() const
+{
+  is_flushed_.ensure(
+    [this]() {
+      std::sort(pending_.begin(), pending_.end());
+      auto middle = entries_.size();
+      entries_.insert(entries_.end(), pending_.begin(), pending_.end());
+      std::inplace_merge(entries_.begin(), entries_.begin() + middle, entries_.end());
+      pending_.clear();
+    });
+}
+
+size_t JoinIndex::get_column_hash() const
+{
+  return column_hash_;
+}
+
+const std::vector<JoinIndex::EntryT> & JoinIndex::get_entries() const
+{
+  flush();
+  return entries_;
+}
+
+const std::vector<size_t> & JoinIndex::get_missing_positions() const
+{
+  return missing_positions_;
+}
+
+size_t JoinIndex::memory_usage() const
+{
+  flush();
+  return sizeof(JoinIndex) + (entries_.capacity() + pending_.capacity()) * sizeof(EntryT) +
+         missing_positions_.capacity() * sizeof(size_t);
+}
@@ -0,0 +1,136 @@
+// Copyright 2021 Research Institute of Systems Planning, Inc.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include <string>
+
+#include "caret_analyze_cpp_impl/memory_usage.hpp"
+
+size_t MemoryUsage::total() const
+{
+  return values + container_overhead + vector_slack + column_names + indexes;
+}
+
+MemoryUsage & MemoryUsage::operator+=(const MemoryUsage & other)
+{
+  values += other.values;
+  container_overhead += other.container_overhead;
+  vector_slack += other.vector_slack;
+  column_names += other.column_names;
+  indexes += other.indexes;
+  return *this;
+}
+
+size_t MemoryUsage::get_string_heap_size(const std::string & str)
+{
+  // An empty string has the capacity of the small string buffer.
+  if (str.capacity() <= std::string().capacity()) {
+    return 0;
+  }
+  return str.capacity() + 1;
+}
+
+MemoryCounter & MemoryCounter::get_instance()
+{
+  static MemoryCounter instance;
+  return instance;
+}
+
+// Counts of the current thread that are not published to MemoryCounter yet.
+struct ThreadMemoryCounter
+{
+  int64_t current = 0;
+  size_t total = 0;
+
+  ~ThreadMemoryCounter()
+  {
+    flush();
+  }
+
+  void flush()
+  {
+    if (current == 0 && total == 0) {
+      return;
+    }
+    MemoryCounter::get_instance().publish(current, total);
+    current = 0;
+    total = 0;
+  }
+};
+
+namespace
+{
+thread_local ThreadMemoryCounter thread_counter;
+}  // namespace
+
+void MemoryCounter::add(size_t bytes)
+{
+  thread_counter.current += static_cast<int64_t>(bytes);
+  thread_counter.total += bytes;
+  if (thread_counter.total >= flush_threshold) {
+    thread_counter.flush();
+  }
+}
+
+void MemoryCounter::sub(size_t bytes)
+{
+  thread_counter.current -= static_cast<int64_t>(bytes);
+  if (thread_counter.current <= -static_cast<int64_t>(flush_threshold)) {
+    thread_counter.flush();
+  }
+}
+
+void MemoryCounter::publish(int64_t current_delta, size_t total_delta)
+{
+  total_.fetch_add(total_delta, std::memory_order_relaxed);
+  auto current = current_.fetch_add(current_delta, std::memory_order_relaxed) + current_delta;
+  if (current_delta <= 0 || current <= 0) {
+    return;
+  }
+  auto current_size = static_cast<size_t>(current);
+  auto peak = peak_.load(std::memory_order_relaxed);
+  while (current_size > peak &&
+    !peak_.compare_exchange_weak(peak, current_size, std::memory_order_relaxed))
+  {
+  }
+}
+
+size_t MemoryCounter::load_current() const
+{
+  auto current = current_.load(std::memory_order_relaxed);
+  return current > 0 ? static_cast<size_t>(current) : 0;
+}
+
+size_t MemoryCounter::get_current()
+{
+  thread_counter.flush();
+  return load_current();
+}
+
+size_t MemoryCounter::get_peak()
+{
+  thread_counter.flush();
+  return peak_.load(std::memory_order_relaxed);
+}
+
+size_t MemoryCounter::get_total_allocated()
+{
+  thread_counter.flush();
+  return total_.load(std::memory_order_relaxed);
+}
+
+void MemoryCounter::reset_peak()
+{
+  thread_counter.flush();
+  peak_.store(load_current(), std::memory_order_relaxed);
+}
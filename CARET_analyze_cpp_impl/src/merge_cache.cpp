@@ -0,0 +1,337 @@
+// Copyright 2021 Research Institute of Systems Planning, Inc.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <cstdio>
+#include <filesystem>
+#include <fstream>
+#include <iostream>
+#include <memory>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+#include "caret_analyze_cpp_impl/column_manager.hpp"
+#include "caret_analyze_cpp_impl/merge_cache.hpp"
+#include "caret_analyze_cpp_impl/records.hpp"
+
+namespace
+{
+
+const uint64_t cache_magic = 0x3143525445524143;  // "CARETRC1"
+const uint64_t cache_version = 2;
+const size_t header_size = 6;
+
+uint64_t mix(uint64_t x)
+{
+  x ^= x >> 30;
+  x *= 0xbf58476d1ce4e5b9;
+  x ^= x >> 27;
+  x *= 0x94d049bb133111eb;
+  x ^= x >> 31;
+  return x;
+}
+
+uint64_t hash_string(const std::string & s)
+{
+  uint64_t hash = 0xcbf29ce484222325;
+  for (auto c : s) {
+    hash ^= static_cast<unsigned char>(c);
+    hash *= 0x100000001b3;
+  }
+  return hash;
+}
+
+// 128-bit order-dependent fingerprint built from two independent lanes.
+class Fingerprint
+{
+public:
+  void update(uint64_t value)
+  {
+    h0_ = mix(h0_ ^ value);
+    h1_ = mix(h1_ + value * 0x9e3779b97f4a7c15);
+  }
+
+  void update(const std::string & s)
+  {
+    update(s.size());
+    update(hash_string(s));
+  }
+
+  std::string to_string() const
+  {
+    const char digits[] = "0123456789abcdef";
+    std::string str;
+    for (auto h : {h0_, h1_}) {
+      for (int shift = 60; shift >= 0; shift -= 4) {
+        str.push_back(digits[(h >> shift) & 0xf]);
+      }
+    }
+    return str;
+  }
+
+private:
+  uint64_t h0_ = 0x6a09e667f3bcc908;
+  uint64_t h1_ = 0xbb67ae8584caa73b;
+};
+
+void write_string(std::ofstream & ofs, const std::string & s)
+{
+  uint64_t size = s.size();
+  ofs.write(reinterpret_cast<const char *>(&size), sizeof(size));
+  ofs.write(s.data(), s.size());
+  const char padding[sizeof(uint64_t)] = {};
+  ofs.write(padding, (sizeof(uint64_t) - s.size() % sizeof(uint64_t)) % sizeof(uint64_t));
+}
+
+}  // namespace
+
+MergeCache & MergeCache::get_instance()
+{
+  static MergeCache instance;
+  return instance;
+}
+
+void MergeCache::enable(std::string cache_dir)
+{
+  std::error_code ec;
+  std::filesystem::create_directories(cache_dir, ec);
+  if (ec) {
+    std::cerr << "Failed to create " << cache_dir << std::endl;
+    throw std::exception();
+  }
+  cache_dir_ = cache_dir;
+  enabled_ = true;
+}
+
+void MergeCache::disable()
+{
+  enabled_ = false;
+}
+
+bool MergeCache::is_enabled() const
+{
+  return enabled_;
+}
+
+std::string MergeCache::get_path(const std::string & key) const
+{
+  return (std::filesystem::path(cache_dir_) / (key + ".bin")).string();
+}
+
+std::string MergeCache::make_key(
+  std::string operation,
+  const std::vector<const RecordsBase *> & inputs,
+  const std::vector<std::string> & params) const
+{
+  auto & column_manager = ColumnManager::get_instance();
+  std::unordered_map<size_t, uint64_t> column_hashes;
+
+  Fingerprint fingerprint;
+  fingerprint.update(cache_version);
+  fingerprint.update(operation);
+  fingerprint.update(params.size());
+  for (auto & param : params) {
+    fingerprint.update(param);
+  }
+
+  for (auto & input : inputs) {
+    auto columns = input->get_columns();
+    fingerprint.update(columns.size());
+    for (auto & column : columns) {
+      fingerprint.update(column);
+    }
+
+    fingerprint.update(input->size());
+    for (auto it = input->cbegin(); it->has_next(); it->next()) {
+      // Field order inside a record is unspecified, so fields are combined commutatively.
+      uint64_t record_hash = 0;
+      it->get_record().for_each(
+        [&](size_t column_hash, uint64_t value) {
+          auto column_it = column_hashes.find(column_hash);
+          if (column_it == column_hashes.end()) {
+            auto name_hash = hash_string(column_manager.get_column(column_hash));
+            column_it = column_hashes.emplace(column_hash, name_hash).first;
+          }
+          record_hash += mix(column_it->second ^ mix(value));
+        });
+      fingerprint.update(record_hash);
+    }
+  }
+
+  return fingerprint.to_string();
+}
+
+void MergeCache::store(const std::string & key, const RecordsBase & records) const
+{
+  auto & column_manager = ColumnManager::get_instance();
+
+  std::vector<std::string> names;
+  std::unordered_map<size_t, uint64_t> name_indices;
+  std::vector<uint64_t> offsets = {0};
+  std::vector<uint64_t> fields;
+
+  for (auto it = records.cbegin(); it->has_next(); it->next()) {
+    it->get_record().for_each(
+      [&](size_t column_hash, uint64_t value) {
+        auto name_it = name_indices.find(column_hash);
+        if (name_it == name_indices.end()) {
+          name_it = name_indices.emplace(column_hash, names.size()).first;
+          names.push_back(column_manager.get_column(column_hash));
+        }
+        fields.push_back(name_it->second);
+        fields.push_back(value);
+      });
+    offsets.push_back(fields.size() / 2);
+  }
+
+  auto path = get_path(key);
+  auto tmp_path = path + ".tmp" + std::to_string(getpid());
+  {
+    std::ofstream ofs(tmp_path, std::ios::binary);
+    auto columns = records.get_columns();
+    uint64_t header[header_size] = {
+      cache_magic, cache_version, columns.size(), names.size(), records.size(), fields.size() / 2
+    };
+    ofs.write(reinterpret_cast<const char *>(header), sizeof(header));
+    for (auto & column : columns) {
+      write_string(ofs, column);
+    }
+    for (auto & name : names) {
+      write_string(ofs, name);
+    }
+    ofs.write(
+      reinterpret_cast<const char *>(offsets.data()), offsets.size() * sizeof(uint64_t));
+    ofs.write(
+      reinterpret_cast<const char *>(fields.data()), fields.size() * sizeof(uint64_t));
+    if (!ofs) {
+      std::cerr << "Failed to write merge cache " << tmp_path << std::endl;
+      std::remove(tmp_path.c_str());
+      return;
+    }
+  }
+
+  std::error_code ec;
+  std::filesystem::rename(tmp_path, path, ec);
+  if (ec) {
+    std::cerr << "Failed to write merge cache " << path << std::endl;
+    std::remove(tmp_path.c_str());
+  }
+}
+
+std::unique_ptr<RecordsBase> MergeCache::load(const std::string & key) const
+{
+  auto path = get_path(key);
+  int fd = open(path.c_str(), O_RDONLY);
+  if (fd < 0) {
+    return nullptr;
+  }
+
+  struct stat st;
+  if (fstat(fd, &st) != 0 || st.st_size < static_cast<off_t>(header_size * sizeof(uint64_t))) {
+    close(fd);
+    return nullptr;
+  }
+
+  size_t file_size = st.st_size;
+  void * addr = mmap(nullptr, file_size, PROT_READ, MAP_PRIVATE, fd, 0);
+  close(fd);
+  if (addr == MAP_FAILED) {
+    return nullptr;
+  }
+
+  auto words = static_cast<const uint64_t *>(addr);
+  size_t word_count = file_size / sizeof(uint64_t);
+  size_t pos = header_size;
+
+  auto read_string = [&](std::string & s) {
+      if (pos >= word_count) {
+        return false;
+      }
+      uint64_t size = words[pos++];
+      uint64_t size_words = (size + sizeof(uint64_t) - 1) / sizeof(uint64_t);
+      if (size_words > word_count - pos) {
+        return false;
+      }
+      s.assign(reinterpret_cast<const char *>(words + pos), size);
+      pos += size_words;
+      return true;
+    };
+
+  std::unique_ptr<RecordsBase> records;
+  auto parse = [&]() -> bool {
+      if (words[0] != cache_magic || words[1] != cache_version) {
+        return false;
+      }
+      uint64_t column_count = words[2];
+      uint64_t name_count = words[3];
+      uint64_t record_count = words[4];
+      uint64_t field_count = words[5];
+
+      std::vector<std::string> columns(column_count);
+      for (auto & column : columns) {
+        if (!read_string(column)) {
+          return false;
+        }
+      }
+
+      auto & column_manager = ColumnManager::get_instance();
+      std::vector<size_t> hashes;
+      for (uint64_t i = 0; i < name_count; i++) {
+        std::string name;
+        if (!read_string(name)) {
+          return false;
+        }
+        hashes.push_back(column_manager.get_hash(name));
+      }
+
+      if (record_count + 1 > word_count - pos ||
+        field_count * 2 != word_count - pos - (record_count + 1))
+      {
+        return false;
+      }
+      auto offsets = words + pos;
+      auto fields = offsets + record_count + 1;
+
+      auto records_tmp = std::make_unique<RecordsVectorImpl>(columns);
+      records_tmp->reserve(record_count);
+      for (uint64_t i = 0; i < record_count; i++) {
+        if (offsets[i] > offsets[i + 1] || offsets[i + 1] > field_count) {
+          return false;
+        }
+        Record record;
+        for (auto j = offsets[i]; j < offsets[i + 1]; j++) {
+          auto name_index = fields[j * 2];
+          if (name_index >= hashes.size()) {
+            return false;
+          }
+          record.add(hashes[name_index], fields[j * 2 + 1]);
+        }
+        records_tmp->append(std::move(record));
+      }
+      records = std::move(records_tmp);
+      return true;
+    };
+
+  if (!parse()) {
+    std::cerr << "Ignoring broken merge cache " << path << std::endl;
+    records = nullptr;
+  }
+  munmap(addr, file_size);
+  return records;
+}
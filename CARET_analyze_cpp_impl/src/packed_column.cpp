@@ -0,0 +1,266 @@
+// Copyright 2021 Research Institute of Systems Planning, Inc.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include <algorithm>
+#include <vector>
+
+#include "caret_analyze_cpp_impl/packed_column.hpp"
+
+namespace
+{
+uint8_t get_bit_width(uint64_t value)
+{
+  uint8_t width = 0;
+  while (value > 0) {
+    value >>= 1;
+    width++;
+  }
+  return width;
+}
+}  // namespace
+
+PackedColumn::PackedColumn(size_t column_hash)
+: column_hash_(column_hash)
+{
+}
+
+void PackedColumn::add(const Record & record)
+{
+  auto position = size();
+  bool has_column = record.has_column(column_hash_);
+  auto value = has_column ? record.get(column_hash_) : UINT64_MAX;
+  if (position % 64 == 0) {
+    present_.push_back(0);
+  }
+  if (has_column) {
+    present_.back() |= uint64_t(1) << (position % 64);
+  }
+  ascending_ = ascending_ && (position == 0 || last_value_ <= value);
+  last_value_ = value;
+
+  open_values_.push_back(value);
+  if (open_values_.size() == block_size) {
+    pack_open_block();
+  }
+}
+
+void PackedColumn::pack_open_block()
+{
+  auto start = blocks_.size() * block_size;
+  Block block = {UINT64_MAX, 0, 0, 0, false};
+  for (size_t i = 0; i < block_size; i++) {
+    if (has_value(start + i)) {
+      block.base = std::min(block.base, open_values_[i]);
+      block.max = std::max(block.max, open_values_[i]);
+    } else {
+      block.has_missing = true;
+    }
+  }
+
+  if (block.base < block.max) {
+    block.bit_width = get_bit_width(block.max - block.base);
+  }
+  if (block.bit_width > 32) {
+    block.bit_width = 64;
+    block.offset = wide_offsets_.size();
+    for (size_t i = 0; i < block_size; i++) {
+      wide_offsets_.push_back(has_value(start + i) ? open_values_[i] - block.base : 0);
+    }
+  } else if (block.bit_width > 0) {
+    block.offset = words_.size();
+    auto row_count = block_size / lane_count;
+    words_.resize(words_.size() + (row_count * block.bit_width + 31) / 32 * lane_count, 0);
+    auto words = &words_[block.offset];
+    for (size_t i = 0; i < block_size; i++) {
+      if (!has_value(start + i)) {
+        continue;
+      }
+      auto offset = static_cast<uint32_t>(open_values_[i] - block.base);
+      auto lane = i % lane_count;
+      auto bit = i / lane_count * block.bit_width;
+      auto shift = bit % 32;
+      words[bit / 32 * lane_count + lane] |= offset << shift;
+      if (shift + block.bit_width > 32) {
+        words[(bit / 32 + 1) * lane_count + lane] |= offset >> (32 - shift);
+      }
+    }
+  }
+  blocks_.push_back(block);
+  open_values_.clear();
+}
+
+void PackedColumn::clear()
+{
+  blocks_.clear();
+  words_.clear();
+  wide_offsets_.clear();
+  present_.clear();
+  open_values_.clear();
+  ascending_ = true;
+}
+
+void PackedColumn::shrink_to_fit()
+{
+  blocks_.shrink_to_fit();
+  words_.shrink_to_fit();
+  wide_offsets_.shrink_to_fit();
+  present_.shrink_to_fit();
+  open_values_.shrink_to_fit();
+}
+
+size_t PackedColumn::get_column_hash() const
+{
+  return column_hash_;
+}
+
+size_t PackedColumn::size() const
+{
+  return blocks_.size() * block_size + open_values_.size();
+}
+
+size_t PackedColumn::get_block_count() const
+{
+  return blocks_.size() + (open_values_.empty() ? 0 : 1);
+}
+
+PackedColumn::BlockInfo PackedColumn::get_block(size_t block) const
+{
+  BlockInfo info;
+  if (block < blocks_.size()) {
+    auto & packed_block = blocks_[block];
+    info.count = block_size;
+    info.min = packed_block.base;
+    info.max = packed_block.max;
+    info.has_missing = packed_block.has_missing;
+    return info;
+  }
+
+  auto start = blocks_.size() * block_size;
+  info.count = open_values_.size();
+  for (size_t i = 0; i < open_values_.size(); i++) {
+    if (has_value(start + i)) {
+      info.min = std::min(info.min, open_values_[i]);
+      info.max = std::max(info.max, open_values_[i]);
+    } else {
+      info.has_missing = true;
+    }
+  }
+  return info;
+}
+
+bool PackedColumn::is_ascending() const
+{
+  return ascending_;
+}
+
+bool PackedColumn::has_value(size_t position) const
+{
+  return (present_[position / 64] >> (position % 64)) & 1;
+}
+
+uint64_t PackedColumn::get(size_t position) const
+{
+  if (!has_value(position)) {
+    return UINT64_MAX;
+  }
+  auto block = position / block_size;
+  auto i = position % block_size;
+  if (block == blocks_.size()) {
+    return open_values_[i];
+  }
+
+  auto & packed_block = blocks_[block];
+  auto width = packed_block.bit_width;
+  if (width == 0) {
+    return packed_block.base;
+  }
+  if (width == 64) {
+    return packed_block.base + wide_offsets_[packed_block.offset + i];
+  }
+  auto words = &words_[packed_block.offset];
+  auto lane = i % lane_count;
+  auto bit = i / lane_count * width;
+  auto shift = bit % 32;
+  uint64_t offset = words[bit / 32 * lane_count + lane] >> shift;
+  if (shift + width > 32) {
+    offset |= uint64_t(words[(bit / 32 + 1) * lane_count + lane]) << (32 - shift);
+  }
+  return packed_block.base + (offset & ((uint64_t(1) << width) - 1));
+}
+
+size_t PackedColumn::decode_block(size_t block, uint64_t * values) const
+{
+  if (block == blocks_.size()) {
+    std::copy(open_values_.begin(), open_values_.end(), values);
+    return open_values_.size();
+  }
+
+  auto & packed_block = blocks_[block];
+  auto base = packed_block.base;
+  auto width = packed_block.bit_width;
+  if (width == 0) {
+    std::fill(values, values + block_size, base);
+  } else if (width == 64) {
+    auto offsets = &wide_offsets_[packed_block.offset];
+    for (size_t i = 0; i < block_size; i++) {
+      values[i] = base + offsets[i];
+    }
+  } else {
+    auto words = &words_[packed_block.offset];
+    auto mask = width == 32 ? UINT32_MAX : (uint32_t(1) << width) - 1;
+    for (size_t row = 0; row < block_size / lane_count; row++) {
+      auto bit = row * width;
+      auto shift = bit % 32;
+      auto low_words = &words[bit / 32 * lane_count];
+      auto row_values = &values[row * lane_count];
+      if (shift + width > 32) {
+        auto high_words = low_words + lane_count;
+        for (size_t lane = 0; lane < lane_count; lane++) {
+          row_values[lane] =
+            base + (((low_words[lane] >> shift) | (high_words[lane] << (32 - shift))) & mask);
+        }
+      } else {
+        for (size_t lane = 0; lane < lane_count; lane++) {
+          row_values[lane] = base + ((low_words[lane] >> shift) & mask);
+        }
+      }
+    }
+  }
+
+  if (packed_block.has_missing) {
+    auto start = block * block_size;
+    for (size_t i = 0; i < block_size; i++) {
+      if (!has_value(start + i)) {
+        values[i] = UINT64_MAX;
+      }
+    }
+  }
+  return block_size;
+}
+
+void PackedColumn::decode(std::vector<uint64_t> & values) const
+{
+  auto offset = values.size();
+  values.resize(offset + size());
+  for (size_t block = 0; block < get_block_count(); block++) {
+    offset += decode_block(block, &values[offset]);
+  }
+}
+
+size_t PackedColumn::memory_usage() const
+{
+  return sizeof(PackedColumn) + blocks_.capacity() * sizeof(Block) +
+         words_.capacity() * sizeof(uint32_t) + wide_offsets_.capacity() * sizeof(uint64_t) +
+         present_.capacity() * sizeof(uint64_t) + open_values_.capacity() * sizeof(uint64_t);
+}
@@ -0,0 +1,129 @@
+// Copyright 2021 Research Institute of Systems Planning, Inc.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include <chrono>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include "caret_analyze_cpp_impl/memory_usage.hpp"
+#include "caret_analyze_cpp_impl/profiler.hpp"
+#include "caret_analyze_cpp_impl/records.hpp"
+
+void OperationStats::merge(const OperationStats & other)
+{
+  call_count += other.call_count;
+  wall_time += other.wall_time;
+  rows_in += other.rows_in;
+  rows_out += other.rows_out;
+  bytes_allocated += other.bytes_allocated;
+}
+
+Profiler & Profiler::get_instance()
+{
+  static Profiler instance;
+  return instance;
+}
+
+void Profiler::enable()
+{
+  enabled_.store(true, std::memory_order_relaxed);
+}
+
+void Profiler::disable()
+{
+  enabled_.store(false, std::memory_order_relaxed);
+}
+
+Profiler::ThreadStats & Profiler::get_thread_stats()
+{
+  // Tables are shared with the profiler so that stats survive the thread.
+  thread_local std::shared_ptr<ThreadStats> thread_stats;
+  if (!thread_stats) {
+    thread_stats = std::make_shared<ThreadStats>();
+    std::lock_guard<std::mutex> lock(mutex_);
+    thread_stats_.push_back(thread_stats);
+  }
+  return *thread_stats;
+}
+
+void Profiler::add(const char * operation, const OperationStats & stats)
+{
+  auto & thread_stats = get_thread_stats();
+  std::lock_guard<std::mutex> lock(thread_stats.mutex);
+  thread_stats.stats[operation].merge(stats);
+}
+
+std::map<std::string, OperationStats> Profiler::get_stats() const
+{
+  std::map<std::string, OperationStats> stats;
+  std::lock_guard<std::mutex> lock(mutex_);
+  for (auto & thread_stats : thread_stats_) {
+    std::lock_guard<std::mutex> thread_lock(thread_stats->mutex);
+    for (auto & pair : thread_stats->stats) {
+      stats[pair.first].merge(pair.second);
+    }
+  }
+  return stats;
+}
+
+void Profiler::reset_stats()
+{
+  std::lock_guard<std::mutex> lock(mutex_);
+  for (auto & thread_stats : thread_stats_) {
+    std::lock_guard<std::mutex> thread_lock(thread_stats->mutex);
+    thread_stats->stats.clear();
+  }
+}
+
+ProfileScope::ProfileScope(const char * operation, size_t rows_in)
+: operation_(operation), enabled_(Profiler::get_instance().is_enabled()),
+  trace_scope_(operation)
+{
+  if (!enabled_) {
+    return;
+  }
+  stats_.call_count = 1;
+  stats_.rows_in = rows_in;
+  allocated_at_start_ = MemoryCounter::get_instance().get_total_allocated();
+  start_ = std::chrono::steady_clock::now();
+}
+
+ProfileScope::~ProfileScope()
+{
+  if (!enabled_) {
+    return;
+  }
+  auto elapsed = std::chrono::steady_clock::now() - start_;
+  stats_.wall_time = std::chrono::duration_cast<std::chrono::nanoseconds>(elapsed).count();
+  stats_.bytes_allocated =
+    MemoryCounter::get_instance().get_total_allocated() - allocated_at_start_;
+  Profiler::get_instance().add(operation_, stats_);
+}
+
+void ProfileScope::set_output(const RecordsBase & records)
+{
+  if (enabled_) {
+    stats_.rows_out += records.size();
+  }
+}
+
+std::unique_ptr<RecordsBase> ProfileScope::set_output(std::unique_ptr<RecordsBase> records)
+{
+  set_output(*records);
+  return records;
+}
@@ -18,6 +18,7 @@
 #include <map>
 #include <tuple>
 #include <memory>
+#include <utility>
 
 #include "pybind11/iostream.h"
 #include "pybind11/pybind11.h"
@@ -31,6 +32,18 @@
 
 namespace py = pybind11;
 
+std::map<std::string, size_t> to_dict(const MemoryUsage & usage)
+{
+  return {
+    {"values", usage.values},
+    {"container_overhead", usage.container_overhead},
+    {"vector_slack", usage.vector_slack},
+    {"column_names", usage.column_names},
+    {"indexes", usage.indexes},
+    {"total", usage.total()},
+  };
+}
+
 PYBIND11_MODULE(record_cpp_impl, m) {
   py::class_<Record>(m, "RecordBase")
   .def(py::init())
@@ -56,24 +69,39 @@ PYBIND11_MODULE(record_cpp_impl, m) {
     "merge", &Record::merge,
     py::call_guard<py::scoped_ostream_redirect, py::scoped_estream_redirect>())
   .def(
-    "add", &Record::add,
+    "add", static_cast<void (Record::*)(std::string, uint64_t)>(&Record::add),
     py::call_guard<py::scoped_ostream_redirect, py::scoped_estream_redirect>())
   .def(
     "drop_columns", &Record::drop_columns,
     py::call_guard<py::scoped_ostream_redirect, py::scoped_estream_redirect>())
   .def(
-    "get", &Record::get,
+    "get", static_cast<uint64_t (Record::*)(std::string) const>(&Record::get),
     py::call_guard<py::scoped_ostream_redirect, py::scoped_estream_redirect>())
   .def(
-    "get_with_default", &Record::get_with_default,
+    "get_with_default",
+    static_cast<uint64_t (Record::*)(std::string, uint64_t) const>(&Record::get_with_default),
     py::call_guard<py::scoped_ostream_redirect, py::scoped_estream_redirect>())
   .def_property_readonly(
     "data", &Record::get_data,
     py::call_guard<py::scoped_ostream_redirect, py::scoped_estream_redirect>())
+  .def(
+    "memory_usage",
+    [](const Record & record) {
+      return to_dict(record.memory_usage());
+    },
+    py::call_guard<py::scoped_ostream_redirect, py::scoped_estream_redirect>())
   .def_property_readonly(
     "columns", &Record::get_columns,
     py::call_guard<py::scoped_ostream_redirect, py::scoped_estream_redirect>());
 
+  py::class_<ColumnStats>(m, "ColumnStats")
+  .def_readonly("min", &ColumnStats::min)
+  .def_readonly("max", &ColumnStats::max)
+  .def_readonly("count", &ColumnStats::count)
+  .def_readonly("ascending", &ColumnStats::ascending)
+  .def_readonly("descending", &ColumnStats::descending)
+  .def_readonly("strict", &ColumnStats::strict);
+
   py::class_<RecordsBase>(m, "RecordsBase")
   .def(py::init())
   .def(
@@ -85,11 +113,11 @@ PYBIND11_MODULE(record_cpp_impl, m) {
   .def(
     py::init(
       [](std::vector<Record> init, std::vector<std::string> columns) {
-        return new RecordsVectorImpl(init, columns);
+        return new RecordsVectorImpl(std::move(init), columns);
       })
   )
   .def(
-    "append", &RecordsBase::append,
+    "append", static_cast<void (RecordsBase::*)(const Record &)>(&RecordsBase::append),
     py::call_guard<py::scoped_ostream_redirect, py::scoped_estream_redirect>())
   .def(
     "append_column", &RecordsBase::append_column,
@@ -109,6 +137,42 @@ PYBIND11_MODULE(record_cpp_impl, m) {
   .def(
     "filter_if", &RecordsBase::filter_if,
     py::call_guard<py::scoped_ostream_redirect, py::scoped_estream_redirect>())
+  .def(
+    "to_csv", &RecordsBase::to_csv,
+    py::call_guard<py::scoped_ostream_redirect, py::scoped_estream_redirect>())
+  .def_static(
+    "from_csv", &RecordsBase::from_csv,
+    py::call_guard<py::scoped_ostream_redirect, py::scoped_estream_redirect>())
+  .def_static(
+    "concat_many", &RecordsBase::concat_many,
+    py::call_guard<py::scoped_ostream_redirect, py::scoped_estream_redirect>())
+  .def(
+    "build_index", &RecordsBase::build_index,
+    py::call_guard<py::scoped_ostream_redirect, py::scoped_estream_redirect>())
+  .def(
+    "has_index", &RecordsBase::has_index,
+    py::call_guard<py::scoped_ostream_redirect, py::scoped_estream_redirect>())
+  .def(
+    "encode_column", &RecordsBase::encode_column,
+    py::call_guard<py::scoped_ostream_redirect, py::scoped_estream_redirect>())
+  .def(
+    "has_encoded_column", &RecordsBase::has_encoded_column,
+    py::call_guard<py::scoped_ostream_redirect, py::scoped_estream_redirect>())
+  .def(
+    "pack_column", &RecordsBase::pack_column,
+    py::call_guard<py::scoped_ostream_redirect, py::scoped_estream_redirect>())
+  .def(
+    "has_packed_column", &RecordsBase::has_packed_column,
+    py::call_guard<py::scoped_ostream_redirect, py::scoped_estream_redirect>())
+  .def(
+    "clip", &RecordsBase::clip,
+    py::call_guard<py::scoped_ostream_redirect, py::scoped_estream_redirect>())
+  .def(
+    "get_column_stats", &RecordsBase::get_column_stats,
+    py::call_guard<py::scoped_ostream_redirect, py::scoped_estream_redirect>())
+  .def(
+    "is_sorted_on", &RecordsBase::is_sorted_on,
+    py::call_guard<py::scoped_ostream_redirect, py::scoped_estream_redirect>())
   .def(
     "reindex", &RecordsBase::reindex,
     py::call_guard<py::scoped_ostream_redirect, py::scoped_estream_redirect>())
@@ -122,10 +186,32 @@ PYBIND11_MODULE(record_cpp_impl, m) {
     "sort_column_order", &RecordsBase::sort_column_order,
     py::call_guard<py::scoped_ostream_redirect, py::scoped_estream_redirect>())
   .def(
-    "merge", &RecordsBase::merge,
+    "merge",
+    static_cast<std::unique_ptr<RecordsBase>(RecordsBase::*)(
+      const RecordsBase &, std::string, std::string, std::vector<std::string>,
+      std::string)>(&RecordsBase::merge),
+    py::call_guard<py::scoped_ostream_redirect, py::scoped_estream_redirect>())
+  .def(
+    "merge",
+    static_cast<std::unique_ptr<RecordsBase>(RecordsBase::*)(
+      const RecordsBase &, std::vector<std::string>, std::vector<std::string>,
+      std::vector<std::string>, std::string)>(&RecordsBase::merge),
+    py::call_guard<py::scoped_ostream_redirect, py::scoped_estream_redirect>())
+  .def(
+    "merge_sequential",
+    static_cast<std::unique_ptr<RecordsBase>(RecordsBase::*)(
+      const RecordsBase &, std::string, std::string, std::string, std::string,
+      std::vector<std::string>, std::string)>(&RecordsBase::merge_sequential),
+    py::call_guard<py::scoped_ostream_redirect, py::scoped_estream_redirect>())
+  .def(
+    "merge_sequential",
+    static_cast<std::unique_ptr<RecordsBase>(RecordsBase::*)(
+      const RecordsBase &, std::string, std::string, std::vector<std::string>,
+      std::vector<std::string>, std::vector<std::string>, std::string)>(
+      &RecordsBase::merge_sequential),
     py::call_guard<py::scoped_ostream_redirect, py::scoped_estream_redirect>())
   .def(
-    "merge_sequential", &RecordsBase::merge_sequential,
+    "merge_asof", &RecordsBase::merge_asof,
     py::call_guard<py::scoped_ostream_redirect, py::scoped_estream_redirect>())
   .def(
     "bind_drop_as_delay", &RecordsBase::bind_drop_as_delay,
@@ -152,13 +238,153 @@ PYBIND11_MODULE(record_cpp_impl, m) {
         std::string, std::string,
         std::string)>(&RecordsBase::groupby),
     py::call_guard<py::scoped_ostream_redirect, py::scoped_estream_redirect>())
+  .def(
+    "memory_usage",
+    [](const RecordsBase & records) {
+      return to_dict(records.memory_usage());
+    },
+    py::call_guard<py::scoped_ostream_redirect, py::scoped_estream_redirect>())
   .def_property_readonly(
     "data", &RecordsBase::get_data,
     py::call_guard<py::scoped_ostream_redirect, py::scoped_estream_redirect>())
+  .def_property_readonly(
+    "sorted_column", &RecordsBase::get_sorted_column,
+    py::call_guard<py::scoped_ostream_redirect, py::scoped_estream_redirect>())
   .def_property_readonly(
     "columns", &RecordsBase::get_columns,
     py::call_guard<py::scoped_ostream_redirect, py::scoped_estream_redirect>());
 
+  py::class_<ColumnarRecords>(m, "ColumnarRecords")
+  .def(
+    py::init<const RecordsBase &, std::vector<std::string>>(),
+    py::call_guard<py::scoped_ostream_redirect, py::scoped_estream_redirect>())
+  .def(
+    py::init<const RecordsBase &, std::vector<std::string>, std::vector<std::string>>(),
+    py::call_guard<py::scoped_ostream_redirect, py::scoped_estream_redirect>())
+  .def(
+    "to_records", &ColumnarRecords::to_records,
+    py::call_guard<py::scoped_ostream_redirect, py::scoped_estream_redirect>())
+  .def(
+    "clip", &ColumnarRecords::clip,
+    py::call_guard<py::scoped_ostream_redirect, py::scoped_estream_redirect>())
+  .def(
+    "is_encoded", &ColumnarRecords::is_encoded,
+    py::call_guard<py::scoped_ostream_redirect, py::scoped_estream_redirect>())
+  .def(
+    "is_packed", &ColumnarRecords::is_packed,
+    py::call_guard<py::scoped_ostream_redirect, py::scoped_estream_redirect>())
+  .def(
+    "memory_usage",
+    [](const ColumnarRecords & records) {
+      return to_dict(records.memory_usage());
+    },
+    py::call_guard<py::scoped_ostream_redirect, py::scoped_estream_redirect>())
+  .def_property_readonly(
+    "size", &ColumnarRecords::size,
+    py::call_guard<py::scoped_ostream_redirect, py::scoped_estream_redirect>())
+  .def_property_readonly(
+    "columns", &ColumnarRecords::get_columns,
+    py::call_guard<py::scoped_ostream_redirect, py::scoped_estream_redirect>());
+
+  m.def(
+    "enable_merge_cache",
+    [](std::string cache_dir) {
+      MergeCache::get_instance().enable(cache_dir);
+    },
+    py::call_guard<py::scoped_ostream_redirect, py::scoped_estream_redirect>());
+  m.def(
+    "disable_merge_cache",
+    []() {
+      MergeCache::get_instance().disable();
+    },
+    py::call_guard<py::scoped_ostream_redirect, py::scoped_estream_redirect>());
+
+  m.def(
+    "enable_out_of_core",
+    [](size_t memory_budget, std::string spill_dir) {
+      OutOfCoreConfig::get_instance().enable(memory_budget, spill_dir);
+    },
+    py::call_guard<py::scoped_ostream_redirect, py::scoped_estream_redirect>());
+  m.def(
+    "disable_out_of_core",
+    []() {
+      OutOfCoreConfig::get_instance().disable();
+    },
+    py::call_guard<py::scoped_ostream_redirect, py::scoped_estream_redirect>());
+
+  m.def(
+    "enable_stats",
+    []() {
+      Profiler::get_instance().enable();
+    },
+    py::call_guard<py::scoped_ostream_redirect, py::scoped_estream_redirect>());
+  m.def(
+    "disable_stats",
+    []() {
+      Profiler::get_instance().disable();
+    },
+    py::call_guard<py::scoped_ostream_redirect, py::scoped_estream_redirect>());
+  m.def(
+    "stats",
+    []() {
+      std::map<std::string, std::map<std::string, uint64_t>> stats;
+      for (auto & pair : Profiler::get_instance().get_stats()) {
+        auto & operation_stats = pair.second;
+        stats[pair.first] = {
+          {"call_count", operation_stats.call_count},
+          {"wall_time", operation_stats.wall_time},
+          {"rows_in", operation_stats.rows_in},
+          {"rows_out", operation_stats.rows_out},
+          {"bytes_allocated", operation_stats.bytes_allocated},
+        };
+      }
+      return stats;
+    },
+    py::call_guard<py::scoped_ostream_redirect, py::scoped_estream_redirect>());
+  m.def(
+    "reset_stats",
+    []() {
+      Profiler::get_instance().reset_stats();
+    },
+    py::call_guard<py::scoped_ostream_redirect, py::scoped_estream_redirect>());
+
+  m.def(
+    "enable_trace",
+    [](std::string path) {
+      Tracer::get_instance().enable(path);
+    },
+    py::call_guard<py::scoped_ostream_redirect, py::scoped_estream_redirect>());
+  m.def(
+    "disable_trace",
+    []() {
+      Tracer::get_instance().disable();
+    },
+    py::call_guard<py::scoped_ostream_redirect, py::scoped_estream_redirect>());
+
+  m.def(
+    "column_memory_usage",
+    []() {
+      return to_dict(ColumnManager::get_instance().memory_usage());
+    },
+    py::call_guard<py::scoped_ostream_redirect, py::scoped_estream_redirect>());
+  m.def(
+    "memory_stats",
+    []() {
+      auto & memory_counter = MemoryCounter::get_instance();
+      return std::map<std::string, size_t>{
+        {"current", memory_counter.get_current()},
+        {"peak", memory_counter.get_peak()},
+        {"total_allocated", memory_counter.get_total_allocated()},
+      };
+    },
+    py::call_guard<py::scoped_ostream_redirect, py::scoped_estream_redirect>());
+  m.def(
+    "reset_peak_memory",
+    []() {
+      MemoryCounter::get_instance().reset_peak();
+    },
+    py::call_guard<py::scoped_ostream_redirect, py::scoped_estream_redirect>());
+
 #ifdef VERSION_INFO
   m.attr("__version__") = MACRO_STRINGIFY(VERSION_INFO);
 #else
@@ -34,19 +34,41 @@ Record::Record(std::unordered_map<std::string, uint64_t> init)
   }
 }
 
+Record::Record(std::unordered_map<std::string, uint64_t> init, const AllocatorT & allocator)
+: data_(allocator)
+{
+  for (auto & pair : init) {
+    add(pair.first, pair.second);
+  }
+}
+
 Record::Record(const Record & record)
 : data_(record.data_)
 {
 }
 
+Record::Record(const AllocatorT & allocator)
+: data_(allocator)
+{
+}
+
+Record::Record(const Record & record, const AllocatorT & allocator)
+: data_(record.data_, allocator)
+{
+}
+
+Record::Record(Record && record, const AllocatorT & allocator)
+: data_(std::move(record.data_), allocator)
+{
+}
+
 std::unordered_map<std::string, uint64_t> Record::get_data() const
 {
   auto & column_manager = ColumnManager::get_instance();
 
   std::unordered_map<std::string, uint64_t> data;
-  for (auto pair : data_) {
-    auto column = column_manager.get_column(pair.first);
-    data[column] = get(column);
+  for (auto & pair : data_) {
+    data[column_manager.get_column(pair.first)] = pair.second;
   }
   return data;
 }
@@ -70,6 +92,21 @@ uint64_t Record::get_with_default(std::string column, uint64_t default_value) co
   return default_value;
 }
 
+uint64_t Record::get(size_t column_hash) const
+{
+  return data_.at(column_hash);
+}
+
+uint64_t Record::get_with_default(size_t column_hash, uint64_t default_value) const
+{
+  auto it = data_.find(column_hash);
+  if (it != data_.end()) {
+    return it->second;
+  }
+
+  return default_value;
+}
+
 void Record::change_dict_key(std::string key_from, std::string key_to)
 {
   auto & column_manager = ColumnManager::get_instance();
@@ -104,30 +141,49 @@ void Record::add(std::string column, uint64_t stamp)
   data_[hash] = stamp;
 }
 
-void Record::merge(const Record & other)
+void Record::add(size_t column_hash, uint64_t stamp)
 {
-  auto & column_manager = ColumnManager::get_instance();
+  data_[column_hash] = stamp;
+}
 
+void Record::merge(const Record & other)
+{
   for (auto & pair : other.data_) {
-    auto column = column_manager.get_column(pair.first);
-    add(column, pair.second);
+    data_[pair.first] = pair.second;
   }
 }
 
-bool Record::has_column(const std::string column)
+bool Record::has_column(const std::string column) const
 {
   auto & column_manager = ColumnManager::get_instance();
   auto hash = column_manager.get_hash(column);
   return data_.count(hash) > 0;
 }
 
+bool Record::has_column(size_t column_hash) const
+{
+  return data_.count(column_hash) > 0;
+}
+
 std::unordered_set<std::string> Record::get_columns() const
 {
   auto & column_manager = ColumnManager::get_instance();
   std::unordered_set<std::string> columns;
-  for (auto pair : data_) {
-    auto key = column_manager.get_column(pair.first);
-    columns.emplace(key);
+  for (auto & pair : data_) {
+    columns.emplace(column_manager.get_column(pair.first));
   }
   return columns;
 }
+
+MemoryUsage Record::memory_usage() const
+{
+  // libstdc++ nodes hold a next pointer and the value; hashes of size_t are not cached.
+  // A table with a single bucket uses the bucket inside the object.
+  MemoryUsage usage;
+  usage.values = data_.size() * sizeof(DataT::value_type);
+  usage.container_overhead = sizeof(Record) + data_.size() * sizeof(void *);
+  if (data_.bucket_count() > 1) {
+    usage.container_overhead += data_.bucket_count() * sizeof(void *);
+  }
+  return usage;
+}
@@ -0,0 +1,80 @@
+// Copyright 2021 Research Institute of Systems Planning, Inc.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include <memory_resource>
+#include <mutex>
+
+#include "caret_analyze_cpp_impl/record_arena.hpp"
+
+namespace
+{
+// The block size grows geometrically from here. Kept small, as each group of
+// groupby() has its own arena.
+const size_t initial_block_size = 4 * 1024;
+}  // namespace
+
+RecordArena::RecordArena()
+: resource_(initial_block_size, &upstream_)
+{
+}
+
+RecordArena::~RecordArena()
+{
+  resource_.release();
+}
+
+void * RecordArena::allocate(size_t bytes, size_t alignment)
+{
+  std::lock_guard<std::mutex> lock(mutex_);
+  used_size_ += bytes;
+  return resource_.allocate(bytes, alignment);
+}
+
+size_t RecordArena::get_allocated_size() const
+{
+  std::lock_guard<std::mutex> lock(mutex_);
+  return upstream_.get_allocated_size();
+}
+
+size_t RecordArena::get_used_size() const
+{
+  std::lock_guard<std::mutex> lock(mutex_);
+  return used_size_;
+}
+
+size_t RecordArena::CountingResource::get_allocated_size() const
+{
+  return allocated_size_;
+}
+
+void * RecordArena::CountingResource::do_allocate(size_t bytes, size_t alignment)
+{
+  auto p = std::pmr::new_delete_resource()->allocate(bytes, alignment);
+  allocated_size_ += bytes;
+  MemoryCounter::get_instance().add(bytes);
+  return p;
+}
+
+void RecordArena::CountingResource::do_deallocate(void * p, size_t bytes, size_t alignment)
+{
+  allocated_size_ -= bytes;
+  MemoryCounter::get_instance().sub(bytes);
+  std::pmr::new_delete_resource()->deallocate(p, bytes, alignment);
+}
+
+bool RecordArena::CountingResource::do_is_equal(
+  const std::pmr::memory_resource & other) const noexcept
+{
+  return this == &other;
+}
@@ -21,6 +21,8 @@
 #include <iostream>
 #include <fstream>
 #include <algorithm>
+#include <numeric>
+#include <queue>
 #include <set>
 #include <map>
 #include <memory>
@@ -28,11 +30,16 @@
 #include <utility>
 #include <iterator>
 #include <exception>
+#include <charconv>
 
 #include "caret_analyze_cpp_impl/record.hpp"
 #include "caret_analyze_cpp_impl/common.hpp"
 #include "caret_analyze_cpp_impl/column_manager.hpp"
 #include "caret_analyze_cpp_impl/records.hpp"
+#include "caret_analyze_cpp_impl/merge_cache.hpp"
+#include "caret_analyze_cpp_impl/profiler.hpp"
+#include "caret_analyze_cpp_impl/spill_sorter.hpp"
+#include "caret_analyze_cpp_impl/tracer.hpp"
 
 enum Side {Left, Right};
 
@@ -63,6 +70,52 @@ private:
 };
 
 
+// Builds records holding only the given columns, allocated with the given allocator.
+class RecordProjection
+{
+public:
+  explicit RecordProjection(
+    const std::vector<std::string> & columns,
+    const Record::AllocatorT & allocator = Record::AllocatorT())
+  : allocator_(allocator)
+  {
+    auto & column_manager = ColumnManager::get_instance();
+    for (auto & column : columns) {
+      hashes_.push_back(column_manager.get_hash(column));
+    }
+  }
+
+  Record operator()(const Record & record) const
+  {
+    Record projected(allocator_);
+    for (auto hash : hashes_) {
+      if (record.has_column(hash)) {
+        projected.add(hash, record.get(hash));
+      }
+    }
+    return projected;
+  }
+
+  // Values of the first record take precedence, as in second.merge(first).
+  Record operator()(const Record & first, const Record & second) const
+  {
+    Record projected(allocator_);
+    for (auto hash : hashes_) {
+      if (first.has_column(hash)) {
+        projected.add(hash, first.get(hash));
+      } else if (second.has_column(hash)) {
+        projected.add(hash, second.get(hash));
+      }
+    }
+    return projected;
+  }
+
+private:
+  std::vector<size_t> hashes_;
+  Record::AllocatorT allocator_;
+};
+
+
 RecordsBase::RecordsBase()
 : columns_({})
 {
@@ -122,10 +175,83 @@ Cont filter(const Cont & container, Pred predicate)
 
 void RecordsBase::concat(RecordsBase & other)
 {
+  ProfileScope scope("concat", other.size());
+  reserve(size() + other.size());
   for (auto it = other.begin(); it->has_next(); it->next() ) {
     auto & record = it->get_record();
     append(record);
   }
+  scope.set_output(other);
+}
+
+std::unique_ptr<RecordsBase> RecordsBase::concat_many(
+  const std::vector<const RecordsBase *> & inputs, std::string sort_key)
+{
+  auto columns = UniqueList();
+  size_t total_size = 0;
+  bool is_all_sorted = sort_key != "";
+  for (auto & input : inputs) {
+    columns.add_columns(input->get_columns());
+    total_size += input->size();
+    // The k-way merge needs every record to have the key.
+    is_all_sorted = is_all_sorted && input->is_sorted_on(sort_key) &&
+      input->get_column_stats(sort_key).count == input->size();
+  }
+
+  ProfileScope scope("concat_many", total_size);
+  auto concat_records = std::make_unique<RecordsVectorImpl>(columns.as_list());
+  concat_records->reserve(total_size);
+
+  auto sort_key_hash = ColumnManager::get_instance().get_hash(sort_key);
+  if (!is_all_sorted) {
+    // Stable sort, so that ties keep the concatenation order as in the k-way merge.
+    std::vector<std::pair<uint64_t, const Record *>> entries;
+    entries.reserve(total_size);
+    for (auto & input : inputs) {
+      for (auto it = input->cbegin(); it->has_next(); it->next()) {
+        auto & record = it->get_record();
+        entries.emplace_back(record.get_with_default(sort_key_hash, UINT64_MAX), &record);
+      }
+    }
+    if (sort_key != "") {
+      std::stable_sort(
+        entries.begin(), entries.end(), [](const auto & a, const auto & b) {
+          return a.first < b.first;
+        });
+    }
+    // append() clears the sorted column at the first record without the key.
+    if (sort_key != "") {
+      static_cast<RecordsBase &>(*concat_records).set_sorted_column(sort_key);
+    }
+    for (auto & entry : entries) {
+      concat_records->append(*entry.second);
+    }
+    return scope.set_output(std::move(concat_records));
+  }
+
+  // k-way merge; ties are taken from the earlier input to keep the concatenation order.
+  using HeapItemT = std::tuple<uint64_t, size_t>;
+  std::priority_queue<HeapItemT, std::vector<HeapItemT>, std::greater<HeapItemT>> heap;
+  std::vector<std::unique_ptr<ConstIteratorBase>> iterators;
+  for (size_t i = 0; i < inputs.size(); i++) {
+    iterators.emplace_back(inputs[i]->cbegin());
+    if (iterators[i]->has_next()) {
+      heap.emplace(iterators[i]->get_record().get_with_default(sort_key_hash, UINT64_MAX), i);
+    }
+  }
+
+  static_cast<RecordsBase &>(*concat_records).set_sorted_column(sort_key);
+  while (!heap.empty()) {
+    auto i = std::get<1>(heap.top());
+    heap.pop();
+    auto & it = iterators[i];
+    concat_records->append(it->get_record());
+    it->next();
+    if (it->has_next()) {
+      heap.emplace(it->get_record().get_with_default(sort_key_hash, UINT64_MAX), i);
+    }
+  }
+  return scope.set_output(std::move(concat_records));
 }
 
 class RecordComp
@@ -225,132 +351,462 @@ std::unique_ptr<RecordsBase> RecordsBase::merge(
   std::string how
 )
 {
+  ProfileScope scope("merge", size() + right_records.size());
   // [python side implementation]
   // assert how in ["inner", "left", "right", "outer"]
 
-  bool merge_right_record = how == "right" || how == "outer";
-  bool merge_left_record = how == "left" || how == "outer";
+  auto & merge_cache = MergeCache::get_instance();
+  std::string cache_key;
+  if (merge_cache.is_enabled()) {
+    std::vector<std::string> params = {join_left_key, join_right_key, how};
+    params.insert(params.end(), columns.begin(), columns.end());
+    cache_key = merge_cache.make_key("merge", {this, &right_records}, params);
+    if (auto cached_records = merge_cache.load(cache_key)) {
+      return scope.set_output(std::move(cached_records));
+    }
+  }
 
-  auto left_records_copy = this->clone();
-  auto right_records_copy = right_records.clone();
+  if (OutOfCoreConfig::get_instance().is_enabled()) {
+    auto merged_records = merge_out_of_core(
+      right_records, join_left_key, join_right_key, columns, how);
+    if (merge_cache.is_enabled()) {
+      merge_cache.store(cache_key, *merged_records);
+    }
+    return scope.set_output(std::move(merged_records));
+  }
 
-  auto column_side = "_tmp_merge_side";
-  auto column_merge_stamp = "_tmp_merge_stamp";
-  auto column_has_valid_join_key = "_tmp_merge_has_valid_join_key";
-  auto column_join_key = "_tmp_merge_join_key";
-  auto column_found_right_record = "_tmp_merge_found_right_record";
+  auto left_index = get_index(join_left_key);
+  auto right_index = right_records.get_index(join_right_key);
+  if (left_index != nullptr || right_index != nullptr) {
+    std::unique_ptr<JoinIndex> index_tmp;
+    if (left_index == nullptr) {
+      index_tmp = std::make_unique<JoinIndex>(create_index(join_left_key));
+      left_index = index_tmp.get();
+    } else if (right_index == nullptr) {
+      index_tmp = std::make_unique<JoinIndex>(right_records.create_index(join_right_key));
+      right_index = index_tmp.get();
+    }
+    auto merged_records = merge_with_index(
+      right_records, *left_index, *right_index, columns, how);
+    if (merged_records) {
+      if (merge_cache.is_enabled()) {
+        merge_cache.store(cache_key, *merged_records);
+      }
+      return scope.set_output(std::move(merged_records));
+    }
+  }
 
+  auto keys = get_join_keys(*this, join_left_key, right_records, join_right_key);
+  auto merged_records = merge_impl(right_records, keys.first, keys.second, columns, how);
 
-  left_records_copy->append_column(
-    column_side,
-    std::vector<uint64_t>(left_records_copy->size(), Left)
-  );
+  if (merge_cache.is_enabled()) {
+    merge_cache.store(cache_key, *merged_records);
+  }
 
-  right_records_copy->append_column(
-    column_side,
-    std::vector<uint64_t>(right_records_copy->size(), Right)
-  );
+  return scope.set_output(std::move(merged_records));
+}
 
-  auto assign_temporal_columns = [&](Record & record, std::string & join_key) {
-      auto has_valid_join_key = record.has_column(join_key);
-      record.add(column_has_valid_join_key, has_valid_join_key);
+RecordsBase::JoinKeys RecordsBase::get_join_keys(std::string join_key) const
+{
+  JoinKeys keys;
+  if (join_key == "") {
+    keys.values.resize(size(), 0);
+    keys.is_valid.resize(size(), true);
+    return keys;
+  }
 
-      if (has_valid_join_key) {
-        record.add(column_merge_stamp, record.get(join_key));
-        record.add(column_join_key, record.get(join_key));
-      } else {
-        record.add(column_merge_stamp, UINT64_MAX);
-      }
-    };
+  auto join_key_hash = ColumnManager::get_instance().get_hash(join_key);
+  if (auto encoded_column = get_encoded_column(join_key_hash)) {
+    encoded_column->visit_codes(
+      [&keys, encoded_column](const auto & codes) {
+        keys.values.reserve(codes.size());
+        keys.is_valid.reserve(codes.size());
+        for (auto code : codes) {
+          keys.values.push_back(encoded_column->get_value(code));
+          keys.is_valid.push_back(code != DictionaryColumn::missing_code);
+        }
+      });
+    return keys;
+  }
 
-  for (auto it = left_records_copy->begin(); it->has_next(); it->next()) {
+  for (auto it = cbegin(); it->has_next(); it->next()) {
     auto & record = it->get_record();
-    assign_temporal_columns(record, join_left_key);
+    bool is_valid = record.has_column(join_key_hash);
+    keys.values.push_back(is_valid ? record.get(join_key_hash) : UINT64_MAX);
+    keys.is_valid.push_back(is_valid);
   }
+  return keys;
+}
 
-  for (auto it = right_records_copy->begin(); it->has_next(); it->next()) {
-    auto & record = it->get_record();
-    assign_temporal_columns(record, join_right_key);
+std::pair<RecordsBase::JoinKeys, RecordsBase::JoinKeys> RecordsBase::get_join_keys(
+  const RecordsBase & left_records,
+  std::string join_left_key,
+  const RecordsBase & right_records,
+  std::string join_right_key)
+{
+  auto left_column = left_records.get_encoded_column(join_left_key);
+  auto right_column = right_records.get_encoded_column(join_right_key);
+  if (left_column != nullptr && right_column != nullptr) {
+    return get_encoded_join_keys(*left_column, *right_column);
+  }
+  return std::make_pair(
+    left_records.get_join_keys(join_left_key), right_records.get_join_keys(join_right_key));
+}
+
+// Codes are mapped to the ranks of their values among the values of both dictionaries,
+// which gives the same order and equality as the values themselves.
+// UINT64_MAX is kept as is, as it is also the value of records without a join key.
+std::pair<RecordsBase::JoinKeys, RecordsBase::JoinKeys> RecordsBase::get_encoded_join_keys(
+  const DictionaryColumn & left_column,
+  const DictionaryColumn & right_column)
+{
+  std::vector<uint64_t> distinct_values;
+  for (auto column : {&left_column, &right_column}) {
+    for (uint32_t code = 1; code < column->get_code_count(); code++) {
+      if (column->get_value(code) != UINT64_MAX) {
+        distinct_values.push_back(column->get_value(code));
+      }
+    }
   }
+  std::sort(distinct_values.begin(), distinct_values.end());
+  distinct_values.erase(
+    std::unique(distinct_values.begin(), distinct_values.end()), distinct_values.end());
+
+  auto get_side_keys = [&distinct_values](const DictionaryColumn & column) {
+      std::vector<uint64_t> ranks(column.get_code_count(), UINT64_MAX);
+      for (uint32_t code = 1; code < column.get_code_count(); code++) {
+        auto value = column.get_value(code);
+        if (value != UINT64_MAX) {
+          ranks[code] = std::lower_bound(
+            distinct_values.begin(), distinct_values.end(), value) - distinct_values.begin();
+        }
+      }
 
-  auto concat_columns = UniqueList();
-  concat_columns.add_columns(left_records_copy->get_columns());
-  concat_columns.add_columns(right_records_copy->get_columns());
-  concat_columns.add_columns(
-  {
-    column_side,
-    column_has_valid_join_key,
-    column_merge_stamp,
-    column_join_key
-  });
+      JoinKeys keys;
+      keys.value_count = distinct_values.size();
+      column.visit_codes(
+        [&keys, &ranks](const auto & codes) {
+          keys.values.reserve(codes.size());
+          keys.is_valid.reserve(codes.size());
+          for (auto code : codes) {
+            keys.values.push_back(ranks[code]);
+            keys.is_valid.push_back(code != DictionaryColumn::missing_code);
+          }
+        });
+      return keys;
+    };
+  return std::make_pair(get_side_keys(left_column), get_side_keys(right_column));
+}
+
+std::unique_ptr<RecordsBase> RecordsBase::merge_impl(
+  const RecordsBase & right_records,
+  const JoinKeys & left_keys,
+  const JoinKeys & right_keys,
+  std::vector<std::string> columns,
+  std::string how
+) const
+{
+  bool merge_right_record = how == "right" || how == "outer";
+  bool merge_left_record = how == "left" || how == "outer";
 
-  RecordsMapImpl concat_records(concat_columns.as_list(), {column_merge_stamp, column_side});
-  concat_records.concat(*left_records_copy);
-  concat_records.concat(*right_records_copy);
+  // Rows are the left records followed by the right records.
+  std::vector<const Record *> records;
+  std::vector<uint8_t> sides;
+  std::vector<uint8_t> has_valid_join_key;
+  std::vector<uint64_t> merge_stamps;
+  TraceScope tag_phase("merge/tag");
+  auto add_rows = [&](const RecordsBase & input_records, const JoinKeys & keys, Side side) {
+      size_t i = 0;
+      for (auto it = input_records.cbegin(); it->has_next(); it->next(), i++) {
+        records.push_back(&it->get_record());
+        sides.push_back(side);
+        has_valid_join_key.push_back(keys.is_valid[i]);
+        merge_stamps.push_back(keys.is_valid[i] ? keys.values[i] : UINT64_MAX);
+      }
+    };
+  add_rows(*this, left_keys, Left);
+  add_rows(right_records, right_keys, Right);
+  tag_phase.end();
+
+  TraceScope sort_phase("merge/sort");
+  std::vector<size_t> order(records.size());
+  auto value_count = left_keys.value_count;
+  if (value_count > 0 && value_count == right_keys.value_count) {
+    // Counting sort on the ranks, with UINT64_MAX last. Left rows come before
+    // right rows, so the order is the same as that of the stable sort.
+    auto get_bucket = [&merge_stamps, value_count](size_t row) {
+        return merge_stamps[row] == UINT64_MAX ? value_count : merge_stamps[row];
+      };
+    std::vector<size_t> offsets(value_count + 2, 0);
+    for (size_t row = 0; row < records.size(); row++) {
+      offsets[get_bucket(row) + 1]++;
+    }
+    std::partial_sum(offsets.begin(), offsets.end(), offsets.begin());
+    for (size_t row = 0; row < records.size(); row++) {
+      order[offsets[get_bucket(row)]++] = row;
+    }
+  } else {
+    std::iota(order.begin(), order.end(), 0);
+    std::stable_sort(
+      order.begin(), order.end(), [&](size_t a, size_t b) {
+        return std::tie(merge_stamps[a], sides[a]) < std::tie(merge_stamps[b], sides[b]);
+      });
+  }
+  sort_phase.end();
 
-  std::vector<Record *> empty_records;
-  std::vector<Record *> left_records_;
-  std::set<uint64_t> processed_stamps;
+  TraceScope scan_phase("merge/scan");
+  std::vector<size_t> empty_rows;
+  std::vector<size_t> left_rows;
+  std::vector<uint8_t> found_right_record(records.size(), false);
+  bool has_join_value = false;
+  uint64_t current_join_value = 0;
 
   auto merged_records = std::make_unique<RecordsVectorImpl>(columns);
+  merged_records->set_arena(std::make_shared<RecordArena>());
+  RecordProjection projection(columns, merged_records->get_record_allocator());
 
-  for (auto it = concat_records.begin(); it->has_next(); it->next()) {
-    auto & record = it->get_record();
-    if (!record.get(column_has_valid_join_key)) {
-      empty_records.push_back(&record);
+  for (auto row : order) {
+    if (!has_valid_join_key[row]) {
+      empty_rows.push_back(row);
       continue;
     }
 
-    auto join_value = record.get(column_join_key);
-    if (processed_stamps.count(join_value) == 0) {
-      for (auto & left_record : left_records_) {
-        if (left_record->get(column_found_right_record) == false) {
-          empty_records.push_back(left_record);
+    auto join_value = merge_stamps[row];
+    if (!has_join_value || join_value != current_join_value) {
+      for (auto left_row : left_rows) {
+        if (!found_right_record[left_row]) {
+          empty_rows.push_back(left_row);
         }
       }
-      left_records_.clear();
-      processed_stamps.emplace(join_value);
+      left_rows.clear();
+      has_join_value = true;
+      current_join_value = join_value;
     }
-    if (record.get(column_side) == Left) {
-      record.add(column_found_right_record, false);
-      left_records_.push_back(&record);
+    if (sides[row] == Left) {
+      left_rows.push_back(row);
       continue;
     }
 
-    for (auto & left_record : left_records_) {
-      left_record->add(column_found_right_record, true);
-      auto merged_record = record;
-      merged_record.merge(*left_record);
-      merged_records->append(merged_record);
+    for (auto left_row : left_rows) {
+      found_right_record[left_row] = true;
+      merged_records->append(projection(*records[left_row], *records[row]));
     }
 
-    if (left_records_.size() == 0) {
-      empty_records.push_back(&record);
+    if (left_rows.size() == 0) {
+      empty_rows.push_back(row);
     }
   }
 
-  for (auto & left_record : left_records_) {
-    if (left_record->get(column_found_right_record) == false) {
-      empty_records.push_back(left_record);
+  for (auto left_row : left_rows) {
+    if (!found_right_record[left_row]) {
+      empty_rows.push_back(left_row);
     }
   }
+  scan_phase.end();
+
+  TraceScope unmatched_phase("merge/unmatched");
+  for (auto row : empty_rows) {
+    if (sides[row] == Left && merge_left_record) {
+      merged_records->append(projection(*records[row]));
+    } else if (sides[row] == Right && merge_right_record) {
+      merged_records->append(projection(*records[row]));
+    }
+  }
+
+  return merged_records;
+}
+
+
+// Same result as merge(), computed from sorted indexes of the join keys
+// instead of sorting a copy of both inputs.
+// Returns nullptr when a join value is UINT64_MAX, which merge() orders
+// together with records without a join key.
+std::unique_ptr<RecordsBase> RecordsBase::merge_with_index(
+  const RecordsBase & right_records,
+  const JoinIndex & left_index,
+  const JoinIndex & right_index,
+  std::vector<std::string> columns,
+  std::string how
+) const
+{
+  auto & left_entries = left_index.get_entries();
+  auto & right_entries = right_index.get_entries();
+  if ((left_entries.size() > 0 && left_entries.back().first == UINT64_MAX) ||
+    (right_entries.size() > 0 && right_entries.back().first == UINT64_MAX))
+  {
+    return nullptr;
+  }
+
+  bool merge_right_record = how == "right" || how == "outer";
+  bool merge_left_record = how == "left" || how == "outer";
+
+  auto merged_records = std::make_unique<RecordsVectorImpl>(columns);
+  merged_records->set_arena(std::make_shared<RecordArena>());
+  RecordProjection projection(columns, merged_records->get_record_allocator());
+  std::vector<std::pair<const Record *, uint64_t>> empty_records;
+  std::vector<const Record *> unmatched_left_records;
+
+  size_t left_begin = 0;
+  size_t right_begin = 0;
+  while (left_begin < left_entries.size() || right_begin < right_entries.size()) {
+    uint64_t join_value = UINT64_MAX;
+    if (left_begin < left_entries.size()) {
+      join_value = left_entries[left_begin].first;
+    }
+    if (right_begin < right_entries.size()) {
+      join_value = std::min(join_value, right_entries[right_begin].first);
+    }
+    auto left_end = left_begin;
+    while (left_end < left_entries.size() && left_entries[left_end].first == join_value) {
+      left_end++;
+    }
+    auto right_end = right_begin;
+    while (right_end < right_entries.size() && right_entries[right_end].first == join_value) {
+      right_end++;
+    }
+
+    for (auto & left_record : unmatched_left_records) {
+      empty_records.emplace_back(left_record, Left);
+    }
+    unmatched_left_records.clear();
 
-  for (auto & record_ptr : empty_records) {
-    auto & record = *record_ptr;
-    if (record.get(column_side) == Left && merge_left_record) {
-      merged_records->append(record);
-    } else if (record.get(column_side) == Right && merge_right_record) {
-      merged_records->append(record);
+    if (right_begin == right_end) {
+      for (auto i = left_begin; i < left_end; i++) {
+        unmatched_left_records.push_back(&at(left_entries[i].second));
+      }
+    } else if (left_begin == left_end) {
+      for (auto i = right_begin; i < right_end; i++) {
+        empty_records.emplace_back(&right_records.at(right_entries[i].second), Right);
+      }
+    } else {
+      for (auto i = right_begin; i < right_end; i++) {
+        auto & right_record = right_records.at(right_entries[i].second);
+        for (auto j = left_begin; j < left_end; j++) {
+          merged_records->append(projection(at(left_entries[j].second), right_record));
+        }
+      }
     }
+    left_begin = left_end;
+    right_begin = right_end;
+  }
+
+  // Records without a join key come last, and the last group of unmatched left
+  // records after them.
+  for (auto position : left_index.get_missing_positions()) {
+    empty_records.emplace_back(&at(position), Left);
+  }
+  for (auto position : right_index.get_missing_positions()) {
+    empty_records.emplace_back(&right_records.at(position), Right);
+  }
+  for (auto & left_record : unmatched_left_records) {
+    empty_records.emplace_back(left_record, Left);
   }
 
-  merged_records->drop_columns(
-    {column_side, column_merge_stamp, column_join_key,
-      column_has_valid_join_key, column_found_right_record});
+  for (auto & pair : empty_records) {
+    if ((pair.second == Left && merge_left_record) ||
+      (pair.second == Right && merge_right_record))
+    {
+      merged_records->append(projection(*pair.first));
+    }
+  }
 
   return merged_records;
 }
 
+// Same algorithm as merge(), but the inputs are not copied.
+// Records are streamed through a SpillSorter ordered by (join value, side), so the
+// sort spills to disk. Unmatched records are collected until the end and the output
+// is built in memory, as in merge().
+std::unique_ptr<RecordsBase> RecordsBase::merge_out_of_core(
+  const RecordsBase & right_records,
+  std::string join_left_key,
+  std::string join_right_key,
+  std::vector<std::string> columns,
+  std::string how
+) const
+{
+  bool merge_right_record = how == "right" || how == "outer";
+  bool merge_left_record = how == "left" || how == "outer";
+
+  auto & config = OutOfCoreConfig::get_instance();
+  SpillSorter sorter(config.get_memory_budget(), config.get_spill_dir());
+
+  // Only the requested columns are spilled; merging projected records gives the
+  // same result as projecting merged ones.
+  RecordProjection projection(columns);
+  auto add_records = [&sorter, &projection](
+    const RecordsBase & records, std::string & join_key, Side side) {
+      auto & column_manager = ColumnManager::get_instance();
+      auto join_key_hash = column_manager.get_hash(join_key);
+      for (auto it = records.cbegin(); it->has_next(); it->next()) {
+        auto & record = it->get_record();
+        bool has_valid_join_key = record.has_column(join_key_hash);
+        auto merge_stamp = has_valid_join_key ? record.get(join_key_hash) : UINT64_MAX;
+        sorter.add(merge_stamp, side, has_valid_join_key, projection(record));
+      }
+    };
+  add_records(*this, join_left_key, Left);
+  add_records(right_records, join_right_key, Right);
+
+  auto merged_records = std::make_unique<RecordsVectorImpl>(columns);
+  merged_records->set_arena(std::make_shared<RecordArena>());
+  std::vector<Record> empty_records;
+  std::vector<Record> left_records_;
+  std::vector<bool> found_right_record;
+  bool has_join_value = false;
+  uint64_t current_join_value = 0;
+
+  auto flush_left_records = [&]() {
+      for (size_t i = 0; i < left_records_.size(); i++) {
+        if (!found_right_record[i] && merge_left_record) {
+          empty_records.push_back(std::move(left_records_[i]));
+        }
+      }
+      left_records_.clear();
+      found_right_record.clear();
+    };
+
+  uint64_t join_value;
+  uint64_t side;
+  uint64_t has_valid_join_key;
+  Record record;
+  while (sorter.next(join_value, side, has_valid_join_key, record)) {
+    if (!has_valid_join_key) {
+      if ((side == Left && merge_left_record) || (side == Right && merge_right_record)) {
+        empty_records.push_back(std::move(record));
+      }
+      continue;
+    }
+
+    if (!has_join_value || join_value != current_join_value) {
+      flush_left_records();
+      has_join_value = true;
+      current_join_value = join_value;
+    }
+
+    if (side == Left) {
+      left_records_.push_back(std::move(record));
+      found_right_record.push_back(false);
+      continue;
+    }
+
+    for (size_t i = 0; i < left_records_.size(); i++) {
+      found_right_record[i] = true;
+      Record merged_record(record, merged_records->get_record_allocator());
+      merged_record.merge(left_records_[i]);
+      merged_records->append(std::move(merged_record));
+    }
+
+    if (left_records_.size() == 0 && merge_right_record) {
+      empty_records.push_back(std::move(record));
+    }
+  }
+  flush_left_records();
+
+  merged_records->append(std::move(empty_records));
+
+  return merged_records;
+}
 
 std::unique_ptr<RecordsBase> RecordsBase::merge_sequential(
   const RecordsBase & right_records,
@@ -362,282 +818,660 @@ std::unique_ptr<RecordsBase> RecordsBase::merge_sequential(
   std::string how
 )
 {
-  auto left_records_copy = this->clone();
-  auto data = left_records_copy->get_data();
-  auto right_records_copy = right_records.clone();
+  ProfileScope scope("merge_sequential", size() + right_records.size());
+  auto & merge_cache = MergeCache::get_instance();
+  std::string cache_key;
+  if (merge_cache.is_enabled()) {
+    std::vector<std::string> params = {
+      left_stamp_key, right_stamp_key, join_left_key, join_right_key, how};
+    params.insert(params.end(), columns.begin(), columns.end());
+    cache_key = merge_cache.make_key("merge_sequential", {this, &right_records}, params);
+    if (auto cached_records = merge_cache.load(cache_key)) {
+      return scope.set_output(std::move(cached_records));
+    }
+  }
+
+  auto keys = get_join_keys(*this, join_left_key, right_records, join_right_key);
+  auto merged_records = merge_sequential_impl(
+    right_records, left_stamp_key, right_stamp_key, keys.first, keys.second, columns, how);
+
+  if (merge_cache.is_enabled()) {
+    merge_cache.store(cache_key, *merged_records);
+  }
 
+  return scope.set_output(std::move(merged_records));
+}
+
+std::unique_ptr<RecordsBase> RecordsBase::merge_sequential_impl(
+  const RecordsBase & right_records,
+  std::string left_stamp_key,
+  std::string right_stamp_key,
+  const JoinKeys & left_keys,
+  const JoinKeys & right_keys,
+  std::vector<std::string> columns,
+  std::string how
+) const
+{
   bool merge_left = how == "left" || how == "outer" || how == "left_use_latest";
   bool merge_right = how == "right" || how == "outer";
   bool bind_latest_left_record = how == "left_use_latest";
 
-
   auto merged_records = std::make_unique<RecordsVectorImpl>(columns);
-
-  auto column_side = "_merge_tmp_side";
-  auto column_has_valid_join_key = "merge_tmp_has_valid_join_key";
-  auto column_merge_stamp = "_merge_tmp_merge_stamp";
-  auto column_has_merge_stamp = "_merge_tmp_has_merge_stamp";
-
-  left_records_copy->append_column(
-    column_side,
-    std::vector<uint64_t>(left_records_copy->size(), Left)
-  );
-
-  right_records_copy->append_column(
-    column_side,
-    std::vector<uint64_t>(right_records_copy->size(), Right)
-  );
-
-  auto assign_temporal_columns = [&](Record & record, std::string & join_key) {
-      record.add(
-        column_has_valid_join_key,
-        join_key == "" || record.has_column(join_key)
-      );
-
-      if (record.get(column_side) == Left && record.has_column(left_stamp_key)) {
-        record.add(column_merge_stamp, record.get(left_stamp_key));
-        record.add(column_has_merge_stamp, true);
-      } else if (record.get(column_side) == Right && record.has_column(right_stamp_key)) {
-        record.add(column_merge_stamp, record.get(right_stamp_key));
-        record.add(column_has_merge_stamp, true);
-      } else {
-        record.add(column_merge_stamp, UINT64_MAX);
-        record.add(column_has_merge_stamp, false);
+  merged_records->set_arena(std::make_shared<RecordArena>());
+  RecordProjection projection(columns, merged_records->get_record_allocator());
+
+  // Rows are the left records followed by the right records.
+  std::vector<const Record *> records;
+  std::vector<uint8_t> sides;
+  std::vector<uint8_t> has_merge_stamp;
+  std::vector<uint64_t> merge_stamps;
+  std::vector<uint8_t> has_valid_join_key;
+  std::vector<uint64_t> join_values;
+  TraceScope tag_phase("merge_sequential/tag");
+  auto add_rows = [&](
+    const RecordsBase & input_records, std::string stamp_key, const JoinKeys & keys, Side side) {
+      auto stamp_hash = ColumnManager::get_instance().get_hash(stamp_key);
+      // Stamps of a packed column are decoded block by block up front.
+      auto packed_column = input_records.get_packed_column(stamp_hash);
+      if (packed_column != nullptr) {
+        packed_column->decode(merge_stamps);
       }
-    };
-
-  for (auto it = left_records_copy->begin(); it->has_next(); it->next()) {
-    auto & record = it->get_record();
-    assign_temporal_columns(record, join_left_key);
-  }
-  for (auto it = right_records_copy->begin(); it->has_next(); it->next()) {
-    auto & record = it->get_record();
-    assign_temporal_columns(record, join_right_key);
-  }
-
-  auto concat_columns = UniqueList();
-  concat_columns.add_columns(left_records_copy->get_columns());
-  concat_columns.add_columns(right_records_copy->get_columns());
-  concat_columns.add_columns(
-  {
-    column_has_merge_stamp,
-    column_merge_stamp,
-    column_has_merge_stamp,
-  });
-  RecordsMapImpl concat_records({}, concat_columns.as_list(), {column_merge_stamp, column_side});
-  concat_records.concat(*left_records_copy);
-  concat_records.concat(*right_records_copy);
-
-  auto get_join_value =
-    [&join_left_key, &join_right_key, &column_side](Record & record) -> uint64_t {
-      std::string join_key;
-      if (record.get(column_side) == Left) {
-        join_key = join_left_key;
-      } else {
-        join_key = join_right_key;
+      size_t i = 0;
+      for (auto it = input_records.cbegin(); it->has_next(); it->next(), i++) {
+        auto & record = it->get_record();
+        bool has_stamp = packed_column != nullptr ?
+          packed_column->has_value(i) : record.has_column(stamp_hash);
+        records.push_back(&record);
+        sides.push_back(side);
+        has_merge_stamp.push_back(has_stamp);
+        if (packed_column == nullptr) {
+          merge_stamps.push_back(has_stamp ? record.get(stamp_hash) : UINT64_MAX);
+        }
+        has_valid_join_key.push_back(keys.is_valid[i]);
+        join_values.push_back(keys.values[i]);  // UINT64_MAX is used as None
       }
-      if (join_key == "") {
-        return 0;
-      } else if (record.has_column(join_key)) {
-        return record.get(join_key);
+    };
+  add_rows(*this, left_stamp_key, left_keys, Left);
+  add_rows(right_records, right_stamp_key, right_keys, Right);
+  auto left_size = size();
+  tag_phase.end();
+
+  TraceScope sort_phase("merge_sequential/sort");
+  // Positions of the records in stamp order, with records without a stamp last.
+  // Taken from the sort order or an index on the stamp when available.
+  auto get_stamp_order = [&](
+    const RecordsBase & input_records, std::string stamp_key, size_t offset, size_t count) {
+      std::vector<size_t> order;
+      auto index = input_records.get_index(stamp_key);
+      auto packed_column = input_records.get_packed_column(stamp_key);
+      if (input_records.is_sorted_on(stamp_key) ||
+        (packed_column != nullptr && packed_column->is_ascending()))
+      {
+        order.resize(count);
+        std::iota(order.begin(), order.end(), offset);
+      } else if (index != nullptr &&
+        (index->get_entries().size() == 0 || index->get_entries().back().first != UINT64_MAX))
+      {
+        for (auto & entry : index->get_entries()) {
+          order.push_back(entry.second + offset);
+        }
+        for (auto position : index->get_missing_positions()) {
+          order.push_back(position + offset);
+        }
       } else {
-        return UINT64_MAX;  // use as None
+        order.resize(count);
+        std::iota(order.begin(), order.end(), offset);
+        std::stable_sort(
+          order.begin(), order.end(), [&merge_stamps](size_t a, size_t b) {
+            return merge_stamps[a] < merge_stamps[b];
+          });
       }
+      return order;
     };
-
-
-  // std::unordered_map<int, uint64_t> sub_empty_records;
-  std::unordered_map<uint64_t, Record *> to_left_record_index;
-  std::unordered_map<Record *, std::vector<Record *>> to_sub_record_indices;
-
-  for (auto it = concat_records.begin(); it->has_next(); it->next()) {
-    auto & record = it->get_record();
-    if (!record.get(column_has_merge_stamp)) {
+  auto left_order = get_stamp_order(*this, left_stamp_key, 0, left_size);
+  auto right_order = get_stamp_order(
+    right_records, right_stamp_key, left_size, records.size() - left_size);
+
+  // Interleave both sides by stamp; left records come first on ties.
+  std::vector<size_t> order;
+  order.reserve(records.size());
+  size_t left_i = 0;
+  size_t right_i = 0;
+  while (left_i < left_order.size() || right_i < right_order.size()) {
+    bool take_left = right_i == right_order.size() ||
+      (left_i < left_order.size() &&
+      merge_stamps[left_order[left_i]] <= merge_stamps[right_order[right_i]]);
+    order.push_back(take_left ? left_order[left_i++] : right_order[right_i++]);
+  }
+  sort_phase.end();
+
+  // Right records assigned to each left record, as singly linked lists.
+  const size_t not_found = SIZE_MAX;
+  std::vector<size_t> sub_head(records.size(), not_found);
+  std::vector<size_t> sub_tail(records.size(), not_found);
+  std::vector<size_t> sub_next(records.size(), not_found);
+  // Latest left row of each join value, in an array when the join values are ranks.
+  bool has_ranks = left_keys.value_count > 0 && left_keys.value_count == right_keys.value_count;
+  std::vector<size_t> to_left_row_by_rank(has_ranks ? left_keys.value_count : 0, not_found);
+  std::unordered_map<uint64_t, size_t> to_left_row;
+
+  TraceScope match_phase("merge_sequential/match");
+  for (auto row : order) {
+    if (!has_merge_stamp[row]) {
       continue;
     }
 
-    if (record.get(column_side) == Left) {
-      to_sub_record_indices[&record] = std::vector<Record *>();
-
-      auto join_value = get_join_value(record);
-      if (join_value == UINT64_MAX) {
-        continue;
-      }
-      to_left_record_index[join_value] = &record;
-    } else if (record.get(column_side) == Right) {
-      auto join_value = get_join_value(record);
-      if (join_value == UINT64_MAX) {
-        continue;
+    auto join_value = join_values[row];
+    if (join_value == UINT64_MAX) {
+      continue;
+    }
+    if (sides[row] == Left) {
+      if (has_ranks) {
+        to_left_row_by_rank[join_value] = row;
+      } else {
+        to_left_row[join_value] = row;
       }
+      continue;
+    }
 
-      if (to_left_record_index.count(join_value) == 0) {
-        continue;
+    auto left_row = not_found;
+    if (has_ranks) {
+      left_row = to_left_row_by_rank[join_value];
+    } else {
+      auto it = to_left_row.find(join_value);
+      if (it != to_left_row.end()) {
+        left_row = it->second;
       }
-      auto & left_record = *to_left_record_index[join_value];
-      to_sub_record_indices[&left_record].push_back(&record);
     }
+    if (left_row == not_found) {
+      continue;
+    }
+    if (sub_head[left_row] == not_found) {
+      sub_head[left_row] = row;
+    } else {
+      sub_next[sub_tail[left_row]] = row;
+    }
+    sub_tail[left_row] = row;
   }
+  match_phase.end();
 
-  std::unordered_set<const Record *> added;
+  TraceScope scan_phase("merge_sequential/scan");
+  std::vector<uint8_t> added(records.size(), false);
 
-  for (auto it = concat_records.begin(); it->has_next(); it->next()) {
-    auto & current_record = it->get_record();
-
-    bool is_recorded = added.count(&current_record) > 0;
-    if (is_recorded) {
+  for (auto row : order) {
+    if (added[row]) {
       continue;
     }
 
-    if (!current_record.get(column_has_merge_stamp) ||
-      !current_record.get(column_has_valid_join_key))
-    {
-      if (current_record.get(column_side) == Left && merge_left) {
-        merged_records->append(current_record);
-        added.insert(&current_record);
-      } else if (current_record.get(column_side) == Right && merge_right) {
-        merged_records->append(current_record);
-        added.insert(&current_record);
+    auto & current_record = *records[row];
+    if (!has_merge_stamp[row] || !has_valid_join_key[row]) {
+      if (sides[row] == Left && merge_left) {
+        merged_records->append(projection(current_record));
+        added[row] = true;
+      } else if (sides[row] == Right && merge_right) {
+        merged_records->append(projection(current_record));
+        added[row] = true;
       }
       continue;
     }
 
-    if (current_record.get(column_side) == Right) {
+    if (sides[row] == Right) {
       if (merge_right) {
-        merged_records->append(current_record);
-        added.insert(&current_record);
+        merged_records->append(projection(current_record));
+        added[row] = true;
       }
       continue;
     }
 
-    auto sub_record_indices = to_sub_record_indices[&current_record];
-    if (sub_record_indices.size() == 0) {
+    if (sub_head[row] == not_found) {
       if (merge_left) {
-        merged_records->append(current_record);
-        added.insert(&current_record);
+        merged_records->append(projection(current_record));
+        added[row] = true;
       }
       continue;
     }
 
-    for (uint64_t j = 0; j < sub_record_indices.size(); j++) {
-      auto & sub_record = *sub_record_indices[j];
+    uint64_t j = 0;
+    for (auto sub_row = sub_head[row]; sub_row != not_found; sub_row = sub_next[sub_row], j++) {
       if (1 <= j && !bind_latest_left_record) {
         break;
       }
 
-      if (added.count(&sub_record) > 0) {
+      if (added[sub_row]) {
         if (merge_left) {
-          merged_records->append(current_record);
-          added.insert(&current_record);
+          merged_records->append(projection(current_record));
+          added[row] = true;
         }
         continue;
       }
 
-      Record merge_record = current_record;
-      merge_record.merge(sub_record);
-      merged_records->append(merge_record);
-      added.insert(&current_record);
-      added.insert(&sub_record);
+      merged_records->append(projection(*records[sub_row], current_record));
+      added[row] = true;
+      added[sub_row] = true;
     }
   }
 
-  merged_records->drop_columns(
-  {
-    column_side,
-    column_has_merge_stamp,
-    column_merge_stamp,
-    column_has_valid_join_key,
-  }
-  );
-
   return merged_records;
 }
 
-
-void RecordsBase::reindex(std::vector<std::string> columns)
-{
-  set_columns(columns);
-}
-
-std::unique_ptr<RecordsBase> RecordsBase::merge_sequential_for_addr_track(
-  std::string source_stamp_key,
-  std::string source_key,
-  const RecordsBase & copy_records,
-  std::string copy_stamp_key,
-  std::string copy_from_key,
-  std::string copy_to_key,
-  const RecordsBase & sink_records,
-  std::string sink_stamp_key,
-  std::string sink_from_key
-)
+// Join values numbered per distinct tuple of the key columns, in tuple order, so
+// that joins see the same ordering as with the tuples themselves.
+// Records missing any of the key columns have no join key.
+std::pair<RecordsBase::JoinKeys, RecordsBase::JoinKeys> RecordsBase::get_composite_join_keys(
+  const RecordsBase & left_records,
+  const std::vector<std::string> & join_left_keys,
+  const RecordsBase & right_records,
+  const std::vector<std::string> & join_right_keys,
+  bool max_as_none)
 {
-  enum RecordType { Copy, Sink, Source};
-  // [python side implementation]
-  // assert how in ["inner", "left", "right", "outer"]
-
-  auto column_type = "_tmp_type";
-  auto column_timestamp = "_tmp_timestamp";
-
-  auto source_records_tmp = this->clone();
-  auto copy_records_tmp = copy_records.clone();
-  auto sink_records_tmp = sink_records.clone();
-
-  source_records_tmp->append_column(
-    column_type,
-    std::vector<uint64_t>(source_records_tmp->size(), Source)
-  );
-
-  copy_records_tmp->append_column(
-    column_type,
-    std::vector<uint64_t>(copy_records_tmp->size(), Copy)
-  );
-
-  sink_records_tmp->append_column(
-    column_type,
-    std::vector<uint64_t>(sink_records_tmp->size(), Sink)
-  );
-
-  std::vector<uint64_t> source_stamps;
-  std::vector<uint64_t> sink_stamps;
-  for (auto & record : source_records_tmp->get_data()) {
-    source_stamps.emplace_back(record.get(source_stamp_key));
+  if (join_left_keys.size() != join_right_keys.size()) {
+    std::cerr << "The number of left and right join keys must be the same." << std::endl;
+    throw std::exception();
   }
-  for (auto & record : sink_records_tmp->get_data()) {
-    sink_stamps.emplace_back(record.get(sink_stamp_key));
+  if (join_left_keys.size() == 0) {
+    std::cerr << "At least one join key is required." << std::endl;
+    throw std::exception();
   }
 
-  source_records_tmp->append_column(column_timestamp, source_stamps);
+  auto & column_manager = ColumnManager::get_instance();
+  auto width = join_left_keys.size();
+  std::vector<const RecordsBase *> records_list = {&left_records, &right_records};
+  std::vector<const std::vector<std::string> *> keys_list = {&join_left_keys, &join_right_keys};
+
+  // Key tuples are stored flat; tuple_ids holds the distinct tuple of each record.
+  std::vector<uint64_t> tuples;
+  std::vector<size_t> tuple_ids;
+  std::vector<size_t> distinct_tuples;
+  auto hash = [&tuples, width](size_t i) {
+      size_t h = 0;
+      for (size_t j = 0; j < width; j++) {
+        h = h * 0x9e3779b97f4a7c15 + std::hash<uint64_t>()(tuples[i * width + j]);
+      }
+      return h;
+    };
+  auto equal = [&tuples, width](size_t a, size_t b) {
+      return std::equal(
+        tuples.begin() + a * width, tuples.begin() + (a + 1) * width,
+        tuples.begin() + b * width);
+    };
+  std::unordered_map<size_t, size_t, decltype(hash), decltype(equal)> to_tuple_id(
+    16, hash, equal);
+
+  const size_t no_tuple = SIZE_MAX;
+  for (size_t side = 0; side < records_list.size(); side++) {
+    std::vector<size_t> hashes;
+    for (auto & key : *keys_list[side]) {
+      hashes.push_back(column_manager.get_hash(key));
+    }
+    for (auto it = records_list[side]->cbegin(); it->has_next(); it->next()) {
+      auto & record = it->get_record();
+      bool has_key = std::all_of(
+        hashes.begin(), hashes.end(), [&record](size_t hash) {
+          return record.has_column(hash);
+        });
+      if (!has_key) {
+        tuple_ids.push_back(no_tuple);
+        continue;
+      }
+      auto row = tuples.size() / width;
+      for (auto hash : hashes) {
+        tuples.push_back(record.get(hash));
+      }
+      auto pair = to_tuple_id.emplace(row, distinct_tuples.size());
+      if (pair.second) {
+        distinct_tuples.push_back(row);
+      } else {
+        tuples.resize(row * width);
+      }
+      tuple_ids.push_back(pair.first->second);
+    }
+  }
 
-  copy_records_tmp->rename_columns(
-    std::unordered_map<std::string, std::string>(
-  {
-    {copy_stamp_key, column_timestamp}
-  })
-  );
+  std::vector<size_t> order(distinct_tuples.size());
+  std::iota(order.begin(), order.end(), 0);
+  std::sort(
+    order.begin(), order.end(), [&](size_t a, size_t b) {
+      auto begin_a = tuples.begin() + distinct_tuples[a] * width;
+      auto begin_b = tuples.begin() + distinct_tuples[b] * width;
+      return std::lexicographical_compare(
+        begin_a, begin_a + width, begin_b, begin_b + width);
+    });
+  std::vector<uint64_t> ranks(distinct_tuples.size());
+  for (size_t i = 0; i < order.size(); i++) {
+    ranks[order[i]] = i;
+  }
+  if (max_as_none) {
+    for (size_t i = 0; i < distinct_tuples.size(); i++) {
+      auto begin = tuples.begin() + distinct_tuples[i] * width;
+      if (std::find(begin, begin + width, UINT64_MAX) != begin + width) {
+        ranks[i] = UINT64_MAX;
+      }
+    }
+  }
 
-  sink_records_tmp->append_column(column_timestamp, sink_stamps);
+  std::pair<JoinKeys, JoinKeys> keys;
+  keys.first.value_count = distinct_tuples.size();
+  keys.second.value_count = distinct_tuples.size();
+  for (size_t i = 0; i < tuple_ids.size(); i++) {
+    auto & side_keys = i < left_records.size() ? keys.first : keys.second;
+    bool is_valid = tuple_ids[i] != no_tuple;
+    side_keys.values.push_back(is_valid ? ranks[tuple_ids[i]] : UINT64_MAX);
+    side_keys.is_valid.push_back(is_valid);
+  }
+  return keys;
+}
 
-  auto merged_columns = UniqueList();
-  merged_columns.add_columns(source_records_tmp->get_columns());
-  merged_columns.add_columns(copy_records_tmp->get_columns());
-  merged_columns.add_columns(sink_records_tmp->get_columns());
+std::unique_ptr<RecordsBase> RecordsBase::merge(
+  const RecordsBase & right_records,
+  std::vector<std::string> join_left_keys,
+  std::vector<std::string> join_right_keys,
+  std::vector<std::string> columns,
+  std::string how
+)
+{
+  if (join_left_keys.size() == 1 && join_right_keys.size() == 1) {
+    return merge(right_records, join_left_keys[0], join_right_keys[0], columns, how);
+  }
+
+  ProfileScope scope("merge", size() + right_records.size());
+  auto & merge_cache = MergeCache::get_instance();
+  std::string cache_key;
+  if (merge_cache.is_enabled()) {
+    std::vector<std::string> params = join_left_keys;
+    params.insert(params.end(), join_right_keys.begin(), join_right_keys.end());
+    params.push_back(how);
+    params.insert(params.end(), columns.begin(), columns.end());
+    cache_key = merge_cache.make_key(
+      "merge_composite_" + std::to_string(join_left_keys.size()), {this, &right_records}, params);
+    if (auto cached_records = merge_cache.load(cache_key)) {
+      return scope.set_output(std::move(cached_records));
+    }
+  }
+
+  auto keys = get_composite_join_keys(
+    *this, join_left_keys, right_records, join_right_keys, false);
+  auto merged_records = merge_impl(right_records, keys.first, keys.second, columns, how);
+
+  if (merge_cache.is_enabled()) {
+    merge_cache.store(cache_key, *merged_records);
+  }
+
+  return scope.set_output(std::move(merged_records));
+}
+
+std::unique_ptr<RecordsBase> RecordsBase::merge_sequential(
+  const RecordsBase & right_records,
+  std::string left_stamp_key,
+  std::string right_stamp_key,
+  std::vector<std::string> join_left_keys,
+  std::vector<std::string> join_right_keys,
+  std::vector<std::string> columns,
+  std::string how
+)
+{
+  if (join_left_keys.size() == 0 && join_right_keys.size() == 0) {
+    return merge_sequential(
+      right_records, left_stamp_key, right_stamp_key, "", "", columns, how);
+  }
+  if (join_left_keys.size() == 1 && join_right_keys.size() == 1) {
+    return merge_sequential(
+      right_records, left_stamp_key, right_stamp_key, join_left_keys[0], join_right_keys[0],
+      columns, how);
+  }
+
+  ProfileScope scope("merge_sequential", size() + right_records.size());
+  auto & merge_cache = MergeCache::get_instance();
+  std::string cache_key;
+  if (merge_cache.is_enabled()) {
+    std::vector<std::string> params = {left_stamp_key, right_stamp_key};
+    params.insert(params.end(), join_left_keys.begin(), join_left_keys.end());
+    params.insert(params.end(), join_right_keys.begin(), join_right_keys.end());
+    params.push_back(how);
+    params.insert(params.end(), columns.begin(), columns.end());
+    cache_key = merge_cache.make_key(
+      "merge_sequential_composite_" + std::to_string(join_left_keys.size()),
+      {this, &right_records}, params);
+    if (auto cached_records = merge_cache.load(cache_key)) {
+      return scope.set_output(std::move(cached_records));
+    }
+  }
+
+  auto keys = get_composite_join_keys(
+    *this, join_left_keys, right_records, join_right_keys, true);
+  auto merged_records = merge_sequential_impl(
+    right_records, left_stamp_key, right_stamp_key, keys.first, keys.second, columns, how);
+
+  if (merge_cache.is_enabled()) {
+    merge_cache.store(cache_key, *merged_records);
+  }
+
+  return scope.set_output(std::move(merged_records));
+}
+
+std::unique_ptr<RecordsBase> RecordsBase::merge_asof(
+  const RecordsBase & right_records,
+  std::string left_stamp_key,
+  std::string right_stamp_key,
+  std::string join_left_key,
+  std::string join_right_key,
+  std::vector<std::string> columns,
+  std::string direction,
+  uint64_t tolerance
+) const
+{
+  ProfileScope scope("merge_asof", size() + right_records.size());
+  bool use_backward = direction == "backward" || direction == "nearest";
+  bool use_forward = direction == "forward" || direction == "nearest";
+  if (!use_backward && !use_forward) {
+    std::cerr << "Unknown direction: " << direction << std::endl;
+    throw std::exception();
+  }
+
+  // Groups of (stamp, position) in stamp order, one group per join key value.
+  struct Group
+  {
+    std::vector<std::pair<uint64_t, size_t>> left;
+    std::vector<std::pair<uint64_t, size_t>> right;
+  };
+  std::vector<Group> groups;
+  std::unordered_map<uint64_t, size_t> to_group_index;
+
+  auto & column_manager = ColumnManager::get_instance();
+  auto add_to_groups = [&](
+    const RecordsBase & records, std::string stamp_key, std::string join_key, bool is_left) {
+      auto stamp_hash = column_manager.get_hash(stamp_key);
+      auto join_hash = join_key == "" ? 0 : column_manager.get_hash(join_key);
+      std::vector<std::pair<uint64_t, size_t>> stamps;
+      size_t position = 0;
+      for (auto it = records.cbegin(); it->has_next(); it->next(), position++) {
+        auto & record = it->get_record();
+        if (record.has_column(stamp_hash)) {
+          stamps.emplace_back(record.get(stamp_hash), position);
+        }
+      }
+      if (!records.is_sorted_on(stamp_key)) {
+        std::sort(stamps.begin(), stamps.end());
+      }
+
+      for (auto & stamp : stamps) {
+        uint64_t join_value = 0;
+        if (join_key != "") {
+          auto & record = records.at(stamp.second);
+          if (!record.has_column(join_hash)) {
+            continue;
+          }
+          join_value = record.get(join_hash);
+        }
+        auto it = to_group_index.find(join_value);
+        if (it == to_group_index.end()) {
+          if (!is_left) {
+            continue;
+          }
+          it = to_group_index.emplace(join_value, groups.size()).first;
+          groups.emplace_back();
+        }
+        auto & group = groups[it->second];
+        (is_left ? group.left : group.right).push_back(stamp);
+      }
+    };
+  add_to_groups(*this, left_stamp_key, join_left_key, true);
+  add_to_groups(right_records, right_stamp_key, join_right_key, false);
+
+  // Groups are independent, so they are matched in parallel.
+  const size_t not_found = SIZE_MAX;
+  std::vector<size_t> matched_positions(size(), not_found);
+  auto chunk_count = std::min(groups.size(), get_parallel_chunk_count(size(), 1 << 14));
+  parallel_for_chunks(
+    groups.size(), chunk_count, [&](size_t begin, size_t end, size_t) {
+      for (auto i = begin; i < end; i++) {
+        auto & left = groups[i].left;
+        auto & right = groups[i].right;
+        // right[lower_i] is the first record at or after the stamp and
+        // right[upper_i - 1] the last record at or before it.
+        size_t lower_i = 0;
+        size_t upper_i = 0;
+        for (auto & left_stamp : left) {
+          auto stamp = left_stamp.first;
+          while (lower_i < right.size() && right[lower_i].first < stamp) {
+            lower_i++;
+          }
+          upper_i = std::max(upper_i, lower_i);
+          while (upper_i < right.size() && right[upper_i].first <= stamp) {
+            upper_i++;
+          }
+
+          size_t best = not_found;
+          uint64_t best_distance = UINT64_MAX;
+          if (use_backward && upper_i > 0) {
+            best = upper_i - 1;
+            best_distance = stamp - right[best].first;
+          }
+          if (use_forward && lower_i < right.size() &&
+            (best == not_found || right[lower_i].first - stamp < best_distance))
+          {
+            best = lower_i;
+            best_distance = right[lower_i].first - stamp;
+          }
+          if (best != not_found && best_distance <= tolerance) {
+            matched_positions[left_stamp.second] = right[best].second;
+          }
+        }
+      }
+    });
+
+  auto merged_records = std::make_unique<RecordsVectorImpl>(columns);
+  merged_records->set_arena(std::make_shared<RecordArena>());
+  merged_records->reserve(size());
+  RecordProjection projection(columns, merged_records->get_record_allocator());
+  size_t position = 0;
+  for (auto it = cbegin(); it->has_next(); it->next(), position++) {
+    auto & record = it->get_record();
+    if (matched_positions[position] == not_found) {
+      merged_records->append(projection(record));
+      continue;
+    }
+    merged_records->append(projection(right_records.at(matched_positions[position]), record));
+  }
+  return scope.set_output(std::move(merged_records));
+}
+
+void RecordsBase::reindex(std::vector<std::string> columns)
+{
+  set_columns(columns);
+}
 
-  auto merged_records = std::make_unique<RecordsVectorImpl>(merged_columns.as_list());
+std::unique_ptr<RecordsBase> RecordsBase::merge_sequential_for_addr_track(
+  std::string source_stamp_key,
+  std::string source_key,
+  const RecordsBase & copy_records,
+  std::string copy_stamp_key,
+  std::string copy_from_key,
+  std::string copy_to_key,
+  const RecordsBase & sink_records,
+  std::string sink_stamp_key,
+  std::string sink_from_key
+)
+{
+  enum RecordType { Copy, Sink, Source};
+  ProfileScope scope(
+    "merge_sequential_for_addr_track", size() + copy_records.size() + sink_records.size());
+  // [python side implementation]
+  // assert how in ["inner", "left", "right", "outer"]
 
-  RecordsMapImpl concat_records({}, merged_columns.as_list(), {column_timestamp, column_type});
-  concat_records.concat(*source_records_tmp);
-  concat_records.concat(*copy_records_tmp);
-  concat_records.concat(*sink_records_tmp);
+  auto & merge_cache = MergeCache::get_instance();
+  std::string cache_key;
+  if (merge_cache.is_enabled()) {
+    cache_key = merge_cache.make_key(
+      "merge_sequential_for_addr_track", {this, &copy_records, &sink_records},
+      {source_stamp_key, source_key, copy_stamp_key, copy_from_key, copy_to_key,
+        sink_stamp_key, sink_from_key});
+    if (auto cached_records = merge_cache.load(cache_key)) {
+      return scope.set_output(std::move(cached_records));
+    }
+  }
 
-  std::unordered_map<uint64_t, Record *> processing_records;
+  // Rows are the source, copy and sink records in that order.
+  std::vector<const Record *> records;
+  std::vector<uint8_t> types;
+  std::vector<uint64_t> timestamps;
+  auto add_rows = [&](const RecordsBase & input_records, std::string stamp_key, RecordType type) {
+      auto stamp_hash = ColumnManager::get_instance().get_hash(stamp_key);
+      for (auto it = input_records.cbegin(); it->has_next(); it->next()) {
+        auto & record = it->get_record();
+        records.push_back(&record);
+        types.push_back(type);
+        if (type == Copy) {
+          timestamps.push_back(record.get_with_default(stamp_hash, UINT64_MAX));
+        } else {
+          timestamps.push_back(record.get(stamp_hash));
+        }
+      }
+    };
+  add_rows(*this, source_stamp_key, Source);
+  add_rows(copy_records, copy_stamp_key, Copy);
+  add_rows(sink_records, sink_stamp_key, Sink);
+
+  std::vector<size_t> order(records.size());
+  std::iota(order.begin(), order.end(), 0);
+  std::sort(
+    order.begin(), order.end(), [&](size_t a, size_t b) {
+      return std::tie(timestamps[a], types[a], a) < std::tie(timestamps[b], types[b], b);
+    });
+
+  std::vector<std::string> dropped_columns = {
+    sink_from_key, copy_from_key, copy_to_key, copy_stamp_key};
+  auto merged_columns = UniqueList();
+  merged_columns.add_columns(get_columns());
+  merged_columns.add_columns(copy_records.get_columns());
+  merged_columns.add_columns(sink_records.get_columns());
+  std::vector<std::string> columns;
+  for (auto & column : merged_columns.as_list()) {
+    if (std::find(dropped_columns.begin(), dropped_columns.end(), column) ==
+      dropped_columns.end())
+    {
+      columns.push_back(column);
+    }
+  }
+  auto merged_records = std::make_unique<RecordsVectorImpl>(columns);
+  merged_records->set_arena(std::make_shared<RecordArena>());
+
+  auto & column_manager = ColumnManager::get_instance();
+  auto source_key_hash = column_manager.get_hash(source_key);
+  auto copy_from_key_hash = column_manager.get_hash(copy_from_key);
+  auto copy_to_key_hash = column_manager.get_hash(copy_to_key);
+  auto sink_from_key_hash = column_manager.get_hash(sink_from_key);
+
+  // Sink rows being tracked, keyed by address.
+  std::unordered_map<uint64_t, size_t> processing_records;
   using StampSet = std::set<uint64_t>;
   std::unordered_map<uint64_t, std::shared_ptr<StampSet>> stamp_sets;
 
   auto merge_processing_record_keys =
-    [&processing_records, &stamp_sets, &column_timestamp](Record & processing_record) {
-      auto condition = [&processing_record, &stamp_sets, &column_timestamp](const Record & x) {
-          std::shared_ptr<StampSet> & sink_set = stamp_sets[x.get(column_timestamp)];
+    [&processing_records, &stamp_sets, &timestamps](size_t processing_row) {
+      auto condition = [processing_row, &stamp_sets, &timestamps](size_t row) {
+          std::shared_ptr<StampSet> & sink_set = stamp_sets[timestamps[row]];
           std::shared_ptr<StampSet> & processing_record_set =
-            stamp_sets[processing_record.get(column_timestamp)];
+            stamp_sets[timestamps[processing_row]];
           std::shared_ptr<StampSet> result = std::make_shared<StampSet>();
 
           std::set_intersection(
@@ -648,14 +1482,12 @@ std::unique_ptr<RecordsBase> RecordsBase::merge_sequential_for_addr_track(
           return result->size() > 0 && sink_set.get() != processing_record_set.get();
         };
       for (auto & processing_record_pair_ : processing_records) {
-        auto & processing_record_ = *processing_record_pair_.second;
-        if (!condition(processing_record_)) {
+        auto row_ = processing_record_pair_.second;
+        if (!condition(row_)) {
           continue;
         }
-        std::shared_ptr<StampSet> & processing_record_keys = stamp_sets[processing_record.get(
-              column_timestamp)];
-        std::shared_ptr<StampSet> & corresponding_record_keys =
-          stamp_sets[processing_record_.get(column_timestamp)];
+        std::shared_ptr<StampSet> & processing_record_keys = stamp_sets[timestamps[processing_row]];
+        std::shared_ptr<StampSet> & corresponding_record_keys = stamp_sets[timestamps[row_]];
         std::shared_ptr<StampSet> merged_set = std::make_shared<StampSet>();
 
         std::set_union(
@@ -669,55 +1501,53 @@ std::unique_ptr<RecordsBase> RecordsBase::merge_sequential_for_addr_track(
     };
 
 
-  for (auto it = concat_records.rbegin(); it->has_next(); it->next()) {
-    auto & record = it->get_record();
-    record.get_columns();
-    record.get_data();
-    if (record.get(column_type) == Sink) {
-      auto timestamp = record.get(column_timestamp);
+  for (auto order_it = order.rbegin(); order_it != order.rend(); ++order_it) {
+    auto row = *order_it;
+    auto & record = *records[row];
+    if (types[row] == Sink) {
+      auto timestamp = timestamps[row];
       auto stamp_set = std::make_shared<StampSet>();
-      auto addr = record.get(sink_from_key);
+      auto addr = record.get(sink_from_key_hash);
       stamp_set->insert(addr);
       stamp_sets.insert(std::make_pair(timestamp, stamp_set));
-      processing_records[addr] = &record;
-    } else if (record.get(column_type) == Copy) {
+      processing_records[addr] = row;
+    } else if (types[row] == Copy) {
       auto condition =
-        [&stamp_sets, &copy_to_key, &record, &column_timestamp](const Record & x) {
-          auto timestamp = x.get(column_timestamp);
-          std::shared_ptr<StampSet> stamp_set = stamp_sets[timestamp];
-          bool has_same_source_addrs = stamp_set->count(record.get(copy_to_key)) > 0;
+        [&stamp_sets, &timestamps, &record, copy_to_key_hash](size_t processing_row) {
+          std::shared_ptr<StampSet> stamp_set = stamp_sets[timestamps[processing_row]];
+          bool has_same_source_addrs = stamp_set->count(record.get(copy_to_key_hash)) > 0;
           return has_same_source_addrs;
         };
       for (auto & processing_record_pair : processing_records) {
-        auto & processing_record = *processing_record_pair.second;
-        if (!condition(processing_record)) {
+        auto processing_row = processing_record_pair.second;
+        if (!condition(processing_row)) {
           continue;
         }
-        auto timestamp = processing_record.get(column_timestamp);
-        std::shared_ptr<StampSet> stamp_set = stamp_sets[timestamp];
-        stamp_set->insert(record.get(copy_from_key));
-        merge_processing_record_keys(processing_record);
+        std::shared_ptr<StampSet> stamp_set = stamp_sets[timestamps[processing_row]];
+        stamp_set->insert(record.get(copy_from_key_hash));
+        merge_processing_record_keys(processing_row);
         // No need for subsequent loops since we integrated them.
         break;
       }
-    } else if (record.get(column_type) == Source) {
+    } else if (types[row] == Source) {
       auto condition =
-        [&stamp_sets, &source_key, &record, &column_timestamp](const Record & x) {
-          auto timestamp = x.get(column_timestamp);
-          std::shared_ptr<StampSet> stamp_set = stamp_sets[timestamp];
-          bool has_same_source_addrs = stamp_set->count(record.get(source_key)) > 0;
+        [&stamp_sets, &timestamps, &record, source_key_hash](size_t processing_row) {
+          std::shared_ptr<StampSet> stamp_set = stamp_sets[timestamps[processing_row]];
+          bool has_same_source_addrs = stamp_set->count(record.get(source_key_hash)) > 0;
           return has_same_source_addrs;
         };
       std::vector<uint64_t> merged_addrs;
 
       for (auto & processing_record_pair : processing_records) {
-        auto & processing_record = *processing_record_pair.second;
-        if (!condition(processing_record)) {
+        auto processing_row = processing_record_pair.second;
+        if (!condition(processing_row)) {
           continue;
         }
 
-        processing_record.merge(record);
-        merged_records->append(processing_record);
+        Record merged_record(*records[processing_row], merged_records->get_record_allocator());
+        merged_record.merge(record);
+        merged_record.drop_columns(dropped_columns);
+        merged_records->append(std::move(merged_record));
         merged_addrs.emplace_back(processing_record_pair.first);
       }
       for (auto & merged_addr : merged_addrs) {
@@ -728,12 +1558,11 @@ std::unique_ptr<RecordsBase> RecordsBase::merge_sequential_for_addr_track(
     }
   }
 
-  // Delete temporal columns
-  merged_records->drop_columns(
-  {
-    column_type, column_timestamp, sink_from_key, copy_from_key, copy_to_key, copy_stamp_key});
+  if (merge_cache.is_enabled()) {
+    merge_cache.store(cache_key, *merged_records);
+  }
 
-  return merged_records;
+  return scope.set_output(std::move(merged_records));
 }
 
 std::size_t RecordsBase::size() const
@@ -773,14 +1602,29 @@ void RecordsBase::append_column(const std::string column, const std::vector<uint
     throw std::exception();
   }
 
+  if (column == sorted_column_) {
+    set_sorted_column("");
+  }
+
   columns_.push_back(column);
+  auto column_hash = ColumnManager::get_instance().get_hash(column);
+  indexes_.erase(column_hash);
+  if (encoded_columns_.count(column_hash) > 0) {
+    are_encoded_columns_valid_.invalidate();
+  }
+  if (packed_columns_.count(column_hash) > 0) {
+    are_packed_columns_valid_.invalidate();
+  }
+  ColumnStats stats;
   auto it = begin();
   auto it_val = values.begin();
   for (; it->has_next(); it->next(), ++it_val) {
     auto & record = it->get_record();
     auto & value = *it_val;
-    record.add(column, value);
+    record.add(column_hash, value);
+    stats.update(value);
   }
+  column_stats_[column_hash] = stats;
 }
 
 void RecordsBase::append(const Record & record)
@@ -789,6 +1633,35 @@ void RecordsBase::append(const Record & record)
   throw std::exception();
 }
 
+void RecordsBase::append(Record && record)
+{
+  append(static_cast<const Record &>(record));
+}
+
+void RecordsBase::append(std::vector<Record> && records)
+{
+  reserve(size() + records.size());
+  for (auto & record : records) {
+    append(std::move(record));
+  }
+  records.clear();
+}
+
+void RecordsBase::reserve(size_t size)
+{
+  (void) size;
+}
+
+void RecordsBase::shrink_to_fit()
+{
+}
+
+std::vector<Record> RecordsBase::release_data()
+{
+  throw std::exception();
+  return std::vector<Record>();
+}
+
 std::vector<std::unordered_map<std::string, uint64_t>> RecordsBase::get_named_data() const
 {
   std::vector<std::unordered_map<std::string, uint64_t>> data;
@@ -800,11 +1673,193 @@ std::vector<std::unordered_map<std::string, uint64_t>> RecordsBase::get_named_da
       auto value = record.get(column);
       record_tmp[column] = value;
     }
-    data.emplace_back(record_tmp);
+    data.emplace_back(std::move(record_tmp));
   }
   return data;
 }
 
+void RecordsBase::to_csv(std::string path, std::vector<std::string> columns) const
+{
+  if (columns.size() == 0) {
+    columns = get_columns();
+  }
+
+  std::ofstream ofs(path, std::ios::binary);
+  if (!ofs) {
+    std::cerr << "Failed to open " << path << std::endl;
+    throw std::exception();
+  }
+
+  auto & column_manager = ColumnManager::get_instance();
+  std::vector<size_t> hashes;
+  for (size_t i = 0; i < columns.size(); i++) {
+    if (i > 0) {
+      ofs << ",";
+    }
+    ofs << columns[i];
+    hashes.push_back(column_manager.get_hash(columns[i]));
+  }
+  ofs << "\n";
+
+  std::vector<const Record *> records;
+  records.reserve(size());
+  for (auto it = cbegin(); it->has_next(); it->next()) {
+    records.push_back(&it->get_record());
+  }
+
+  // Format a bounded batch of rows at a time so that the whole table
+  // is never held as text in memory.
+  const size_t rows_per_chunk = 1 << 16;
+  auto chunk_count = get_parallel_chunk_count(records.size(), rows_per_chunk);
+  auto batch_size = chunk_count * rows_per_chunk;
+  std::vector<std::string> buffers(chunk_count);
+
+  for (size_t offset = 0; offset < records.size(); offset += batch_size) {
+    auto batch_end = std::min(records.size(), offset + batch_size);
+    parallel_for_chunks(
+      batch_end - offset, chunk_count,
+      [&records, &hashes, &buffers, offset](size_t begin, size_t end, size_t chunk_index) {
+        auto & buffer = buffers[chunk_index];
+        buffer.clear();
+        char value_str[24];
+        for (size_t i = offset + begin; i < offset + end; i++) {
+          auto & record = *records[i];
+          for (size_t j = 0; j < hashes.size(); j++) {
+            if (j > 0) {
+              buffer.push_back(',');
+            }
+            if (!record.has_column(hashes[j])) {
+              continue;
+            }
+            auto result = std::to_chars(
+              value_str, value_str + sizeof(value_str), record.get(hashes[j]));
+            buffer.append(value_str, result.ptr);
+          }
+          buffer.push_back('\n');
+        }
+      });
+
+    for (auto & buffer : buffers) {
+      ofs.write(buffer.data(), buffer.size());
+    }
+  }
+
+  if (!ofs) {
+    std::cerr << "Failed to write " << path << std::endl;
+    throw std::exception();
+  }
+}
+
+std::unique_ptr<RecordsBase> RecordsBase::from_csv(std::string path)
+{
+  std::ifstream ifs(path, std::ios::binary);
+  if (!ifs) {
+    std::cerr << "Failed to open " << path << std::endl;
+    throw std::exception();
+  }
+
+  std::string data;
+  ifs.seekg(0, std::ios::end);
+  data.resize(ifs.tellg());
+  ifs.seekg(0, std::ios::beg);
+  ifs.read(&data[0], data.size());
+
+  auto find_char = [&data](char c, size_t begin, size_t end) -> size_t {
+      return std::find(data.begin() + begin, data.begin() + end, c) - data.begin();
+    };
+  auto trim_cr = [&data](size_t begin, size_t end) {
+      if (end > begin && data[end - 1] == '\r') {
+        return end - 1;
+      }
+      return end;
+    };
+
+  auto header_end = find_char('\n', 0, data.size());
+  std::vector<std::string> columns;
+  auto line_end = trim_cr(0, header_end);
+  for (size_t pos = 0; pos < line_end; ) {
+    auto field_end = find_char(',', pos, line_end);
+    columns.push_back(data.substr(pos, field_end - pos));
+    pos = field_end + 1;
+  }
+
+  auto & column_manager = ColumnManager::get_instance();
+  std::vector<size_t> hashes;
+  for (auto & column : columns) {
+    hashes.push_back(column_manager.get_hash(column));
+  }
+
+  // Split the body into chunks aligned to line starts and parse each chunk on its own thread.
+  auto body_begin = std::min(header_end + 1, data.size());
+  auto body_size = data.size() - body_begin;
+  auto chunk_count = get_parallel_chunk_count(body_size, 1 << 20);
+  std::vector<size_t> bounds = {body_begin};
+  for (size_t i = 1; i < chunk_count; i++) {
+    auto pos = std::max(bounds.back(), body_begin + i * (body_size / chunk_count));
+    if (pos > body_begin) {
+      pos = std::min(find_char('\n', pos - 1, data.size()) + 1, data.size());
+    }
+    bounds.push_back(pos);
+  }
+  bounds.push_back(data.size());
+
+  std::vector<std::vector<Record>> chunk_records(chunk_count);
+  std::vector<char> failed(chunk_count, false);
+
+  parallel_for_chunks(
+    chunk_count, chunk_count,
+    [&](size_t chunk_begin, size_t chunk_end, size_t) {
+      for (size_t chunk = chunk_begin; chunk < chunk_end; chunk++) {
+        auto end = bounds[chunk + 1];
+        for (size_t pos = bounds[chunk]; pos < end; ) {
+          auto next = find_char('\n', pos, end);
+          auto line_end = trim_cr(pos, next);
+          // An empty line is a record without values, unless it is the end of the file.
+          if (line_end > pos || next < end) {
+            Record record;
+            size_t column_index = 0;
+            for (auto field = pos; field <= line_end; column_index++) {
+              auto field_end = find_char(',', field, line_end);
+              if (field_end > field) {
+                uint64_t value;
+                auto result = std::from_chars(
+                  data.data() + field, data.data() + field_end, value);
+                if (column_index >= hashes.size() || result.ec != std::errc() ||
+                  result.ptr != data.data() + field_end)
+                {
+                  failed[chunk] = true;
+                  return;
+                }
+                record.add(hashes[column_index], value);
+              }
+              field = field_end + 1;
+            }
+            chunk_records[chunk].emplace_back(std::move(record));
+          }
+          pos = next + 1;
+        }
+      }
+    });
+
+  for (size_t chunk = 0; chunk < chunk_count; chunk++) {
+    if (failed[chunk]) {
+      std::cerr << "Failed to parse " << path << std::endl;
+      throw std::exception();
+    }
+  }
+
+  auto records = std::make_unique<RecordsVectorImpl>(columns);
+  size_t record_count = 0;
+  for (auto & records_chunk : chunk_records) {
+    record_count += records_chunk.size();
+  }
+  records->reserve(record_count);
+  for (auto & records_chunk : chunk_records) {
+    records->append(std::move(records_chunk));
+  }
+  return records;
+}
+
 bool RecordsBase::equals(const RecordsBase & other) const
 {
   auto size_equal = size() == other.size();
@@ -846,6 +1901,17 @@ void RecordsBase::drop_columns(std::vector<std::string> column_names)
       return false;
     };
 
+  if (has_key(sorted_column_)) {
+    set_sorted_column("");
+  }
+  auto & column_manager = ColumnManager::get_instance();
+  for (auto & column_name : column_names) {
+    column_stats_.erase(column_manager.get_hash(column_name));
+    indexes_.erase(column_manager.get_hash(column_name));
+    encoded_columns_.erase(column_manager.get_hash(column_name));
+    packed_columns_.erase(column_manager.get_hash(column_name));
+  }
+
   auto columns_tmp = columns_;
   columns_.clear();
   for (auto & column_tmp : columns_tmp) {
@@ -856,6 +1922,440 @@ void RecordsBase::drop_columns(std::vector<std::string> column_names)
   }
 }
 
+std::unique_ptr<RecordsBase> RecordsBase::clip(
+  std::string column, uint64_t t_start, uint64_t t_end) const
+{
+  auto & column_manager = ColumnManager::get_instance();
+  auto column_hash = column_manager.get_hash(column);
+
+  auto clipped_records = std::make_unique<RecordsVectorImpl>(get_columns());
+  if (column == sorted_column_) {
+    clipped_records->set_sorted_column(column);
+  }
+
+  // Prune using the column statistics when the whole input is in or out of range.
+  auto stats = get_column_stats(column);
+  if (stats.count == 0 || t_start > t_end || stats.max < t_start || t_end < stats.min) {
+    return clipped_records;
+  }
+  bool contains_all = stats.count == size() && t_start <= stats.min && stats.max <= t_end;
+
+  // Prune and compare block by block on a packed column.
+  auto packed_column = contains_all ? nullptr : get_packed_column(column_hash);
+  if (packed_column != nullptr) {
+    std::vector<uint64_t> values(PackedColumn::block_size);
+    auto it = cbegin();
+    size_t position = 0;
+    for (size_t block = 0; block < packed_column->get_block_count(); block++) {
+      auto info = packed_column->get_block(block);
+      if (info.max < t_start || t_end < info.min) {
+        for (size_t i = 0; i < info.count; i++) {
+          it->next();
+        }
+        position += info.count;
+        continue;
+      }
+
+      bool contains_block = !info.has_missing && t_start <= info.min && info.max <= t_end;
+      if (!contains_block) {
+        packed_column->decode_block(block, values.data());
+      }
+      for (size_t i = 0; i < info.count; i++, it->next(), position++) {
+        auto value = values[i];
+        if (contains_block ||
+          (t_start <= value && value <= t_end &&
+          (value != UINT64_MAX || packed_column->has_value(position))))
+        {
+          clipped_records->append(it->get_record());
+        }
+      }
+    }
+    return clipped_records;
+  }
+
+  for (auto it = cbegin(); it->has_next(); it->next()) {
+    auto & record = it->get_record();
+    if (contains_all) {
+      clipped_records->append(record);
+      continue;
+    }
+    if (!record.has_column(column_hash)) {
+      continue;
+    }
+    auto value = record.get(column_hash);
+    if (t_start <= value && value <= t_end) {
+      clipped_records->append(record);
+    }
+  }
+  return clipped_records;
+}
+
+std::string RecordsBase::get_sorted_column() const
+{
+  return sorted_column_;
+}
+
+void ColumnStats::update(uint64_t value)
+{
+  if (count > 0) {
+    ascending = ascending && last <= value;
+    descending = descending && last >= value;
+    strict = strict && last != value;
+  }
+  min = std::min(min, value);
+  max = std::max(max, value);
+  last = value;
+  count++;
+}
+
+ColumnStats RecordsBase::get_column_stats(std::string column) const
+{
+  auto column_hash = ColumnManager::get_instance().get_hash(column);
+  {
+    std::lock_guard<std::mutex> lock(column_stats_mutex_);
+    auto it = column_stats_.find(column_hash);
+    if (it != column_stats_.end()) {
+      return it->second;
+    }
+  }
+
+  // Computed without the lock; a reader racing on the same column stores the same result.
+  ColumnStats stats;
+  for (auto it = cbegin(); it->has_next(); it->next()) {
+    auto & record = it->get_record();
+    if (record.has_column(column_hash)) {
+      stats.update(record.get(column_hash));
+    }
+  }
+  std::lock_guard<std::mutex> lock(column_stats_mutex_);
+  column_stats_.emplace(column_hash, stats);
+  return stats;
+}
+
+bool RecordsBase::is_sorted_on(std::string column) const
+{
+  // An empty sorted_column_ means the sorted column is unknown.
+  if (column == "") {
+    return false;
+  }
+  if (column == sorted_column_) {
+    return true;
+  }
+  auto stats = get_column_stats(column);
+  return stats.ascending && stats.count == size();
+}
+
+const Record & RecordsBase::at(size_t index) const
+{
+  (void) index;
+  throw std::exception();
+}
+
+MemoryUsage RecordsBase::memory_usage() const
+{
+  return get_base_memory_usage();
+}
+
+MemoryUsage RecordsBase::get_base_memory_usage() const
+{
+  // Hash table nodes hold a next pointer and the value; buckets are pointers.
+  auto get_hash_table_overhead = [](size_t size, size_t bucket_count) {
+      return size * sizeof(void *) + (bucket_count > 1 ? bucket_count * sizeof(void *) : 0);
+    };
+
+  MemoryUsage usage;
+  usage.column_names = columns_.capacity() * sizeof(std::string) +
+    MemoryUsage::get_string_heap_size(sorted_column_);
+  for (auto & column : columns_) {
+    usage.column_names += MemoryUsage::get_string_heap_size(column);
+  }
+  {
+    std::lock_guard<std::mutex> lock(column_stats_mutex_);
+    usage.container_overhead =
+      column_stats_.size() * sizeof(std::pair<const size_t, ColumnStats>) +
+      get_hash_table_overhead(column_stats_.size(), column_stats_.bucket_count());
+  }
+  usage.indexes = indexes_.size() * sizeof(size_t) +
+    get_hash_table_overhead(indexes_.size(), indexes_.bucket_count());
+  for (auto & pair : indexes_) {
+    usage.indexes += pair.second.memory_usage();
+  }
+  // Rebuild stale encoded and packed columns first, so that no other reader is
+  // rebuilding them while they are measured.
+  if (encoded_columns_.size() > 0) {
+    get_encoded_column(encoded_columns_.begin()->first);
+  }
+  if (packed_columns_.size() > 0) {
+    get_packed_column(packed_columns_.begin()->first);
+  }
+  usage.indexes +=
+    get_hash_table_overhead(encoded_columns_.size(), encoded_columns_.bucket_count());
+  for (auto & pair : encoded_columns_) {
+    usage.indexes += sizeof(size_t) + pair.second.memory_usage();
+  }
+  usage.indexes +=
+    get_hash_table_overhead(packed_columns_.size(), packed_columns_.bucket_count());
+  for (auto & pair : packed_columns_) {
+    usage.indexes += sizeof(size_t) + pair.second.memory_usage();
+  }
+  return usage;
+}
+
+void RecordsBase::set_arena(std::shared_ptr<RecordArena> arena)
+{
+  // Records already appended would be left pointing into the old arena.
+  if (size() > 0) {
+    std::cerr << "The arena must be set before records are appended." << std::endl;
+    throw std::exception();
+  }
+  arena_ = arena;
+}
+
+std::shared_ptr<RecordArena> RecordsBase::get_arena() const
+{
+  return arena_;
+}
+
+Record::AllocatorT RecordsBase::get_record_allocator() const
+{
+  return Record::AllocatorT(arena_.get());
+}
+
+JoinIndex RecordsBase::create_index(std::string column) const
+{
+  JoinIndex index(ColumnManager::get_instance().get_hash(column));
+  size_t position = 0;
+  for (auto it = cbegin(); it->has_next(); it->next()) {
+    index.add(it->get_record(), position++);
+  }
+  return index;
+}
+
+void RecordsBase::build_index(std::string column)
+{
+  auto index = create_index(column);
+  indexes_.erase(index.get_column_hash());
+  indexes_.emplace(index.get_column_hash(), std::move(index));
+}
+
+bool RecordsBase::has_index(std::string column) const
+{
+  return get_index(column) != nullptr;
+}
+
+const JoinIndex * RecordsBase::get_index(std::string column) const
+{
+  if (column == "") {
+    return nullptr;
+  }
+  auto it = indexes_.find(ColumnManager::get_instance().get_hash(column));
+  if (it == indexes_.end()) {
+    return nullptr;
+  }
+  return &it->second;
+}
+
+void RecordsBase::encode_column(std::string column)
+{
+  auto column_hash = ColumnManager::get_instance().get_hash(column);
+  if (encoded_columns_.count(column_hash) > 0) {
+    return;
+  }
+  DictionaryColumn encoded_column(column_hash);
+  if (are_encoded_columns_valid_.is_valid()) {
+    for (auto it = cbegin(); it->has_next(); it->next()) {
+      encoded_column.add(it->get_record());
+    }
+  }
+  encoded_columns_.emplace(column_hash, std::move(encoded_column));
+}
+
+bool RecordsBase::has_encoded_column(std::string column) const
+{
+  return column != "" &&
+         encoded_columns_.count(ColumnManager::get_instance().get_hash(column)) > 0;
+}
+
+const DictionaryColumn * RecordsBase::get_encoded_column(std::string column) const
+{
+  if (column == "") {
+    return nullptr;
+  }
+  return get_encoded_column(ColumnManager::get_instance().get_hash(column));
+}
+
+const DictionaryColumn * RecordsBase::get_encoded_column(size_t column_hash) const
+{
+  auto it = encoded_columns_.find(column_hash);
+  if (it == encoded_columns_.end()) {
+    return nullptr;
+  }
+
+  are_encoded_columns_valid_.ensure(
+    [this]() {
+      for (auto & pair : encoded_columns_) {
+        pair.second.clear_codes();
+      }
+      for (auto record_it = cbegin(); record_it->has_next(); record_it->next()) {
+        for (auto & pair : encoded_columns_) {
+          pair.second.add(record_it->get_record());
+        }
+      }
+    });
+  return &it->second;
+}
+
+void RecordsBase::pack_column(std::string column)
+{
+  auto column_hash = ColumnManager::get_instance().get_hash(column);
+  if (packed_columns_.count(column_hash) > 0) {
+    return;
+  }
+  PackedColumn packed_column(column_hash);
+  if (are_packed_columns_valid_.is_valid()) {
+    for (auto it = cbegin(); it->has_next(); it->next()) {
+      packed_column.add(it->get_record());
+    }
+  }
+  packed_columns_.emplace(column_hash, std::move(packed_column));
+}
+
+bool RecordsBase::has_packed_column(std::string column) const
+{
+  return column != "" &&
+         packed_columns_.count(ColumnManager::get_instance().get_hash(column)) > 0;
+}
+
+const PackedColumn * RecordsBase::get_packed_column(std::string column) const
+{
+  if (column == "") {
+    return nullptr;
+  }
+  return get_packed_column(ColumnManager::get_instance().get_hash(column));
+}
+
+const PackedColumn * RecordsBase::get_packed_column(size_t column_hash) const
+{
+  auto it = packed_columns_.find(column_hash);
+  if (it == packed_columns_.end()) {
+    return nullptr;
+  }
+
+  are_packed_columns_valid_.ensure(
+    [this]() {
+      for (auto & pair : packed_columns_) {
+        pair.second.clear();
+      }
+      for (auto record_it = cbegin(); record_it->has_next(); record_it->next()) {
+        for (auto & pair : packed_columns_) {
+          pair.second.add(record_it->get_record());
+        }
+      }
+    });
+  return &it->second;
+}
+
+bool RecordsBase::groupby_encoded(
+  const std::vector<std::string> & columns,
+  const std::function<RecordsBase *(const Record &)> & get_group_records) const
+{
+  std::vector<const DictionaryColumn *> encoded_columns;
+  for (auto & column : columns) {
+    auto encoded_column = get_encoded_column(column);
+    if (encoded_column == nullptr) {
+      return false;
+    }
+    encoded_columns.push_back(encoded_column);
+  }
+
+  // Codes of all columns combined into one number.
+  uint64_t combined_code_count = 1;
+  for (auto encoded_column : encoded_columns) {
+    auto code_count = encoded_column->get_code_count();
+    if (combined_code_count > UINT64_MAX / code_count) {
+      return false;
+    }
+    combined_code_count *= code_count;
+  }
+  std::vector<uint64_t> combined_codes(size(), 0);
+  uint64_t multiplier = 1;
+  for (auto encoded_column : encoded_columns) {
+    encoded_column->visit_codes(
+      [&combined_codes, multiplier](const auto & codes) {
+        for (size_t i = 0; i < codes.size(); i++) {
+          combined_codes[i] += codes[i] * multiplier;
+        }
+      });
+    multiplier *= encoded_column->get_code_count();
+  }
+
+  // Records of each combined code, looked up in an array when the codes are few.
+  std::vector<RecordsBase *> group_records_by_code;
+  std::unordered_map<uint64_t, RecordsBase *> group_records_map;
+  bool use_array = combined_code_count <= std::max<uint64_t>(size(), 1 << 16);
+  if (use_array) {
+    group_records_by_code.resize(combined_code_count, nullptr);
+  }
+
+  size_t position = 0;
+  for (auto it = cbegin(); it->has_next(); it->next(), position++) {
+    auto & record = it->get_record();
+    auto code = combined_codes[position];
+    auto & group_records = use_array ? group_records_by_code[code] : group_records_map[code];
+    if (group_records == nullptr) {
+      group_records = get_group_records(record);
+    }
+    group_records->append(record);
+  }
+  return true;
+}
+
+void RecordsBase::update_indexes(const Record & record, size_t position)
+{
+  for (auto & pair : indexes_) {
+    pair.second.add(record, position);
+  }
+  if (are_encoded_columns_valid_.is_valid()) {
+    for (auto & pair : encoded_columns_) {
+      pair.second.add(record);
+    }
+  }
+  if (are_packed_columns_valid_.is_valid()) {
+    for (auto & pair : packed_columns_) {
+      pair.second.add(record);
+    }
+  }
+}
+
+void RecordsBase::invalidate_indexes()
+{
+  indexes_.clear();
+  are_encoded_columns_valid_.invalidate();
+  are_packed_columns_valid_.invalidate();
+}
+
+void RecordsBase::update_column_stats(const Record & record)
+{
+  for (auto & pair : column_stats_) {
+    if (record.has_column(pair.first)) {
+      pair.second.update(record.get(pair.first));
+    }
+  }
+}
+
+void RecordsBase::invalidate_column_stats()
+{
+  column_stats_.clear();
+}
+
+void RecordsBase::set_sorted_column(std::string column)
+{
+  sorted_column_ = column;
+  if (column != "") {
+    sorted_column_hash_ = ColumnManager::get_instance().get_hash(column);
+  }
+}
+
 void RecordsBase::filter_if(const std::function<bool(Record)> & f)
 {
   (void) f;
@@ -885,43 +2385,61 @@ void RecordsBase::bind_drop_as_delay()
 std::map<std::tuple<uint64_t>, std::unique_ptr<RecordsBase>> RecordsBase::groupby(
   std::string column0)
 {
+  ProfileScope scope("groupby", size());
   std::map<std::tuple<uint64_t>, std::unique_ptr<RecordsBase>> map;
 
-  for (auto it = begin(); it->has_next(); it->next()) {
-    auto & record = it->get_record();
-    auto key = std::make_tuple(
-      record.get_with_default(column0, UINT64_MAX)
-    );
-    if (map.count(key) == 0) {
-      // cppcheck-suppress stlFindInsert
-      map[key] = std::make_unique<RecordsVectorImpl>(get_columns());
+  auto get_group_records = [&](const Record & record) {
+      auto key = std::make_tuple(
+        record.get_with_default(column0, UINT64_MAX)
+      );
+      auto & records = map[key];
+      if (!records) {
+        records = std::make_unique<RecordsVectorImpl>(get_columns());
+        // Each group has its own arena, so that a group kept alive does not keep
+        // the memory of the others.
+        records->set_arena(std::make_shared<RecordArena>());
+      }
+      return records.get();
+    };
+
+  if (!groupby_encoded({column0}, get_group_records)) {
+    for (auto it = begin(); it->has_next(); it->next()) {
+      auto & record = it->get_record();
+      get_group_records(record)->append(record);
     }
-    auto & records = map[key];
-    records->append(record);
   }
 
+  scope.set_output(*this);
   return map;
 }
 
 std::map<std::tuple<uint64_t, uint64_t>, std::unique_ptr<RecordsBase>> RecordsBase::groupby(
   std::string column0, std::string column1)
 {
+  ProfileScope scope("groupby", size());
   std::map<std::tuple<uint64_t, uint64_t>, std::unique_ptr<RecordsBase>> map;
 
-  for (auto it = begin(); it->has_next(); it->next()) {
-    auto & record = it->get_record();
-    auto key = std::make_tuple(
-      record.get_with_default(column0, UINT64_MAX),
-      record.get_with_default(column1, UINT64_MAX)
-    );
-    if (map.count(key) == 0) {
-      // cppcheck-suppress stlFindInsert
-      map[key] = std::make_unique<RecordsVectorImpl>(get_columns());
+  auto get_group_records = [&](const Record & record) {
+      auto key = std::make_tuple(
+        record.get_with_default(column0, UINT64_MAX),
+        record.get_with_default(column1, UINT64_MAX)
+      );
+      auto & records = map[key];
+      if (!records) {
+        records = std::make_unique<RecordsVectorImpl>(get_columns());
+        records->set_arena(std::make_shared<RecordArena>());
+      }
+      return records.get();
+    };
+
+  if (!groupby_encoded({column0, column1}, get_group_records)) {
+    for (auto it = begin(); it->has_next(); it->next()) {
+      auto & record = it->get_record();
+      get_group_records(record)->append(record);
     }
-    auto & records = map[key];
-    records->append(record);
   }
 
+  scope.set_output(*this);
   return map;
 }
 
@@ -929,29 +2447,38 @@ std::map<std::tuple<uint64_t, uint64_t, uint64_t>,
   std::unique_ptr<RecordsBase>> RecordsBase::groupby(
   std::string column0, std::string column1, std::string column2)
 {
+  ProfileScope scope("groupby", size());
   std::map<std::tuple<uint64_t, uint64_t, uint64_t>, std::unique_ptr<RecordsBase>> map;
 
-  for (auto it = begin(); it->has_next(); it->next()) {
-    auto & record = it->get_record();
-    auto key = std::make_tuple(
-      record.get_with_default(column0, UINT64_MAX),
-      record.get_with_default(column1, UINT64_MAX),
-      record.get_with_default(column2, UINT64_MAX)
-    );
-    if (map.count(key) == 0) {
-      // cppcheck-suppress stlFindInsert
-      map[key] = std::make_unique<RecordsVectorImpl>(get_columns());
+  auto get_group_records = [&](const Record & record) {
+      auto key = std::make_tuple(
+        record.get_with_default(column0, UINT64_MAX),
+        record.get_with_default(column1, UINT64_MAX),
+        record.get_with_default(column2, UINT64_MAX)
+      );
+      auto & records = map[key];
+      if (!records) {
+        records = std::make_unique<RecordsVectorImpl>(get_columns());
+        records->set_arena(std::make_shared<RecordArena>());
+      }
+      return records.get();
+    };
+
+  if (!groupby_encoded({column0, column1, column2}, get_group_records)) {
+    for (auto it = begin(); it->has_next(); it->next()) {
+      auto & record = it->get_record();
+      get_group_records(record)->append(record);
     }
-    auto & records = map[key];
-    records->append(record);
   }
 
+  scope.set_output(*this);
   return map;
 }
 
 void RecordsBase::set_columns(const std::vector<std::string> columns)
 {
   columns_ = columns;
+  invalidate_column_stats();
 }
 
 void RecordsBase::rename_columns(
@@ -969,4 +2496,30 @@ void RecordsBase::rename_columns(
       column = renames[column];
     }
   }
+
+  if (renames.count(sorted_column_) > 0) {
+    set_sorted_column(renames[sorted_column_]);
+  }
+
+  // Encoded and packed columns follow their renamed column and are rebuilt on the
+  // next access.
+  auto & column_manager = ColumnManager::get_instance();
+  std::unordered_map<size_t, DictionaryColumn> encoded_columns;
+  for (auto & pair : encoded_columns_) {
+    auto & column = column_manager.get_column(pair.first);
+    auto column_hash = renames.count(column) > 0 ?
+      column_manager.get_hash(renames[column]) : pair.first;
+    encoded_columns.emplace(column_hash, DictionaryColumn(column_hash));
+  }
+  encoded_columns_ = std::move(encoded_columns);
+  std::unordered_map<size_t, PackedColumn> packed_columns;
+  for (auto & pair : packed_columns_) {
+    auto & column = column_manager.get_column(pair.first);
+    auto column_hash = renames.count(column) > 0 ?
+      column_manager.get_hash(renames[column]) : pair.first;
+    packed_columns.emplace(column_hash, PackedColumn(column_hash));
+  }
+  packed_columns_ = std::move(packed_columns);
+  invalidate_column_stats();
+  invalidate_indexes();
 }
@@ -27,10 +27,12 @@
 #include <tuple>
 #include <utility>
 #include <iterator>
+#include <numeric>
 
 #include "caret_analyze_cpp_impl/record.hpp"
 #include "caret_analyze_cpp_impl/common.hpp"
 #include "caret_analyze_cpp_impl/column_manager.hpp"
+#include "caret_analyze_cpp_impl/profiler.hpp"
 #include "caret_analyze_cpp_impl/records.hpp"
 
 RecordsMapImpl::RecordsMapImpl(
@@ -42,13 +44,15 @@ RecordsMapImpl::RecordsMapImpl(
   data_(std::make_unique<DataT>()),
   key_columns_(key_columns)
 {
-  if (key_columns.size() > max_key_size_) {
-    throw std::exception();
+  auto & column_manager = ColumnManager::get_instance();
+  for (auto & column : key_columns) {
+    key_column_hashes_.push_back(column_manager.get_hash(column));
   }
-
-  for (auto & record : records) {
-    append(record);
+  if (key_columns.size() > 0) {
+    set_sorted_column(key_columns[0]);
   }
+
+  append(std::move(records));
 }
 
 RecordsMapImpl::~RecordsMapImpl()
@@ -84,71 +88,300 @@ RecordsMapImpl::RecordsMapImpl(
 
 void RecordsMapImpl::bind_drop_as_delay()
 {
-  throw std::exception();
+  ProfileScope scope("bind_drop_as_delay", size());
+  TraceScope sort_phase("bind_drop_as_delay/sort");
+  sort_column_order(false, false);
+  sort_phase.end();
+
+  TraceScope fill_phase("bind_drop_as_delay/fill");
+
+  auto & column_manager = ColumnManager::get_instance();
+  std::vector<size_t> hashes;
+  for (auto & column : get_columns()) {
+    hashes.push_back(column_manager.get_hash(column));
+  }
+
+  std::unordered_map<size_t, uint64_t> oldest_values;
+  for (auto & record : *data_) {
+    for (auto hash : hashes) {
+      bool has_value = record.has_column(hash);
+      auto oldest_it = oldest_values.find(hash);
+      if (!has_value && oldest_it != oldest_values.end()) {
+        record.add(hash, oldest_it->second);
+      }
+      if (has_value) {
+        oldest_values[hash] = record.get(hash);
+      }
+    }
+  }
+  fill_phase.end();
+
+  TraceScope resort_phase("bind_drop_as_delay/sort");
+  sort_column_order(true, true);
+  resort_phase.end();
+  scope.set_output(*this);
 }
 
 void RecordsMapImpl::append(const Record & other)
 {
-  auto key = make_key(other);
-  auto pair = std::make_pair(key, other);
-  data_->insert(pair);
+  append(Record(other, get_record_allocator()));
+}
+
+void RecordsMapImpl::append(Record && other)
+{
+  add_key(other);
+  // A record appended in key order to a sorted buffer leaves every position as it is,
+  // so the statistics and indexes are kept up to date as for RecordsVectorImpl.
+  bool is_in_order = is_sorted_.is_valid() &&
+    (data_->size() == 0 || !key_less(data_->size(), data_->size() - 1));
+  if (is_in_order) {
+    update_column_stats(other);
+    update_indexes(other, data_->size());
+  } else {
+    is_sorted_.invalidate();
+    invalidate_column_stats();
+    invalidate_indexes();
+  }
+  data_->emplace_back(std::move(other), get_record_allocator());
+}
+
+void RecordsMapImpl::add_key(const Record & record)
+{
+  for (auto hash : key_column_hashes_) {
+    keys_.push_back(record.get_with_default(hash, key_default_value_) ^ key_mask_);
+  }
 }
 
-RecordsMapImpl::KeyT RecordsMapImpl::make_key(const Record & record)
+namespace
+{
+
+template<size_t N>
+bool fixed_key_less(const uint64_t * a, const uint64_t * b)
 {
-  std::vector<uint64_t> key_values = {0, 0, 0};
-  for (size_t i = 0; i < key_columns_.size(); i++) {
-    auto & column = key_columns_[i];
-    key_values[i] = record.get(column);
+  for (size_t i = 0; i + 1 < N; i++) {
+    if (a[i] != b[i]) {
+      return a[i] < b[i];
+    }
   }
+  return a[N - 1] < b[N - 1];
+}
+
+template<typename LessT>
+std::vector<size_t> get_stable_order(size_t size, LessT less)
+{
+  std::vector<size_t> order(size);
+  std::iota(order.begin(), order.end(), 0);
+  std::stable_sort(order.begin(), order.end(), less);
+  return order;
+}
+
+// Comparisons are specialised for the common key widths so that the loop is unrolled.
+template<size_t N>
+std::vector<size_t> get_stable_order(size_t size, const uint64_t * keys)
+{
+  return get_stable_order(
+    size, [keys](size_t a, size_t b) {
+      return fixed_key_less<N>(keys + a * N, keys + b * N);
+    });
+}
+
+}  // namespace
+
+bool RecordsMapImpl::key_less(size_t a, size_t b) const
+{
+  auto width = key_column_hashes_.size();
+  auto key_a = keys_.data() + a * width;
+  auto key_b = keys_.data() + b * width;
+  return std::lexicographical_compare(key_a, key_a + width, key_b, key_b + width);
+}
 
-  return std::make_tuple(key_values[0], key_values[1], key_values[2]);
+void RecordsMapImpl::sort_by_key() const
+{
+  // Also called from const accessors, which may run on several threads at once.
+  is_sorted_.ensure(
+    [this]() {
+      auto width = key_column_hashes_.size();
+      auto size = data_->size();
+      std::vector<size_t> order;
+      switch (width) {
+        case 1:
+          order = get_stable_order<1>(size, keys_.data());
+          break;
+        case 2:
+          order = get_stable_order<2>(size, keys_.data());
+          break;
+        case 3:
+          order = get_stable_order<3>(size, keys_.data());
+          break;
+        case 4:
+          order = get_stable_order<4>(size, keys_.data());
+          break;
+        default:
+          order = get_stable_order(
+            size, [this](size_t a, size_t b) {
+              return key_less(a, b);
+            });
+          break;
+      }
+
+      DataT sorted_data;
+      std::vector<uint64_t> sorted_keys;
+      sorted_data.reserve(size);
+      sorted_keys.reserve(keys_.size());
+      for (auto i : order) {
+        sorted_data.push_back(std::move((*data_)[i]));
+        sorted_keys.insert(
+          sorted_keys.end(), keys_.begin() + i * width, keys_.begin() + (i + 1) * width);
+      }
+      *data_ = std::move(sorted_data);
+      keys_ = std::move(sorted_keys);
+    });
 }
 
 std::unique_ptr<RecordsBase> RecordsMapImpl::clone() const
 {
-  return std::make_unique<RecordsMapImpl>(*this);
+  ProfileScope scope("clone", size());
+  return scope.set_output(std::make_unique<RecordsMapImpl>(*this));
 }
 
 
 std::vector<Record> RecordsMapImpl::get_data() const
 {
+  ProfileScope scope("get_data", size());
+  scope.set_output(*this);
+  sort_by_key();
+  return std::vector<Record>(data_->begin(), data_->end());
+}
+
+std::vector<Record> RecordsMapImpl::release_data()
+{
+  ProfileScope scope("release_data", size());
+  sort_by_key();
+  // Records leaving an arena are copied to the heap, and the arena is replaced to
+  // free their memory.
   std::vector<Record> data;
+  data.reserve(data_->size());
   for (auto & record : *data_) {
-    data.push_back(record.second);
+    data.emplace_back(std::move(record), Record::AllocatorT());
+  }
+  data_->clear();
+  keys_.clear();
+  invalidate_column_stats();
+  invalidate_indexes();
+  if (get_arena()) {
+    set_arena(std::make_shared<RecordArena>());
   }
   return data;
 }
 
+void RecordsMapImpl::reserve(size_t size)
+{
+  data_->reserve(size);
+  keys_.reserve(size * key_column_hashes_.size());
+}
+
+void RecordsMapImpl::shrink_to_fit()
+{
+  data_->shrink_to_fit();
+  keys_.shrink_to_fit();
+}
+
 void RecordsMapImpl::filter_if(const std::function<bool(Record)> & f)
 {
-  auto tmp = std::make_unique<DataT>();
+  ProfileScope scope("filter_if", size());
+  sort_by_key();
 
-  for (auto it = begin(); it->has_next(); it->next()) {
-    auto & record = it->get_record();
+  auto tmp = std::make_unique<DataT>();
+  std::vector<uint64_t> tmp_keys;
+  auto width = key_column_hashes_.size();
+  for (size_t i = 0; i < data_->size(); i++) {
+    auto & record = (*data_)[i];
     if (f(record)) {
-      auto key = make_key(record);
-      tmp->insert(std::make_pair(key, record));
+      tmp->push_back(std::move(record));
+      tmp_keys.insert(
+        tmp_keys.end(), keys_.begin() + i * width, keys_.begin() + (i + 1) * width);
     }
   }
   data_ = std::move(tmp);
+  keys_ = std::move(tmp_keys);
+  scope.set_output(*this);
+  invalidate_column_stats();
+  invalidate_indexes();
 }
 
-void RecordsMapImpl::sort(std::string key, std::string sub_key, bool ascending)
+void RecordsMapImpl::rekey(
+  const std::vector<std::string> & key_columns,
+  bool ascending,
+  uint64_t default_value)
 {
-  (void) key;
-  (void) sub_key;
-  (void) ascending;
+  // Records tied on the new key keep their order under the current key.
+  sort_by_key();
+
+  auto & column_manager = ColumnManager::get_instance();
+  key_columns_ = key_columns;
+  key_column_hashes_.clear();
+  for (auto & column : key_columns_) {
+    key_column_hashes_.push_back(column_manager.get_hash(column));
+  }
+  // Descending keys are stored inverted so that a single ascending sort serves both orders.
+  key_mask_ = ascending ? 0 : UINT64_MAX;
+  key_default_value_ = default_value;
+
+  keys_.clear();
+  keys_.reserve(data_->size() * key_columns_.size());
+  for (auto & record : *data_) {
+    add_key(record);
+  }
+  is_sorted_.invalidate();
+  sort_by_key();
+}
 
-  throw std::exception();
+void RecordsMapImpl::sort(std::string key, std::string sub_key, bool ascending)
+{
+  ProfileScope scope("sort", size());
+  scope.set_output(*this);
+  std::vector<std::string> key_columns = {key};
+  if (sub_key != "") {
+    key_columns.push_back(sub_key);
+  }
+  // Records without the key are placed at the end.
+  rekey(key_columns, ascending, ascending ? UINT64_MAX : 0);
+  set_sorted_column(ascending ? key : "");
+  invalidate_column_stats();
+  invalidate_indexes();
 }
 
 void RecordsMapImpl::sort_column_order(bool ascending, bool put_none_at_top)
 {
-  (void) ascending;
-  (void) put_none_at_top;
+  uint64_t default_value = ascending == put_none_at_top ? UINT64_MAX : 0;
+  rekey(get_columns(), ascending, default_value);
+  set_sorted_column("");
+  invalidate_column_stats();
+  invalidate_indexes();
+}
+
+const Record & RecordsMapImpl::at(size_t index) const
+{
+  sort_by_key();
+  return data_->at(index);
+}
 
-  throw std::exception();
+MemoryUsage RecordsMapImpl::memory_usage() const
+{
+  auto usage = get_base_memory_usage();
+  usage.container_overhead += sizeof(RecordsMapImpl) + sizeof(DataT);
+  usage.container_overhead += keys_.size() * sizeof(uint64_t) +
+    key_column_hashes_.capacity() * sizeof(size_t);
+  usage.vector_slack += (data_->capacity() - data_->size()) * sizeof(Record) +
+    (keys_.capacity() - keys_.size()) * sizeof(uint64_t);
+  usage.column_names += key_columns_.capacity() * sizeof(std::string);
+  for (auto & column : key_columns_) {
+    usage.column_names += MemoryUsage::get_string_heap_size(column);
+  }
+  for (auto & record : *data_) {
+    usage += record.memory_usage();
+  }
+  return usage;
 }
 
 std::size_t RecordsMapImpl::size() const
@@ -158,19 +391,23 @@ std::size_t RecordsMapImpl::size() const
 
 std::unique_ptr<IteratorBase> RecordsMapImpl::begin()
 {
+  sort_by_key();
   return std::make_unique<MapIterator>(data_->begin(), data_->end());
 }
 std::unique_ptr<ConstIteratorBase> RecordsMapImpl::cbegin() const
 {
+  sort_by_key();
   return std::make_unique<MapConstIterator>(data_->begin(), data_->end());
 }
 
 std::unique_ptr<IteratorBase> RecordsMapImpl::rbegin()
 {
+  sort_by_key();
   return std::make_unique<MapIterator>(data_->rbegin(), data_->rend());
 }
 
 std::unique_ptr<ConstIteratorBase> RecordsMapImpl::crbegin() const
 {
+  sort_by_key();
   return std::make_unique<MapConstIterator>(data_->rbegin(), data_->rend());
 }
@@ -27,6 +27,7 @@
 #include <tuple>
 #include <utility>
 #include <iterator>
+#include <numeric>
 
 #include <yaml-cpp/yaml.h>
 
@@ -34,14 +35,13 @@
 #include "caret_analyze_cpp_impl/record.hpp"
 #include "caret_analyze_cpp_impl/common.hpp"
 #include "caret_analyze_cpp_impl/column_manager.hpp"
+#include "caret_analyze_cpp_impl/profiler.hpp"
 #include "caret_analyze_cpp_impl/records.hpp"
 
 RecordsVectorImpl::RecordsVectorImpl(std::vector<Record> records, std::vector<std::string> columns)
 : RecordsVectorImpl(columns)
 {
-  for (auto & record : records) {
-    append(record);
-  }
+  append(std::move(records));
 }
 
 RecordsVectorImpl::RecordsVectorImpl(std::vector<std::string> columns)
@@ -62,7 +62,12 @@ RecordsVectorImpl::~RecordsVectorImpl()
 RecordsVectorImpl::RecordsVectorImpl(const RecordsVectorImpl & records)
 : RecordsVectorImpl(records.get_columns())
 {
-  for (auto & record : records.get_data()) {
+  set_sorted_column(records.get_sorted_column());
+  if (records.get_arena()) {
+    set_arena(std::make_shared<RecordArena>());
+  }
+  data_->reserve(records.size());
+  for (auto & record : *records.data_) {
     append(record);
   }
 }
@@ -85,61 +90,235 @@ RecordsVectorImpl::RecordsVectorImpl(const File & file)
       auto value = elem.second.as<uint64_t>();
       record.add(key, value);
     }
-    append(record);
+    append(std::move(record));
   }
 }
 
 void RecordsVectorImpl::bind_drop_as_delay()
 {
+  // Each missing value takes the value of the nearest following record in ascending
+  // column order (missing values sorting last). The table is processed as column arrays,
+  // the fill and ordering are computed on row indices, and records are moved only once.
+  ProfileScope scope("bind_drop_as_delay", size());
   auto & column_manager = ColumnManager::get_instance();
-  sort_column_order(false, false);
+  auto columns = get_columns();
+  auto rows = data_->size();
+  auto column_size = columns.size();
 
-  std::unordered_map<size_t, uint64_t> oldest_values;
+  std::vector<size_t> hashes;
+  for (auto & column : columns) {
+    hashes.push_back(column_manager.get_hash(column));
+  }
 
-  for (auto & record : *data_) {
-    for (auto & key : get_columns()) {
-      auto hash = column_manager.get_hash(key);
-      bool has_value = record.has_column(key);
-      bool has_value_ = oldest_values.count(hash) > 0;
-      if (!has_value && has_value_) {
-        record.add(key, oldest_values[hash]);
+  const uint8_t absent = 0;
+  const uint8_t present = 1;
+  const uint8_t filled = 2;
+  std::vector<std::vector<uint64_t>> values(column_size, std::vector<uint64_t>(rows));
+  std::vector<std::vector<uint8_t>> states(column_size, std::vector<uint8_t>(rows));
+
+  TraceScope load_phase("bind_drop_as_delay/load");
+  auto row_chunk_count = get_parallel_chunk_count(rows, 1 << 14);
+  parallel_for_chunks(
+    rows, row_chunk_count, [&](size_t begin, size_t end, size_t) {
+      for (size_t row = begin; row < end; row++) {
+        auto & record = (*data_)[row];
+        for (size_t i = 0; i < column_size; i++) {
+          bool has_value = record.has_column(hashes[i]);
+          values[i][row] = has_value ? record.get(hashes[i]) : UINT64_MAX;
+          states[i][row] = has_value ? present : absent;
+        }
+      }
+    });
+  load_phase.end();
+
+  auto row_less = [&values](size_t a, size_t b) {
+      for (auto & column_values : values) {
+        if (column_values[a] != column_values[b]) {
+          return column_values[a] < column_values[b];
+        }
       }
-      if (has_value) {
-        oldest_values[hash] = record.get(key);
+      return false;
+    };
+
+  TraceScope sort_phase("bind_drop_as_delay/sort");
+  std::vector<size_t> order(rows);
+  std::iota(order.begin(), order.end(), 0);
+  std::sort(order.begin(), order.end(), row_less);
+  sort_phase.end();
+
+  TraceScope fill_phase("bind_drop_as_delay/fill");
+  std::vector<uint8_t> column_filled(column_size);
+  auto column_chunk_count = std::min(
+    column_size, get_parallel_chunk_count(rows * column_size, 1 << 16));
+  parallel_for_chunks(
+    column_size, column_chunk_count, [&](size_t begin, size_t end, size_t) {
+      for (size_t i = begin; i < end; i++) {
+        auto & column_values = values[i];
+        auto & column_states = states[i];
+        bool has_next = false;
+        uint64_t next_value = 0;
+        for (auto it = order.rbegin(); it != order.rend(); ++it) {
+          if (column_states[*it] == present) {
+            has_next = true;
+            next_value = column_values[*it];
+          } else if (has_next) {
+            column_values[*it] = next_value;
+            column_states[*it] = filled;
+            column_filled[i] = true;
+          }
+        }
       }
+    });
+  fill_phase.end();
+
+  bool has_filled = std::any_of(
+    column_filled.begin(), column_filled.end(), [](uint8_t x) {return x;});
+  if (has_filled) {
+    // The first column is never filled, because its missing values sort last.
+    // Records thus only move within runs of equal first column values, and only
+    // runs holding a filled value are sorted again.
+    TraceScope resort_phase("bind_drop_as_delay/sort");
+    auto is_filled = [&states, column_size](size_t row) {
+        for (size_t i = 1; i < column_size; i++) {
+          if (states[i][row] == filled) {
+            return true;
+          }
+        }
+        return false;
+      };
+    auto & first_values = values[0];
+    for (size_t begin = 0; begin < rows; ) {
+      auto end = begin + 1;
+      bool has_filled_row = is_filled(order[begin]);
+      while (end < rows && first_values[order[end]] == first_values[order[begin]]) {
+        has_filled_row = has_filled_row || is_filled(order[end]);
+        end++;
+      }
+      if (has_filled_row) {
+        std::sort(order.begin() + begin, order.begin() + end, row_less);
+      }
+      begin = end;
     }
+    resort_phase.end();
+
+    TraceScope store_phase("bind_drop_as_delay/store");
+    parallel_for_chunks(
+      rows, row_chunk_count, [&](size_t begin, size_t end, size_t) {
+        for (size_t row = begin; row < end; row++) {
+          auto & record = (*data_)[row];
+          for (size_t i = 0; i < column_size; i++) {
+            if (states[i][row] == filled) {
+              record.add(hashes[i], values[i][row]);
+            }
+          }
+        }
+      });
   }
 
-  sort_column_order(true, true);
+  TraceScope move_phase("bind_drop_as_delay/move");
+  DataT sorted_data;
+  sorted_data.reserve(rows);
+  for (auto row : order) {
+    sorted_data.push_back(std::move((*data_)[row]));
+  }
+  *data_ = std::move(sorted_data);
+  move_phase.end();
+
+  set_sorted_column("");
+  invalidate_column_stats();
+  invalidate_indexes();
+  scope.set_output(*this);
 }
 
 void RecordsVectorImpl::append(const Record & other)
 {
-  data_->emplace_back(other);
+  append(Record(other, get_record_allocator()));
+}
+
+void RecordsVectorImpl::append(Record && other)
+{
+  if (sorted_column_ != "") {
+    if (!other.has_column(sorted_column_hash_) ||
+      (data_->size() > 0 && other.get(sorted_column_hash_) < data_->back().get(sorted_column_hash_)))
+    {
+      set_sorted_column("");
+    }
+  }
+  update_column_stats(other);
+  update_indexes(other, data_->size());
+  data_->emplace_back(std::move(other), get_record_allocator());
+}
+
+const Record & RecordsVectorImpl::at(size_t index) const
+{
+  return data_->at(index);
+}
+
+MemoryUsage RecordsVectorImpl::memory_usage() const
+{
+  auto usage = get_base_memory_usage();
+  usage.container_overhead += sizeof(RecordsVectorImpl) + sizeof(DataT);
+  usage.vector_slack += (data_->capacity() - data_->size()) * sizeof(Record);
+  for (auto & record : *data_) {
+    usage += record.memory_usage();
+  }
+  return usage;
+}
+
+void RecordsVectorImpl::reserve(size_t size)
+{
+  data_->reserve(size);
+}
+
+void RecordsVectorImpl::shrink_to_fit()
+{
+  data_->shrink_to_fit();
 }
 
 std::unique_ptr<RecordsBase> RecordsVectorImpl::clone() const
 {
-  return std::make_unique<RecordsVectorImpl>(*this);
+  ProfileScope scope("clone", size());
+  return scope.set_output(std::make_unique<RecordsVectorImpl>(*this));
 }
 
 
 std::vector<Record> RecordsVectorImpl::get_data() const
 {
-  return *data_;
+  ProfileScope scope("get_data", size());
+  scope.set_output(*this);
+  return std::vector<Record>(data_->begin(), data_->end());
 }
 
-template<typename Cont, typename Pred>
-Cont filter(const Cont & container, Pred predicate)
+std::vector<Record> RecordsVectorImpl::release_data()
 {
-  Cont result;
-  std::copy_if(container.begin(), container.end(), std::back_inserter(result), predicate);
-  return result;
+  ProfileScope scope("release_data", size());
+  // Records leaving an arena are copied to the heap, and the arena is replaced to
+  // free their memory.
+  std::vector<Record> data;
+  data.reserve(data_->size());
+  for (auto & record : *data_) {
+    data.emplace_back(std::move(record), Record::AllocatorT());
+  }
+  data_->clear();
+  invalidate_column_stats();
+  invalidate_indexes();
+  if (get_arena()) {
+    set_arena(std::make_shared<RecordArena>());
+  }
+  return data;
 }
 
 void RecordsVectorImpl::filter_if(const std::function<bool(Record)> & f)
 {
-  *data_ = filter(*data_, f);
+  ProfileScope scope("filter_if", size());
+  // Filtered in place, so records stay in the arena they were allocated from.
+  data_->erase(
+    std::remove_if(
+      data_->begin(), data_->end(), [&f](const Record & record) {return !f(record);}),
+    data_->end());
+  scope.set_output(*this);
+  invalidate_column_stats();
+  invalidate_indexes();
 }
 
 class RecordComp
@@ -173,7 +352,44 @@ private:
 
 void RecordsVectorImpl::sort(std::string key, std::string sub_key, bool ascending)
 {
-  std::sort(data_->begin(), data_->end(), RecordComp{key, sub_key, ascending});
+  ProfileScope scope("sort", size());
+  scope.set_output(*this);
+  // Skip sorting when the statistics show the records are already in order.
+  auto stats = get_column_stats(key);
+  bool is_sorted = stats.count == size() &&
+    (ascending ? stats.ascending : stats.descending) &&
+    (sub_key == "" || stats.strict);
+  if (!is_sorted) {
+    std::sort(data_->begin(), data_->end(), RecordComp{key, sub_key, ascending});
+    invalidate_column_stats();
+    invalidate_indexes();
+  }
+  set_sorted_column(ascending ? key : "");
+}
+
+std::unique_ptr<RecordsBase> RecordsVectorImpl::clip(
+  std::string column, uint64_t t_start, uint64_t t_end) const
+{
+  if (!is_sorted_on(column)) {
+    return RecordsBase::clip(column, t_start, t_end);
+  }
+
+  auto column_hash = ColumnManager::get_instance().get_hash(column);
+  auto first = std::lower_bound(
+    data_->begin(), data_->end(), t_start,
+    [column_hash](const Record & record, uint64_t value) {
+      return record.get(column_hash) < value;
+    });
+  auto last = std::upper_bound(
+    first, data_->end(), t_end,
+    [column_hash](uint64_t value, const Record & record) {
+      return value < record.get(column_hash);
+    });
+
+  auto clipped_records = std::make_unique<RecordsVectorImpl>(get_columns());
+  clipped_records->data_->assign(first, last);
+  clipped_records->set_sorted_column(column);
+  return clipped_records;
 }
 
 class RecordCompColumnOrder
@@ -236,6 +452,9 @@ private:
 
 void RecordsVectorImpl::sort_column_order(bool ascending, bool put_none_at_top)
 {
+  set_sorted_column("");
+  invalidate_column_stats();
+  invalidate_indexes();
   std::sort(
     data_->begin(),
     data_->end(), RecordCompColumnOrder{get_columns(), ascending, put_none_at_top});
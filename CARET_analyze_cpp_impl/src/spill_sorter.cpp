@@ -0,0 +1,327 @@
+// Copyright 2021 Research Institute of Systems Planning, Inc.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include <unistd.h>
+
+#include <algorithm>
+#include <atomic>
+#include <cstdio>
+#include <filesystem>
+#include <fstream>
+#include <iostream>
+#include <memory>
+#include <numeric>
+#include <string>
+#include <tuple>
+#include <vector>
+
+#include "caret_analyze_cpp_impl/spill_sorter.hpp"
+
+// Rough heap footprint of a single record field (hash node and bucket).
+const size_t record_field_bytes = 40;
+const size_t run_buffer_size = 1 << 16;
+
+OutOfCoreConfig & OutOfCoreConfig::get_instance()
+{
+  static OutOfCoreConfig instance;
+  return instance;
+}
+
+void OutOfCoreConfig::enable(size_t memory_budget, std::string spill_dir)
+{
+  if (memory_budget < min_memory_budget) {
+    std::cerr << "The memory budget must be at least " << min_memory_budget << " bytes." <<
+      std::endl;
+    throw std::exception();
+  }
+
+  std::error_code ec;
+  std::filesystem::create_directories(spill_dir, ec);
+  if (ec) {
+    std::cerr << "Failed to create " << spill_dir << std::endl;
+    throw std::exception();
+  }
+  memory_budget_ = memory_budget;
+  spill_dir_ = spill_dir;
+  enabled_ = true;
+}
+
+void OutOfCoreConfig::disable()
+{
+  enabled_ = false;
+}
+
+bool OutOfCoreConfig::is_enabled() const
+{
+  return enabled_;
+}
+
+size_t OutOfCoreConfig::get_memory_budget() const
+{
+  return memory_budget_;
+}
+
+const std::string & OutOfCoreConfig::get_spill_dir() const
+{
+  return spill_dir_;
+}
+
+SpillSorter::RunReader::RunReader(std::string path)
+: buffer_(run_buffer_size)
+{
+  ifs_.rdbuf()->pubsetbuf(buffer_.data(), buffer_.size());
+  ifs_.open(path, std::ios::binary);
+  if (!ifs_) {
+    std::cerr << "Failed to open " << path << std::endl;
+    throw std::exception();
+  }
+}
+
+bool SpillSorter::RunReader::read(Entry & entry)
+{
+  uint64_t header[5];
+  if (!ifs_.read(reinterpret_cast<char *>(header), sizeof(header))) {
+    return false;
+  }
+  entry.key0 = header[0];
+  entry.key1 = header[1];
+  entry.seq = header[2];
+  entry.tag = header[3];
+  entry.record = Record();
+
+  std::vector<uint64_t> fields(header[4] * 2);
+  ifs_.read(reinterpret_cast<char *>(fields.data()), fields.size() * sizeof(uint64_t));
+  if (!ifs_) {
+    std::cerr << "Failed to read spilled records" << std::endl;
+    throw std::exception();
+  }
+  for (size_t i = 0; i < fields.size(); i += 2) {
+    entry.record.add(static_cast<size_t>(fields[i]), fields[i + 1]);
+  }
+  return true;
+}
+
+SpillSorter::SpillSorter(size_t memory_budget, std::string spill_dir, size_t max_open_runs)
+: memory_budget_(memory_budget), spill_dir_(spill_dir), max_open_runs_(max_open_runs)
+{
+  if (max_open_runs_ < 2) {
+    std::cerr << "At least two runs must be merged at a time." << std::endl;
+    throw std::exception();
+  }
+}
+
+SpillSorter::~SpillSorter()
+{
+  readers_.clear();
+  for (auto & path : run_paths_) {
+    std::remove(path.c_str());
+  }
+}
+
+size_t SpillSorter::get_run_count() const
+{
+  return run_count_;
+}
+
+void SpillSorter::add(uint64_t key0, uint64_t key1, uint64_t tag, Record record)
+{
+  if (reading_) {
+    throw std::exception();
+  }
+
+  size_t field_count = 0;
+  record.for_each(
+    [&field_count](size_t, uint64_t) {
+      field_count++;
+    });
+
+  buffer_.push_back(Entry{key0, key1, seq_++, tag, std::move(record)});
+  buffered_bytes_ += sizeof(Entry) + field_count * record_field_bytes;
+  if (buffered_bytes_ > memory_budget_) {
+    spill();
+  }
+}
+
+void SpillSorter::spill()
+{
+  if (buffer_.size() == 0) {
+    return;
+  }
+
+  order_.resize(buffer_.size());
+  std::iota(order_.begin(), order_.end(), 0);
+  std::sort(
+    order_.begin(), order_.end(), [this](size_t a, size_t b) {
+      auto & x = buffer_[a];
+      auto & y = buffer_[b];
+      return std::tie(x.key0, x.key1, x.seq) < std::tie(y.key0, y.key1, y.seq);
+    });
+
+  auto path = create_run_path();
+  std::vector<char> write_buffer(run_buffer_size);
+  std::ofstream ofs;
+  ofs.rdbuf()->pubsetbuf(write_buffer.data(), write_buffer.size());
+  ofs.open(path, std::ios::binary);
+  run_paths_.push_back(path);
+  run_count_++;
+
+  for (auto index : order_) {
+    write_entry(ofs, buffer_[index]);
+  }
+  ofs.close();
+  if (!ofs) {
+    std::cerr << "Failed to write " << path << std::endl;
+    throw std::exception();
+  }
+
+  buffer_.clear();
+  order_.clear();
+  buffered_bytes_ = 0;
+}
+
+std::string SpillSorter::create_run_path() const
+{
+  static std::atomic<uint64_t> run_id{0};
+  auto file_name = "caret_spill_" + std::to_string(getpid()) + "_" + std::to_string(run_id++) +
+    ".bin";
+  return (std::filesystem::path(spill_dir_) / file_name).string();
+}
+
+void SpillSorter::write_entry(std::ofstream & ofs, const Entry & entry)
+{
+  words_ = {entry.key0, entry.key1, entry.seq, entry.tag, 0};
+  entry.record.for_each(
+    [this](size_t column_hash, uint64_t value) {
+      words_.push_back(column_hash);
+      words_.push_back(value);
+    });
+  words_[4] = (words_.size() - 5) / 2;
+  ofs.write(reinterpret_cast<const char *>(words_.data()), words_.size() * sizeof(uint64_t));
+}
+
+// Merges runs [first, last) into a new run file, removes them and returns the new path.
+// Entries keep their sequence numbers, so later passes still merge stably.
+std::string SpillSorter::merge_runs(size_t first, size_t last)
+{
+  std::vector<std::unique_ptr<RunReader>> readers;
+  std::vector<Entry> heads(last - first);
+  std::priority_queue<HeapItemT, std::vector<HeapItemT>, std::greater<HeapItemT>> heap;
+  for (size_t i = 0; i < heads.size(); i++) {
+    readers.emplace_back(std::make_unique<RunReader>(run_paths_[first + i]));
+    if (readers[i]->read(heads[i])) {
+      heap.emplace(heads[i].key0, heads[i].key1, heads[i].seq, i);
+    }
+  }
+
+  auto path = create_run_path();
+  std::vector<char> write_buffer(run_buffer_size);
+  std::ofstream ofs;
+  ofs.rdbuf()->pubsetbuf(write_buffer.data(), write_buffer.size());
+  ofs.open(path, std::ios::binary);
+  while (!heap.empty()) {
+    auto i = std::get<3>(heap.top());
+    heap.pop();
+    write_entry(ofs, heads[i]);
+    if (readers[i]->read(heads[i])) {
+      heap.emplace(heads[i].key0, heads[i].key1, heads[i].seq, i);
+    }
+  }
+  ofs.close();
+  if (!ofs) {
+    std::remove(path.c_str());
+    std::cerr << "Failed to write " << path << std::endl;
+    throw std::exception();
+  }
+
+  readers.clear();
+  for (size_t i = first; i < last; i++) {
+    std::remove(run_paths_[i].c_str());
+  }
+  return path;
+}
+
+void SpillSorter::start_reading()
+{
+  reading_ = true;
+
+  if (run_paths_.size() == 0) {
+    // Everything fit in the budget; sort in memory.
+    order_.resize(buffer_.size());
+    std::iota(order_.begin(), order_.end(), 0);
+    std::sort(
+      order_.begin(), order_.end(), [this](size_t a, size_t b) {
+        auto & x = buffer_[a];
+        auto & y = buffer_[b];
+        return std::tie(x.key0, x.key1, x.seq) < std::tie(y.key0, y.key1, y.seq);
+      });
+    return;
+  }
+
+  spill();
+  buffer_.shrink_to_fit();
+
+  while (run_paths_.size() > max_open_runs_) {
+    std::vector<std::string> merged_paths;
+    for (size_t first = 0; first < run_paths_.size(); first += max_open_runs_) {
+      auto last = std::min(first + max_open_runs_, run_paths_.size());
+      merged_paths.push_back(last - first == 1 ? run_paths_[first] : merge_runs(first, last));
+    }
+    run_paths_ = std::move(merged_paths);
+  }
+
+  heads_.resize(run_paths_.size());
+  for (size_t i = 0; i < run_paths_.size(); i++) {
+    readers_.emplace_back(std::make_unique<RunReader>(run_paths_[i]));
+    if (readers_[i]->read(heads_[i])) {
+      heap_.emplace(heads_[i].key0, heads_[i].key1, heads_[i].seq, i);
+    }
+  }
+}
+
+bool SpillSorter::next(uint64_t & key0, uint64_t & key1, uint64_t & tag, Record & record)
+{
+  if (!reading_) {
+    start_reading();
+  }
+
+  if (run_paths_.size() == 0) {
+    if (order_pos_ >= order_.size()) {
+      return false;
+    }
+    auto & entry = buffer_[order_[order_pos_++]];
+    key0 = entry.key0;
+    key1 = entry.key1;
+    tag = entry.tag;
+    record = std::move(entry.record);
+    return true;
+  }
+
+  if (heap_.empty()) {
+    return false;
+  }
+
+  auto run_index = std::get<3>(heap_.top());
+  heap_.pop();
+
+  auto & entry = heads_[run_index];
+  key0 = entry.key0;
+  key1 = entry.key1;
+  tag = entry.tag;
+  record = std::move(entry.record);
+
+  if (readers_[run_index]->read(entry)) {
+    heap_.emplace(entry.key0, entry.key1, entry.seq, run_index);
+  }
+  return true;
+}
@@ -0,0 +1,300 @@
+// Copyright 2021 Research Institute of Systems Planning, Inc.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include <algorithm>
+#include <filesystem>
+#include <fstream>
+#include <functional>
+#include <iostream>
+#include <map>
+#include <memory>
+#include <queue>
+#include <random>
+#include <string>
+#include <tuple>
+#include <vector>
+
+#include "caret_analyze_cpp_impl/trace_generator.hpp"
+
+namespace
+{
+
+const uint64_t base_time = 1600000000000000000;
+const uint64_t callback_object_base = 0x10000;
+const uint64_t publisher_handle_base = 0x20000;
+const uint64_t message_base = 0x7f0000000000;
+const uint64_t copied_message_base = 0x7e0000000000;
+const uint64_t received_message_base = 0x7d0000000000;
+const uint64_t message_stride = 0x100;
+
+// Ratio of intra-process messages that are copied into a new buffer before dispatch.
+const double copy_ratio = 0.5;
+
+const std::map<std::string, std::vector<std::string>> record_columns = {
+  {"callback_start", {"callback_start_timestamp", "callback_object", "is_intra_process"}},
+  {"callback_end", {"callback_end_timestamp", "callback_object"}},
+  {"rclcpp_publish",
+    {"rclcpp_publish_timestamp", "publisher_handle", "message", "message_timestamp"}},
+  {"dispatch_subscription_callback",
+    {"dispatch_subscription_callback_timestamp", "callback_object", "message",
+      "source_timestamp", "message_timestamp"}},
+  {"rclcpp_intra_publish",
+    {"rclcpp_intra_publish_timestamp", "publisher_handle", "message", "message_timestamp"}},
+  {"message_construct",
+    {"message_construct_timestamp", "original_message", "constructed_message"}},
+  {"dispatch_intra_process_subscription_callback",
+    {"dispatch_intra_process_subscription_callback_timestamp", "callback_object", "message",
+      "message_timestamp"}},
+};
+
+struct Job
+{
+  uint64_t ready;
+  uint64_t seq;
+  size_t node;
+  bool is_timer;
+  bool is_intra_process;
+  uint64_t message;
+  uint64_t message_timestamp;
+
+  bool operator>(const Job & other) const
+  {
+    return std::tie(ready, seq) > std::tie(other.ready, other.seq);
+  }
+};
+
+uint64_t get_timer_callback(size_t node)
+{
+  return callback_object_base + node * 0x10;
+}
+
+uint64_t get_subscription_callback(size_t node)
+{
+  return callback_object_base + node * 0x10 + 0x8;
+}
+
+}  // namespace
+
+TraceGenerator::TraceGenerator(TraceGeneratorConfig config)
+: config_(config)
+{
+  if (config_.node_count == 0 || config_.executor_count == 0 || config_.address_count == 0 ||
+    config_.rate <= 0.0)
+  {
+    std::cerr << "node_count, executor_count, address_count and rate must be positive."
+              << std::endl;
+    throw std::exception();
+  }
+  for (auto & pair : record_columns) {
+    records_[pair.first] = std::make_unique<RecordsVectorImpl>(pair.second);
+  }
+  generate();
+}
+
+std::vector<std::string> TraceGenerator::get_record_names() const
+{
+  std::vector<std::string> names;
+  for (auto & pair : records_) {
+    names.push_back(pair.first);
+  }
+  return names;
+}
+
+const RecordsBase & TraceGenerator::get_records(std::string name) const
+{
+  auto it = records_.find(name);
+  if (it == records_.end()) {
+    std::cerr << "Unknown trace records: " << name << std::endl;
+    throw std::exception();
+  }
+  return *it->second;
+}
+
+RecordsVectorImpl & TraceGenerator::records(std::string name)
+{
+  return *records_.at(name);
+}
+
+void TraceGenerator::generate()
+{
+  std::mt19937_64 engine(config_.seed);
+  std::uniform_real_distribution<double> probability(0.0, 1.0);
+  auto uniform = [&engine](uint64_t min, uint64_t max) {
+      return min + engine() % (max - min + 1);
+    };
+
+  auto period = std::max<uint64_t>(1, static_cast<uint64_t>(1e9 / config_.rate));
+  auto end_time = base_time + config_.duration;
+
+  auto & callback_start = records("callback_start");
+  auto & callback_end = records("callback_end");
+  auto & rclcpp_publish = records("rclcpp_publish");
+  auto & dispatch = records("dispatch_subscription_callback");
+  auto & intra_publish = records("rclcpp_intra_publish");
+  auto & message_construct = records("message_construct");
+  auto & intra_dispatch = records("dispatch_intra_process_subscription_callback");
+
+  std::priority_queue<Job, std::vector<Job>, std::greater<Job>> jobs;
+  uint64_t seq = 0;
+  for (size_t node = 0; node < config_.node_count; node++) {
+    jobs.push(Job{base_time + uniform(0, period - 1), seq++, node, true, false, 0, 0});
+  }
+
+  std::vector<uint64_t> publish_counts(config_.node_count);
+  std::vector<uint64_t> executor_busy_until(config_.executor_count);
+
+  while (!jobs.empty()) {
+    auto job = jobs.top();
+    jobs.pop();
+
+    auto & busy_until = executor_busy_until[job.node % config_.executor_count];
+    auto start = std::max(job.ready, busy_until);
+    auto callback_duration = uniform(10000, 100000);
+
+    if (job.is_timer) {
+      auto node = job.node;
+      callback_start.append(
+        Record(
+          {{"callback_start_timestamp", start},
+            {"callback_object", get_timer_callback(node)},
+            {"is_intra_process", 0}}));
+
+      auto publish_time = start + callback_duration / 2;
+      auto address_index = node * config_.address_count +
+        publish_counts[node]++ % config_.address_count;
+      auto message = message_base + address_index * message_stride;
+      bool is_intra_process = node % 2 == 0;
+
+      Job subscription{0, 0, (node + 1) % config_.node_count, false, is_intra_process, 0,
+        publish_time};
+      if (is_intra_process) {
+        intra_publish.append(
+          Record(
+            {{"rclcpp_intra_publish_timestamp", publish_time},
+              {"publisher_handle", publisher_handle_base + node * 0x10},
+              {"message", message},
+              {"message_timestamp", publish_time}}));
+        subscription.message = message;
+        if (probability(engine) < copy_ratio) {
+          auto copied_message = copied_message_base + address_index * message_stride;
+          message_construct.append(
+            Record(
+              {{"message_construct_timestamp", publish_time + uniform(1000, 5000)},
+                {"original_message", message},
+                {"constructed_message", copied_message}}));
+          subscription.message = copied_message;
+        }
+        subscription.ready = publish_time + uniform(5000, 20000);
+      } else {
+        rclcpp_publish.append(
+          Record(
+            {{"rclcpp_publish_timestamp", publish_time},
+              {"publisher_handle", publisher_handle_base + node * 0x10},
+              {"message", message},
+              {"message_timestamp", publish_time}}));
+        subscription.message = received_message_base + address_index * message_stride;
+        subscription.ready = publish_time + uniform(50000, 200000);
+      }
+
+      if (probability(engine) >= config_.drop_ratio) {
+        subscription.seq = seq++;
+        jobs.push(subscription);
+      }
+
+      busy_until = start + callback_duration;
+      callback_end.append(
+        Record(
+          {{"callback_end_timestamp", busy_until},
+            {"callback_object", get_timer_callback(node)}}));
+
+      auto next_ready = job.ready + period;
+      if (next_ready < end_time) {
+        jobs.push(Job{next_ready, seq++, node, true, false, 0, 0});
+      }
+    } else {
+      auto callback_object = get_subscription_callback(job.node);
+      if (job.is_intra_process) {
+        intra_dispatch.append(
+          Record(
+            {{"dispatch_intra_process_subscription_callback_timestamp", start},
+              {"callback_object", callback_object},
+              {"message", job.message},
+              {"message_timestamp", job.message_timestamp}}));
+      } else {
+        dispatch.append(
+          Record(
+            {{"dispatch_subscription_callback_timestamp", start},
+              {"callback_object", callback_object},
+              {"message", job.message},
+              {"source_timestamp", job.message_timestamp},
+              {"message_timestamp", job.message_timestamp}}));
+      }
+
+      auto callback_start_time = start + uniform(1000, 5000);
+      callback_start.append(
+        Record(
+          {{"callback_start_timestamp", callback_start_time},
+            {"callback_object", callback_object},
+            {"is_intra_process", job.is_intra_process ? 1u : 0u}}));
+      busy_until = callback_start_time + callback_duration;
+      callback_end.append(
+        Record(
+          {{"callback_end_timestamp", busy_until},
+            {"callback_object", callback_object}}));
+    }
+  }
+
+  // Executors run concurrently, so events are only ordered per executor until sorted here.
+  for (auto & pair : records_) {
+    pair.second->sort(record_columns.at(pair.first)[0]);
+  }
+}
+
+void TraceGenerator::write(std::string dir) const
+{
+  std::error_code ec;
+  std::filesystem::create_directories(dir, ec);
+  if (ec) {
+    std::cerr << "Failed to create " << dir << std::endl;
+    throw std::exception();
+  }
+
+  for (auto & pair : records_) {
+    auto path = (std::filesystem::path(dir) / (pair.first + ".yaml")).string();
+    std::ofstream ofs(path);
+    if (!ofs) {
+      std::cerr << "Failed to open " << path << std::endl;
+      throw std::exception();
+    }
+
+    // Written as whitespace-free JSON flow style, since File reads a single token.
+    auto & columns = record_columns.at(pair.first);
+    ofs << "[";
+    bool is_first_record = true;
+    for (auto & record : pair.second->get_named_data()) {
+      ofs << (is_first_record ? "" : ",") << "{";
+      bool is_first_column = true;
+      for (auto & column : columns) {
+        if (record.count(column) == 0) {
+          continue;
+        }
+        ofs << (is_first_column ? "" : ",") << "\"" << column << "\":" << record.at(column);
+        is_first_column = false;
+      }
+      ofs << "}";
+      is_first_record = false;
+    }
+    ofs << "]\n";
+  }
+}
@@ -0,0 +1,84 @@
+// Copyright 2021 Research Institute of Systems Planning, Inc.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include <iostream>
+#include <string>
+
+#include "caret_analyze_cpp_impl/trace_generator.hpp"
+
+void print_usage(std::string program)
+{
+  std::cerr << "Usage: " << program << " [options] output_dir" << std::endl
+            << "  --nodes N          number of nodes (default: 10)" << std::endl
+            << "  --rate HZ          timer rate of each node (default: 100)" << std::endl
+            << "  --duration SEC     trace length (default: 1)" << std::endl
+            << "  --drop-ratio R     ratio of dropped messages (default: 0)" << std::endl
+            << "  --address-count N  message addresses per publisher (default: 16)" << std::endl
+            << "  --executors N      number of executors (default: 1)" << std::endl
+            << "  --seed N           random seed (default: 0)" << std::endl;
+}
+
+int main(int argc, char ** argvs)
+{
+  TraceGeneratorConfig config;
+  std::string output_dir;
+
+  for (int i = 1; i < argc; i++) {
+    std::string arg = argvs[i];
+    if (arg == "-h" || arg == "--help") {
+      print_usage(argvs[0]);
+      return 0;
+    }
+    if (arg.rfind("--", 0) != 0) {
+      output_dir = arg;
+      continue;
+    }
+    if (i + 1 >= argc) {
+      print_usage(argvs[0]);
+      return 1;
+    }
+    std::string value = argvs[++i];
+    if (arg == "--nodes") {
+      config.node_count = std::stoul(value);
+    } else if (arg == "--rate") {
+      config.rate = std::stod(value);
+    } else if (arg == "--duration") {
+      config.duration = static_cast<uint64_t>(std::stod(value) * 1e9);
+    } else if (arg == "--drop-ratio") {
+      config.drop_ratio = std::stod(value);
+    } else if (arg == "--address-count") {
+      config.address_count = std::stoul(value);
+    } else if (arg == "--executors") {
+      config.executor_count = std::stoul(value);
+    } else if (arg == "--seed") {
+      config.seed = std::stoull(value);
+    } else {
+      std::cerr << "Unknown option: " << arg << std::endl;
+      print_usage(argvs[0]);
+      return 1;
+    }
+  }
+
+  if (output_dir == "") {
+    print_usage(argvs[0]);
+    return 1;
+  }
+
+  TraceGenerator generator(config);
+  generator.write(output_dir);
+  for (auto & name : generator.get_record_names()) {
+    std::cout << name << ": " << generator.get_records(name).size() << std::endl;
+  }
+  return 0;
+}
@@ -0,0 +1,147 @@
+// Copyright 2021 Research Institute of Systems Planning, Inc.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include <unistd.h>
+
+#include <algorithm>
+#include <chrono>
+#include <fstream>
+#include <iomanip>
+#include <iostream>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
+
+#include "caret_analyze_cpp_impl/tracer.hpp"
+
+Tracer & Tracer::get_instance()
+{
+  static Tracer instance;
+  return instance;
+}
+
+void Tracer::enable(std::string path)
+{
+  std::ofstream ofs(path);
+  if (!ofs) {
+    std::cerr << "Failed to open " << path << std::endl;
+    throw std::exception();
+  }
+
+  std::lock_guard<std::mutex> lock(mutex_);
+  path_ = path;
+  start_ = std::chrono::steady_clock::now();
+  enabled_.store(true, std::memory_order_relaxed);
+}
+
+void Tracer::disable()
+{
+  if (!is_enabled()) {
+    return;
+  }
+  enabled_.store(false, std::memory_order_relaxed);
+  flush();
+
+  std::lock_guard<std::mutex> lock(mutex_);
+  for (auto & thread_spans : thread_spans_) {
+    std::lock_guard<std::mutex> thread_lock(thread_spans->mutex);
+    thread_spans->spans.clear();
+  }
+  // Drop the buffers of finished threads.
+  thread_spans_.erase(
+    std::remove_if(
+      thread_spans_.begin(), thread_spans_.end(),
+      [](const std::shared_ptr<ThreadSpans> & thread_spans) {
+        return thread_spans.use_count() == 1;
+      }),
+    thread_spans_.end());
+}
+
+Tracer::ThreadSpans & Tracer::get_thread_spans()
+{
+  thread_local std::shared_ptr<ThreadSpans> thread_spans;
+  if (!thread_spans) {
+    thread_spans = std::make_shared<ThreadSpans>();
+    std::lock_guard<std::mutex> lock(mutex_);
+    thread_spans->thread_id = ++thread_count_;
+    thread_spans_.push_back(thread_spans);
+  }
+  return *thread_spans;
+}
+
+void Tracer::add_span(
+  const char * name, std::chrono::steady_clock::time_point begin,
+  std::chrono::steady_clock::time_point end)
+{
+  auto & thread_spans = get_thread_spans();
+  std::lock_guard<std::mutex> lock(thread_spans.mutex);
+  thread_spans.spans.push_back(Span{name, begin, end});
+}
+
+void Tracer::flush() const
+{
+  std::lock_guard<std::mutex> lock(mutex_);
+  std::ofstream ofs(path_);
+  if (!ofs) {
+    std::cerr << "Failed to open " << path_ << std::endl;
+    throw std::exception();
+  }
+
+  auto to_us = [](std::chrono::steady_clock::duration duration) {
+      return std::chrono::duration<double, std::micro>(duration).count();
+    };
+
+  auto pid = getpid();
+  ofs << std::fixed << std::setprecision(3);
+  ofs << "{\"traceEvents\":[";
+  bool is_first = true;
+  for (auto & thread_spans : thread_spans_) {
+    std::lock_guard<std::mutex> thread_lock(thread_spans->mutex);
+    for (auto & span : thread_spans->spans) {
+      if (span.begin < start_) {
+        continue;
+      }
+      ofs << (is_first ? "\n" : ",\n")
+          << "{\"name\":\"" << span.name << "\",\"ph\":\"X\""
+          << ",\"ts\":" << to_us(span.begin - start_)
+          << ",\"dur\":" << to_us(span.end - span.begin)
+          << ",\"pid\":" << pid << ",\"tid\":" << thread_spans->thread_id << "}";
+      is_first = false;
+    }
+  }
+  ofs << "\n],\"displayTimeUnit\":\"ms\"}\n";
+}
+
+TraceScope::TraceScope(const char * name)
+: name_(name), enabled_(Tracer::get_instance().is_enabled())
+{
+  if (enabled_) {
+    begin_ = std::chrono::steady_clock::now();
+  }
+}
+
+TraceScope::~TraceScope()
+{
+  end();
+}
+
+void TraceScope::end()
+{
+  if (!enabled_) {
+    return;
+  }
+  enabled_ = false;
+  Tracer::get_instance().add_span(name_, begin_, std::chrono::steady_clock::now());
+}
@@ -0,0 +1,75 @@
+// Copyright 2021 Research Institute of Systems Planning, Inc.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+#include <string>
+#include <thread>
+#include <vector>
+
+#include <gtest/gtest.h>
+#include <gmock/gmock.h>
+
+#include "caret_analyze_cpp_impl/column_manager.hpp"
+#include "caret_analyze_cpp_impl/record.hpp"
+
+
+TEST(ColumnManagerTest, test_hash_is_stable)
+{
+  auto & column_manager = ColumnManager::get_instance();
+  auto hash = column_manager.get_hash("column_manager_stable");
+  ASSERT_EQ(column_manager.get_column(hash), "column_manager_stable");
+
+  // Registering many columns grows the tables.
+  for (size_t i = 0; i < 2000; i++) {
+    column_manager.register_column("column_manager_grow_" + std::to_string(i));
+  }
+  ASSERT_EQ(column_manager.get_hash("column_manager_stable"), hash);
+  ASSERT_EQ(column_manager.get_column(hash), "column_manager_stable");
+  auto grown_hash = column_manager.get_hash("column_manager_grow_1999");
+  ASSERT_EQ(column_manager.get_column(grown_hash), "column_manager_grow_1999");
+}
+
+TEST(ColumnManagerTest, test_concurrent_registration)
+{
+  auto & column_manager = ColumnManager::get_instance();
+  const size_t thread_count = 8;
+  // Prime, so that every thread visits every column.
+  const size_t column_count = 1009;
+  std::vector<std::vector<size_t>> hashes(thread_count, std::vector<size_t>(column_count));
+  std::vector<uint8_t> is_valid(thread_count, true);
+
+  std::vector<std::thread> threads;
+  for (size_t t = 0; t < thread_count; t++) {
+    threads.emplace_back(
+      [&, t]() {
+        for (size_t i = 0; i < column_count; i++) {
+          // Threads register the same columns in different orders.
+          auto column = "column_manager_concurrent_" + std::to_string((i * (t + 1)) % column_count);
+          auto hash = column_manager.get_hash(column);
+          Record record;
+          record.add(column, i);
+          if (column_manager.get_column(hash) != column || record.get(hash) != i) {
+            is_valid[t] = false;
+          }
+          hashes[t][(i * (t + 1)) % column_count] = hash;
+        }
+      });
+  }
+  for (auto & thread : threads) {
+    thread.join();
+  }
+
+  for (size_t t = 0; t < thread_count; t++) {
+    ASSERT_TRUE(is_valid[t]);
+    ASSERT_EQ(hashes[t], hashes[0]);
+  }
+}
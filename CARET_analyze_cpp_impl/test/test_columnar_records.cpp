@@ -0,0 +1,117 @@
+// Copyright 2021 Research Institute of Systems Planning, Inc.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include <memory>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include <gtest/gtest.h>
+#include <gmock/gmock.h>
+
+#include "caret_analyze_cpp_impl/records.hpp"
+#include "caret_analyze_cpp_impl/columnar_records.hpp"
+
+// Callback records: increasing stamps, a few threads and callback addresses, and
+// a unique value per record.
+std::unique_ptr<RecordsVectorImpl> create_callback_records(uint64_t size)
+{
+  auto records = std::make_unique<RecordsVectorImpl>(
+    std::vector<std::string>{"stamp", "tid", "callback_object", "value"});
+  for (uint64_t i = 0; i < size; i++) {
+    Record record({{"stamp", 1000000000 + i * 1000}, {"tid", 100 + i % 4}, {"value", i * 37}});
+    if (i % 10 != 0) {
+      record.add("callback_object", 0x7f0000000000 + (i % 100) * 64);
+    }
+    records->append(record);
+  }
+  records->sort("stamp");
+  return records;
+}
+
+TEST(ColumnarRecordsTest, test_to_records)
+{
+  auto records = create_callback_records(1000);
+  ColumnarRecords columnar(*records, {"tid", "callback_object"});
+
+  EXPECT_EQ(columnar.size(), 1000u);
+  EXPECT_EQ(columnar.get_columns(), records->get_columns());
+  EXPECT_TRUE(columnar.is_encoded("tid"));
+  EXPECT_FALSE(columnar.is_encoded("stamp"));
+  EXPECT_FALSE(columnar.has_value(10, "callback_object"));
+  EXPECT_EQ(columnar.get(10, "callback_object"), UINT64_MAX);
+  EXPECT_EQ(columnar.get(11, "callback_object"), 0x7f0000000000u + 11 * 64);
+  EXPECT_EQ(columnar.get(11, "value"), 11u * 37);
+
+  auto restored = columnar.to_records();
+  EXPECT_TRUE(restored->equals(*records));
+  EXPECT_EQ(restored->get_sorted_column(), "stamp");
+}
+
+TEST(ColumnarRecordsTest, test_memory_usage)
+{
+  auto records = create_callback_records(10000);
+  auto records_usage = records->memory_usage().total();
+  ColumnarRecords columnar(*records, {"tid", "callback_object"});
+
+  // Two plain and two one-byte encoded columns take about 18 bytes per record,
+  // against a hash table node per value in records.
+  auto usage = columnar.memory_usage();
+  EXPECT_LT(usage.values, 10000u * 20);
+  EXPECT_LT(usage.total() * 4, records_usage);
+}
+
+TEST(ColumnarRecordsTest, test_packed_column)
+{
+  auto records = create_callback_records(1000);
+  ColumnarRecords columnar(*records, {"tid", "callback_object"}, {"stamp"});
+  EXPECT_TRUE(columnar.is_packed("stamp"));
+  EXPECT_EQ(columnar.get(999, "stamp"), 1000000000u + 999 * 1000);
+  EXPECT_TRUE(columnar.to_records()->equals(*records));
+
+  // Ranges within a block, across blocks, covering everything and covering nothing.
+  std::vector<std::pair<uint64_t, uint64_t>> ranges = {
+    {1000010000, 1000020000}, {1000100500, 1000500500}, {0, UINT64_MAX}, {1, 2}};
+  for (auto & range : ranges) {
+    auto expect = records->clip("stamp", range.first, range.second);
+    auto result = columnar.clip("stamp", range.first, range.second);
+    EXPECT_TRUE(result->equals(*expect)) << range.first;
+    EXPECT_EQ(result->get_sorted_column(), "stamp");
+  }
+
+  auto expect = records->clip("callback_object", 0x7f0000000000, 0x7f0000000100);
+  EXPECT_TRUE(columnar.clip("callback_object", 0x7f0000000000, 0x7f0000000100)->equals(*expect));
+  expect = records->clip("value", 100, 1000);
+  EXPECT_TRUE(columnar.clip("value", 100, 1000)->equals(*expect));
+}
+
+TEST(ColumnarRecordsTest, test_packed_memory_usage)
+{
+  auto records = create_callback_records(10000);
+  ColumnarRecords plain(*records, {"tid", "callback_object"});
+  ColumnarRecords packed(*records, {"tid", "callback_object"}, {"stamp"});
+
+  // Stamps 1000 apart pack into 17 bits per value instead of 64.
+  EXPECT_LT(packed.memory_usage().values + 10000 * 5, plain.memory_usage().values);
+}
+
+TEST(ColumnarRecordsTest, test_unknown_column)
+{
+  auto records = create_callback_records(10);
+  EXPECT_THROW(ColumnarRecords(*records, {"pid"}), std::exception);
+  EXPECT_THROW(ColumnarRecords(*records, {}, {"pid"}), std::exception);
+  EXPECT_THROW(ColumnarRecords(*records, {"stamp"}, {"stamp"}), std::exception);
+  ColumnarRecords columnar(*records, {});
+  EXPECT_THROW(columnar.get(0, "pid"), std::exception);
+}
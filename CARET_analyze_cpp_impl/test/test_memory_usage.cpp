@@ -0,0 +1,270 @@
+// Copyright 2021 Research Institute of Systems Planning, Inc.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include <future>
+#include <memory>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include <gtest/gtest.h>
+#include <gmock/gmock.h>
+
+#include "caret_analyze_cpp_impl/records.hpp"
+#include "caret_analyze_cpp_impl/memory_usage.hpp"
+
+TEST(MemoryUsageTest, test_record)
+{
+  auto & memory_counter = MemoryCounter::get_instance();
+  for (uint64_t column_count : {0, 1, 2, 10, 100}) {
+    auto before = memory_counter.get_current();
+    auto record = std::make_unique<Record>();
+    for (uint64_t i = 0; i < column_count; i++) {
+      record->add("column_" + std::to_string(i), i);
+    }
+    auto allocated = memory_counter.get_current() - before;
+
+    auto usage = record->memory_usage();
+    EXPECT_EQ(usage.values, column_count * 2 * sizeof(uint64_t));
+    EXPECT_EQ(usage.total() - sizeof(Record), allocated);
+  }
+}
+
+TEST(MemoryUsageTest, test_records_vector_impl)
+{
+  auto & memory_counter = MemoryCounter::get_instance();
+  auto before = memory_counter.get_current();
+  auto records = std::make_unique<RecordsVectorImpl>(std::vector<std::string>{"stamp", "value"});
+  for (uint64_t i = 0; i < 100; i++) {
+    records->append(Record({{"stamp", i}, {"value", i * 2}}));
+  }
+  auto allocated = memory_counter.get_current() - before;
+
+  auto usage = records->memory_usage();
+  EXPECT_EQ(usage.values, 100 * 2 * 2 * sizeof(uint64_t));
+  EXPECT_GT(usage.vector_slack, 0u);
+  EXPECT_EQ(usage.indexes, 0u);
+  EXPECT_EQ(
+    usage.values + usage.container_overhead + usage.vector_slack -
+    sizeof(RecordsVectorImpl) - sizeof(RecordsVectorImpl::DataT),
+    allocated);
+
+  records->build_index("stamp");
+  EXPECT_GT(records->memory_usage().indexes, 0u);
+
+  auto total = records->memory_usage().total();
+  records->filter_if([](Record record) {return record.get("stamp") < 10;});
+  EXPECT_LT(records->memory_usage().total(), total);
+}
+
+TEST(MemoryUsageTest, test_records_map_impl)
+{
+  RecordsMapImpl records({"stamp", "value"}, {"stamp"});
+  for (uint64_t i = 0; i < 100; i++) {
+    records.append(Record({{"stamp", 100 - i}, {"value", i}}));
+  }
+
+  auto usage = records.memory_usage();
+  EXPECT_EQ(usage.values, 100 * 2 * 2 * sizeof(uint64_t));
+  // Sort keys are part of the container overhead.
+  EXPECT_GE(usage.container_overhead, 100 * (sizeof(Record) + sizeof(uint64_t)));
+  EXPECT_GT(usage.column_names, 0u);
+}
+
+TEST(MemoryUsageTest, test_column_manager)
+{
+  auto & column_manager = ColumnManager::get_instance();
+  auto usage = column_manager.memory_usage();
+  column_manager.get_hash(std::string(100, 'a'));
+  auto new_usage = column_manager.memory_usage();
+  EXPECT_GE(new_usage.column_names, usage.column_names + 100);
+  EXPECT_GT(new_usage.values, usage.values);
+}
+
+TEST(MemoryUsageTest, test_peak)
+{
+  auto & memory_counter = MemoryCounter::get_instance();
+  memory_counter.reset_peak();
+  auto before = memory_counter.get_current();
+  {
+    RecordsVectorImpl::DataT data(1000);
+    EXPECT_GE(memory_counter.get_peak(), before + 1000 * sizeof(Record));
+  }
+  EXPECT_EQ(memory_counter.get_current(), before);
+  EXPECT_GE(memory_counter.get_peak(), before + 1000 * sizeof(Record));
+
+  memory_counter.reset_peak();
+  EXPECT_EQ(memory_counter.get_peak(), before);
+}
+
+TEST(MemoryUsageTest, test_threads)
+{
+  // Counts batched in other threads are published when the threads exit.
+  auto & memory_counter = MemoryCounter::get_instance();
+  auto before_current = memory_counter.get_current();
+  auto before_total = memory_counter.get_total_allocated();
+  std::vector<RecordsVectorImpl::DataT> kept(4);
+  std::vector<std::thread> threads;
+  for (auto & data : kept) {
+    threads.emplace_back([&data]() {
+        for (size_t i = 0; i < 100; i++) {
+          RecordsVectorImpl::DataT temporary(10);
+        }
+        data.resize(10);
+      });
+  }
+  for (auto & thread : threads) {
+    thread.join();
+  }
+  EXPECT_EQ(memory_counter.get_current() - before_current, 4 * 10 * sizeof(Record));
+  EXPECT_EQ(
+    memory_counter.get_total_allocated() - before_total, 4 * 101 * 10 * sizeof(Record));
+}
+
+TEST(MemoryUsageTest, test_cross_thread_free)
+{
+  // Memory allocated by a thread that has not published yet and freed by another.
+  using ValuesT = std::vector<uint64_t, CountingAllocator<uint64_t>>;
+  auto & memory_counter = MemoryCounter::get_instance();
+  auto before = memory_counter.get_current();
+  memory_counter.reset_peak();
+
+  ValuesT allocated;
+  std::promise<void> allocated_promise;
+  std::promise<void> freed_promise;
+  auto freed_future = freed_promise.get_future();
+  std::thread allocating_thread([&]() {
+      allocated.resize(50 * 1024 / sizeof(uint64_t));
+      allocated_promise.set_value();
+      freed_future.wait();
+    });
+  allocated_promise.get_future().wait();
+  ValuesT().swap(allocated);
+  EXPECT_LE(memory_counter.get_current(), before);
+
+  ValuesT kept;
+  std::thread([&kept]() {kept.resize(1024 / sizeof(uint64_t));}).join();
+  EXPECT_LE(memory_counter.get_current(), before + 1024);
+  EXPECT_LE(memory_counter.get_peak(), before + 1024);
+
+  freed_promise.set_value();
+  allocating_thread.join();
+  EXPECT_EQ(memory_counter.get_current(), before + 1024);
+  EXPECT_LE(memory_counter.get_peak(), before + 1024);
+}
+
+TEST(MemoryUsageTest, test_record_arena)
+{
+  auto & memory_counter = MemoryCounter::get_instance();
+  auto before = memory_counter.get_current();
+  {
+    auto arena = std::make_shared<RecordArena>();
+    RecordsVectorImpl records(std::vector<std::string>{"stamp", "value"});
+    records.set_arena(arena);
+    for (uint64_t i = 0; i < 1000; i++) {
+      records.append(Record({{"stamp", i}, {"value", i * 2}}));
+    }
+    EXPECT_GE(arena->get_used_size(), 1000 * 2 * 2 * sizeof(uint64_t));
+    EXPECT_GE(arena->get_allocated_size(), arena->get_used_size());
+
+    // Records keep their arena alive.
+    arena.reset();
+    auto copied = records.get_data();
+    records.filter_if([](Record record) {return record.get("stamp") < 10;});
+    EXPECT_EQ(records.size(), 10u);
+    EXPECT_EQ(records.at(9).get("value"), 18u);
+    EXPECT_EQ(copied[999].get("value"), 1998u);
+  }
+  EXPECT_EQ(memory_counter.get_current(), before);
+}
+
+TEST(MemoryUsageTest, test_record_arena_threads)
+{
+  // Records sharing an arena grow from worker threads, as in bind_drop_as_delay on
+  // merged records and in groups returned by groupby.
+  auto arena = std::make_shared<RecordArena>();
+  Record::AllocatorT allocator(arena.get());
+  std::vector<size_t> hashes;
+  for (size_t i = 0; i < 20; i++) {
+    hashes.push_back(ColumnManager::get_instance().get_hash("column_" + std::to_string(i)));
+  }
+
+  const size_t thread_count = 8;
+  const size_t record_count = 200;
+  std::vector<std::vector<Record>> records(thread_count);
+  std::vector<std::thread> threads;
+  for (size_t t = 0; t < thread_count; t++) {
+    threads.emplace_back(
+      [&records, &allocator, &hashes, t]() {
+        records[t].reserve(record_count);
+        for (size_t i = 0; i < record_count; i++) {
+          records[t].emplace_back(allocator);
+          for (size_t j = 0; j < hashes.size(); j++) {
+            records[t].back().add(hashes[j], t * record_count + i + j);
+          }
+        }
+      });
+  }
+  for (auto & thread : threads) {
+    thread.join();
+  }
+
+  for (size_t t = 0; t < thread_count; t++) {
+    ASSERT_EQ(records[t].size(), record_count);
+    for (size_t i = 0; i < record_count; i++) {
+      for (size_t j = 0; j < hashes.size(); j++) {
+        EXPECT_EQ(records[t][i].get(hashes[j]), t * record_count + i + j);
+      }
+    }
+  }
+  EXPECT_GE(
+    arena->get_used_size(), thread_count * record_count * hashes.size() * 2 * sizeof(uint64_t));
+}
+
+TEST(MemoryUsageTest, test_merge_uses_arena)
+{
+  RecordsVectorImpl left(std::vector<std::string>{"key", "left_stamp"});
+  RecordsVectorImpl right(std::vector<std::string>{"key", "right_stamp"});
+  for (uint64_t i = 0; i < 10; i++) {
+    left.append(Record({{"key", i}, {"left_stamp", i}}));
+    right.append(Record({{"key", i}, {"right_stamp", i + 1}}));
+  }
+  auto merged = left.merge(right, "key", "key", {"key", "left_stamp", "right_stamp"}, "inner");
+  ASSERT_NE(merged->get_arena(), nullptr);
+  EXPECT_GE(merged->get_arena()->get_used_size(), 10 * 3 * 2 * sizeof(uint64_t));
+
+  auto groups = merged->groupby("key");
+  ASSERT_EQ(groups.size(), 10u);
+  EXPECT_NE(groups.begin()->second->get_arena(), groups.rbegin()->second->get_arena());
+
+  // A group outlives the others and the records it came from.
+  auto group = std::move(groups.begin()->second);
+  groups.clear();
+  merged.reset();
+  EXPECT_EQ(group->at(0).get("right_stamp"), 1u);
+}
+
+TEST(MemoryUsageTest, test_record_size)
+{
+  // The allocator of a record holds a plain arena pointer.
+  EXPECT_EQ(sizeof(Record::AllocatorT), sizeof(void *));
+  EXPECT_LE(sizeof(Record), 64u);
+}
+
+TEST(MemoryUsageTest, test_set_arena_after_append)
+{
+  RecordsVectorImpl records(std::vector<std::string>{"stamp"});
+  records.append(Record({{"stamp", 1}}));
+  EXPECT_THROW(records.set_arena(std::make_shared<RecordArena>()), std::exception);
+}
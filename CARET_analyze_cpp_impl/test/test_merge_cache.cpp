@@ -0,0 +1,106 @@
+// Copyright 2021 Research Institute of Systems Planning, Inc.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include <unistd.h>
+
+#include <algorithm>
+#include <filesystem>
+#include <map>
+#include <string>
+#include <vector>
+
+#include <gtest/gtest.h>
+#include <gmock/gmock.h>
+
+#include "caret_analyze_cpp_impl/records.hpp"
+#include "caret_analyze_cpp_impl/merge_cache.hpp"
+
+
+class MergeCacheTest : public ::testing::Test
+{
+protected:
+  void SetUp() override
+  {
+    // One directory per test and process, so that entries left by other runs are never read.
+    auto test_info = ::testing::UnitTest::GetInstance()->current_test_info();
+    cache_dir_ = ::testing::TempDir() + "merge_cache_" + test_info->name() + "_" +
+      std::to_string(getpid());
+    std::filesystem::remove_all(cache_dir_);
+    MergeCache::get_instance().enable(cache_dir_);
+  }
+
+  void TearDown() override
+  {
+    MergeCache::get_instance().disable();
+    std::filesystem::remove_all(cache_dir_);
+  }
+
+  std::string cache_dir_;
+};
+
+TEST_F(MergeCacheTest, test_key_depends_on_inputs)
+{
+  auto & cache = MergeCache::get_instance();
+  RecordsVectorImpl left(std::vector<std::string>({"stamp"}));
+  left.append(Record({{"stamp", 1}}));
+  RecordsVectorImpl right(std::vector<std::string>({"stamp"}));
+  right.append(Record({{"stamp", 2}}));
+
+  auto key = cache.make_key("merge", {&left, &right}, {"stamp"});
+  ASSERT_EQ(key, cache.make_key("merge", {&left, &right}, {"stamp"}));
+  ASSERT_NE(key, cache.make_key("merge", {&right, &left}, {"stamp"}));
+  ASSERT_NE(key, cache.make_key("merge", {&left, &right}, {"value"}));
+  ASSERT_NE(key, cache.make_key("merge_sequential", {&left, &right}, {"stamp"}));
+}
+
+TEST_F(MergeCacheTest, test_merge_served_from_cache)
+{
+  RecordsVectorImpl left(std::vector<std::string>({"stamp", "value"}));
+  left.append(Record({{"stamp", 1}, {"value", 10}}));
+  left.append(Record({{"stamp", 3}, {"value", 20}}));
+  left.append(Record({{"stamp", 5}}));
+
+  RecordsVectorImpl right(std::vector<std::string>({"stamp_", "value"}));
+  right.append(Record({{"stamp_", 2}, {"value", 10}}));
+  right.append(Record({{"stamp_", 4}, {"value", 30}}));
+
+  auto expected = left.merge(right, "value", "value", {"stamp", "value", "stamp_"}, "outer");
+
+  auto & cache = MergeCache::get_instance();
+  auto key = cache.make_key(
+    "merge", {&left, &right}, {"value", "value", "outer", "stamp", "value", "stamp_"});
+  ASSERT_TRUE(std::filesystem::exists(std::filesystem::path(cache_dir_) / (key + ".bin")));
+  auto cached = cache.load(key);
+  ASSERT_NE(cached, nullptr);
+  ASSERT_TRUE(cached->equals(*expected));
+
+  auto merged = left.merge(right, "value", "value", {"stamp", "value", "stamp_"}, "outer");
+  ASSERT_TRUE(merged->equals(*expected));
+
+  using Row = std::map<std::string, uint64_t>;
+  std::vector<Row> rows;
+  for (auto & record : merged->get_data()) {
+    auto data = record.get_data();
+    rows.push_back(Row(data.begin(), data.end()));
+  }
+  std::sort(rows.begin(), rows.end());
+  std::vector<Row> expected_rows = {
+    {{"stamp", 1}, {"value", 10}, {"stamp_", 2}},
+    {{"stamp", 3}, {"value", 20}},
+    {{"stamp", 5}},
+    {{"stamp_", 4}, {"value", 30}},
+  };
+  std::sort(expected_rows.begin(), expected_rows.end());
+  ASSERT_EQ(rows, expected_rows);
+}
@@ -0,0 +1,133 @@
+// Copyright 2021 Research Institute of Systems Planning, Inc.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include <fstream>
+#include <iterator>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include <gtest/gtest.h>
+#include <gmock/gmock.h>
+
+#include "caret_analyze_cpp_impl/records.hpp"
+#include "caret_analyze_cpp_impl/profiler.hpp"
+#include "caret_analyze_cpp_impl/tracer.hpp"
+
+class ProfilerTest : public ::testing::Test
+{
+protected:
+  void SetUp() override
+  {
+    Profiler::get_instance().reset_stats();
+  }
+
+  void TearDown() override
+  {
+    Profiler::get_instance().disable();
+    Profiler::get_instance().reset_stats();
+  }
+};
+
+RecordsVectorImpl get_records()
+{
+  return RecordsVectorImpl(
+    {
+      Record({{"stamp", 0}, {"value", 1}}),
+      Record({{"stamp", 2}, {"value", 2}}),
+      Record({{"stamp", 1}, {"value", 2}}),
+    },
+    {"stamp", "value"}
+  );
+}
+
+TEST_F(ProfilerTest, test_disabled)
+{
+  auto records = get_records();
+  records.sort("stamp");
+  records.clone();
+  EXPECT_TRUE(Profiler::get_instance().get_stats().empty());
+}
+
+TEST_F(ProfilerTest, test_operations)
+{
+  Profiler::get_instance().enable();
+
+  auto records = get_records();
+  records.sort("stamp");
+  records.sort("value");
+  records.filter_if([](Record record) {return record.get("value") == 2;});
+  auto merged = records.merge(get_records(), "value", "value", {"stamp", "value"}, "inner");
+  records.groupby("value");
+
+  auto stats = Profiler::get_instance().get_stats();
+  EXPECT_EQ(stats["sort"].call_count, 2u);
+  EXPECT_EQ(stats["sort"].rows_in, 6u);
+  EXPECT_EQ(stats["filter_if"].rows_in, 3u);
+  EXPECT_EQ(stats["filter_if"].rows_out, 2u);
+  EXPECT_EQ(stats["merge"].call_count, 1u);
+  EXPECT_EQ(stats["merge"].rows_in, 5u);
+  EXPECT_EQ(stats["merge"].rows_out, merged->size());
+  EXPECT_GT(stats["merge"].bytes_allocated, 0u);
+  EXPECT_EQ(stats["groupby"].rows_out, 2u);
+
+  Profiler::get_instance().reset_stats();
+  EXPECT_TRUE(Profiler::get_instance().get_stats().empty());
+}
+
+TEST_F(ProfilerTest, test_threads)
+{
+  Profiler::get_instance().enable();
+
+  std::vector<std::thread> threads;
+  for (int i = 0; i < 4; i++) {
+    threads.emplace_back(
+      []() {
+        get_records().clone();
+      });
+  }
+  for (auto & thread : threads) {
+    thread.join();
+  }
+
+  auto stats = Profiler::get_instance().get_stats();
+  EXPECT_EQ(stats["clone"].call_count, 4u);
+  EXPECT_EQ(stats["clone"].rows_out, 12u);
+}
+
+TEST_F(ProfilerTest, test_trace)
+{
+  auto path = ::testing::TempDir() + "trace.json";
+  Tracer::get_instance().enable(path);
+  auto records = get_records();
+  records.merge(get_records(), "value", "value", {"stamp", "value"}, "inner");
+  records.bind_drop_as_delay();
+  Tracer::get_instance().disable();
+
+  std::ifstream ifs(path);
+  std::string trace((std::istreambuf_iterator<char>(ifs)), std::istreambuf_iterator<char>());
+  EXPECT_THAT(trace, ::testing::StartsWith("{\"traceEvents\":["));
+  EXPECT_THAT(trace, ::testing::HasSubstr("{\"name\":\"merge\",\"ph\":\"X\""));
+  EXPECT_THAT(trace, ::testing::HasSubstr("{\"name\":\"merge/scan\",\"ph\":\"X\""));
+  EXPECT_THAT(trace, ::testing::HasSubstr("{\"name\":\"bind_drop_as_delay/fill\",\"ph\":\"X\""));
+
+  // Spans are not collected after disable().
+  records.sort("stamp");
+  Tracer::get_instance().enable(path);
+  Tracer::get_instance().disable();
+  std::ifstream empty_ifs(path);
+  std::string empty_trace(
+    (std::istreambuf_iterator<char>(empty_ifs)), std::istreambuf_iterator<char>());
+  EXPECT_THAT(empty_trace, ::testing::Not(::testing::HasSubstr("\"name\"")));
+}
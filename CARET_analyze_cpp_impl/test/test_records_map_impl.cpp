@@ -0,0 +1,203 @@
+// Copyright 2021 Research Institute of Systems Planning, Inc.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include <string>
+#include <thread>
+#include <vector>
+
+#include <gtest/gtest.h>
+#include <gmock/gmock.h>
+
+#include "caret_analyze_cpp_impl/records.hpp"
+
+TEST(RecordsMapImplTest, test_append_out_of_order)
+{
+  RecordsMapImpl records(std::vector<std::string>({"key", "value"}), {"key"});
+  uint64_t keys[] = {3, 1, 2, 1, 3};
+  for (uint64_t i = 0; i < 5; i++) {
+    Record record;
+    record.add("key", keys[i]);
+    record.add("value", i);
+    records.append(record);
+  }
+
+  // Equal keys keep their insertion order.
+  std::vector<uint64_t> expect_values = {1, 3, 2, 0, 4};
+  std::vector<uint64_t> values;
+  for (auto it = records.cbegin(); it->has_next(); it->next()) {
+    values.push_back(it->get_record().get("value"));
+  }
+  EXPECT_EQ(values, expect_values);
+
+  std::vector<uint64_t> reversed_values;
+  for (auto it = records.crbegin(); it->has_next(); it->next()) {
+    reversed_values.push_back(it->get_record().get("value"));
+  }
+  EXPECT_EQ(reversed_values, std::vector<uint64_t>({4, 0, 2, 3, 1}));
+
+  Record record;
+  record.add("key", 0);
+  record.add("value", 5);
+  records.append(record);
+  records.filter_if([](Record record) {return record.get("value") != 3;});
+  auto data = records.get_data();
+  ASSERT_EQ(data.size(), 5u);
+  EXPECT_EQ(data[0].get("value"), 5u);
+  EXPECT_EQ(data[1].get("value"), 1u);
+  EXPECT_EQ(data[2].get("value"), 2u);
+}
+
+TEST(RecordsMapImplTest, test_wide_key)
+{
+  std::vector<std::string> keys = {"k0", "k1", "k2", "k3", "k4"};
+  RecordsMapImpl records(keys, keys);
+  std::vector<std::vector<uint64_t>> rows = {
+    {1, 1, 1, 1, 2}, {1, 1, 1, 1, 1}, {0, 9, 9, 9, 9}, {1, 1, 1, 0, 5},
+  };
+  for (auto & row : rows) {
+    Record record;
+    for (size_t i = 0; i < keys.size(); i++) {
+      record.add(keys[i], row[i]);
+    }
+    records.append(record);
+  }
+  // A record without the last key column sorts after the others with the same prefix.
+  Record record;
+  for (size_t i = 0; i < 4; i++) {
+    record.add(keys[i], 1);
+  }
+  records.append(record);
+
+  std::vector<uint64_t> expect_k4 = {9, 5, 1, 2, UINT64_MAX};
+  std::vector<uint64_t> k4;
+  for (auto it = records.cbegin(); it->has_next(); it->next()) {
+    k4.push_back(it->get_record().get_with_default("k4", UINT64_MAX));
+  }
+  EXPECT_EQ(k4, expect_k4);
+}
+
+TEST(RecordsMapImplTest, test_sort)
+{
+  RecordsMapImpl records(std::vector<std::string>({"a", "b"}), {"a"});
+  std::vector<std::vector<uint64_t>> rows = {{2, 0}, {1, 2}, {3, 1}, {1, 1}};
+  for (auto & row : rows) {
+    Record record;
+    record.add("a", row[0]);
+    record.add("b", row[1]);
+    records.append(record);
+  }
+
+  records.sort("a", "b", false);
+  auto data = records.get_data();
+  std::vector<std::vector<uint64_t>> expect = {{3, 1}, {2, 0}, {1, 2}, {1, 1}};
+  for (size_t i = 0; i < expect.size(); i++) {
+    EXPECT_EQ(data[i].get("a"), expect[i][0]);
+    EXPECT_EQ(data[i].get("b"), expect[i][1]);
+  }
+
+  // Appended records follow the new key.
+  Record record;
+  record.add("a", 2);
+  record.add("b", 5);
+  records.append(record);
+  data = records.get_data();
+  EXPECT_EQ(data[1].get("b"), 5u);
+}
+
+TEST(RecordsMapImplTest, test_sort_keeps_key_order_on_ties)
+{
+  RecordsMapImpl records(std::vector<std::string>({"a", "b"}), {"a"});
+  std::vector<std::vector<uint64_t>> rows = {{3, 0}, {1, 1}, {4, 0}, {2, 1}, {0, 0}};
+  for (auto & row : rows) {
+    Record record;
+    record.add("a", row[0]);
+    record.add("b", row[1]);
+    records.append(record);
+  }
+
+  // Ties on b keep the order on a, not the order of appends.
+  records.sort("b");
+  auto data = records.get_data();
+  std::vector<uint64_t> expect = {0, 3, 4, 1, 2};
+  for (size_t i = 0; i < expect.size(); i++) {
+    EXPECT_EQ(data[i].get("a"), expect[i]) << i;
+  }
+}
+
+TEST(RecordsMapImplTest, test_bind_drop_as_delay)
+{
+  std::vector<std::string> columns = {"a", "b", "c"};
+  RecordsMapImpl records(columns, {"a"});
+  RecordsVectorImpl expect_records(columns);
+  std::vector<std::vector<uint64_t>> rows = {
+    {0, 1, 5}, {3, 4, 6}, {1, 0, 0}, {2, 3, 0}, {7, 0, 0}
+  };
+  for (auto & row : rows) {
+    Record record;
+    for (size_t i = 0; i < columns.size(); i++) {
+      if (row[i] > 0 || i == 0) {
+        record.add(columns[i], row[i]);
+      }
+    }
+    records.append(record);
+    expect_records.append(record);
+  }
+
+  records.bind_drop_as_delay();
+  expect_records.bind_drop_as_delay();
+  auto data = records.get_data();
+  auto expect = expect_records.get_data();
+  ASSERT_EQ(data.size(), expect.size());
+  for (size_t i = 0; i < data.size(); i++) {
+    EXPECT_TRUE(data[i].equals(expect[i]));
+  }
+}
+
+TEST(RecordsMapImplTest, test_concurrent_readers)
+{
+  // Unsorted records with stale encoded and packed columns, shared by several readers.
+  RecordsMapImpl records(std::vector<std::string>({"key", "value"}), {"key"});
+  records.encode_column("value");
+  records.pack_column("key");
+  const uint64_t size = 2000;
+  for (uint64_t i = 0; i < size; i++) {
+    Record record;
+    record.add("key", (i * 7919) % size);
+    record.add("value", i % 10);
+    records.append(record);
+  }
+
+  const size_t thread_count = 8;
+  std::vector<char> ok(thread_count, false);
+  std::vector<std::thread> threads;
+  for (size_t t = 0; t < thread_count; t++) {
+    threads.emplace_back(
+      [&records, &ok, size, t]() {
+        bool is_sorted = true;
+        for (uint64_t i = 0; i < size; i++) {
+          is_sorted = is_sorted && records.at(i).get("key") == i;
+        }
+        ok[t] = is_sorted &&
+        records.get_column_stats("value").count == size &&
+        records.get_encoded_column("value")->size() == size &&
+        records.get_packed_column("key")->size() == size;
+      });
+  }
+  for (auto & thread : threads) {
+    thread.join();
+  }
+  for (size_t t = 0; t < thread_count; t++) {
+    EXPECT_TRUE(ok[t]) << t;
+  }
+}
@@ -12,7 +12,11 @@
 // See the License for the specific language governing permissions and
 // limitations under the License.
 
+#include <algorithm>
+#include <map>
 #include <string>
+#include <thread>
+#include <vector>
 
 #include <gtest/gtest.h>
 #include <gmock/gmock.h>
@@ -84,3 +88,900 @@ TEST_F(RecordsVectorImplTest, test_constructor_file)
   ASSERT_EQ(data[1].get_data().at("key"), (uint64_t) 2);
   ASSERT_EQ(data[1].get_data().at("key_"), (uint64_t) 3);
 }
+
+TEST_F(RecordsVectorImplTest, test_csv_round_trip)
+{
+  RecordsVectorImpl records(std::vector<std::string>({"stamp", "value"}));
+  records.append(Record({{"stamp", 0}, {"value", 1}}));
+  records.append(Record({{"stamp", UINT64_MAX - 1}}));
+  records.append(Record({{"value", 3}}));
+
+  auto path = ::testing::TempDir() + "test_csv_round_trip.csv";
+  records.to_csv(path, {});
+
+  auto loaded = RecordsBase::from_csv(path);
+  ASSERT_EQ(loaded->get_columns(), records.get_columns());
+  ASSERT_TRUE(loaded->equals(records));
+}
+
+TEST_F(RecordsVectorImplTest, test_csv_column_subset)
+{
+  RecordsVectorImpl records(std::vector<std::string>({"stamp", "value"}));
+  records.append(Record({{"stamp", 10}, {"value", 1}}));
+
+  auto path = ::testing::TempDir() + "test_csv_column_subset.csv";
+  records.to_csv(path, {"value"});
+
+  auto loaded = RecordsBase::from_csv(path);
+  auto data = loaded->get_data();
+  ASSERT_EQ(loaded->get_columns(), std::vector<std::string>({"value"}));
+  ASSERT_EQ(data.size(), (size_t) 1);
+  ASSERT_EQ(data[0].get_data().size(), (size_t) 1);
+  ASSERT_EQ(data[0].get("value"), (uint64_t) 1);
+}
+
+TEST_F(RecordsVectorImplTest, test_csv_single_column_missing_value)
+{
+  RecordsVectorImpl records(std::vector<std::string>({"stamp", "value"}));
+  records.append(Record({{"stamp", 10}, {"value", 1}}));
+  records.append(Record({{"stamp", 20}}));
+  records.append(Record({{"stamp", 30}, {"value", 3}}));
+
+  auto path = ::testing::TempDir() + "test_csv_single_column_missing_value.csv";
+  records.to_csv(path, {"value"});
+
+  auto loaded = RecordsBase::from_csv(path);
+  auto data = loaded->get_data();
+  ASSERT_EQ(data.size(), (size_t) 3);
+  ASSERT_EQ(data[0].get("value"), (uint64_t) 1);
+  ASSERT_FALSE(data[1].has_column("value"));
+  ASSERT_EQ(data[2].get("value"), (uint64_t) 3);
+}
+
+TEST_F(RecordsVectorImplTest, test_clip)
+{
+  RecordsVectorImpl records(std::vector<std::string>({"stamp"}));
+  for (uint64_t stamp : {5, 1, 3, 3, 9, 7}) {
+    records.append(Record({{"stamp", stamp}}));
+  }
+  ASSERT_EQ(records.get_sorted_column(), "");
+
+  auto unsorted_clip = records.clip("stamp", 3, 7);
+  ASSERT_EQ(unsorted_clip->size(), (size_t) 4);
+
+  records.sort("stamp", "", true);
+  ASSERT_EQ(records.get_sorted_column(), "stamp");
+
+  auto clipped = records.clip("stamp", 3, 7);
+  auto data = clipped->get_data();
+  ASSERT_EQ(data.size(), (size_t) 4);
+  ASSERT_EQ(data.front().get("stamp"), (uint64_t) 3);
+  ASSERT_EQ(data.back().get("stamp"), (uint64_t) 7);
+  ASSERT_EQ(clipped->get_sorted_column(), "stamp");
+
+  ASSERT_EQ(records.clip("stamp", 10, 20)->size(), (size_t) 0);
+  ASSERT_EQ(records.clip("stamp", 7, 3)->size(), (size_t) 0);
+
+  records.append(Record({{"stamp", 10}}));
+  ASSERT_EQ(records.get_sorted_column(), "stamp");
+  records.append(Record({{"stamp", 2}}));
+  ASSERT_EQ(records.get_sorted_column(), "");
+}
+
+TEST_F(RecordsVectorImplTest, test_merge_sequential_sorted_map_input)
+{
+  // Keyed on a column that is not the first, so a copy iterates in another order.
+  RecordsMapImpl left(
+    std::vector<std::string>({"value", "stamp"}), std::vector<std::string>({"stamp"}));
+  left.append(Record({{"value", 2}, {"stamp", 1}}));
+  left.append(Record({{"value", 1}, {"stamp", 5}}));
+  RecordsVectorImpl right(std::vector<std::string>({"sub_stamp", "sub_value"}));
+  right.append(Record({{"sub_stamp", 2}, {"sub_value", 10}}));
+  right.append(Record({{"sub_stamp", 6}, {"sub_value", 20}}));
+  ASSERT_TRUE(left.is_sorted_on("stamp"));
+  ASSERT_TRUE(right.is_sorted_on("sub_stamp"));
+
+  auto merged = left.merge_sequential(
+    right, "stamp", "sub_stamp", "", "", {"stamp", "value", "sub_stamp", "sub_value"}, "inner");
+  auto data = merged->get_data();
+  ASSERT_EQ(data.size(), (size_t) 2);
+  EXPECT_EQ(data[0].get("stamp"), (uint64_t) 1);
+  EXPECT_EQ(data[0].get("sub_stamp"), (uint64_t) 2);
+  EXPECT_EQ(data[0].get("sub_value"), (uint64_t) 10);
+  EXPECT_EQ(data[1].get("stamp"), (uint64_t) 5);
+  EXPECT_EQ(data[1].get("sub_stamp"), (uint64_t) 6);
+  EXPECT_EQ(data[1].get("sub_value"), (uint64_t) 20);
+}
+
+TEST_F(RecordsVectorImplTest, test_column_stats)
+{
+  RecordsVectorImpl records(std::vector<std::string>({"stamp", "value"}));
+  records.append(Record({{"stamp", 1}, {"value", 5}}));
+  records.append(Record({{"stamp", 2}}));
+
+  auto stats = records.get_column_stats("value");
+  ASSERT_EQ(stats.count, (size_t) 1);
+  ASSERT_FALSE(records.is_sorted_on("value"));
+  ASSERT_TRUE(records.is_sorted_on("stamp"));
+  ASSERT_EQ(records.get_sorted_column(), "");
+  ASSERT_FALSE(records.is_sorted_on(""));
+
+  records.append(Record({{"stamp", 2}, {"value", 3}}));
+  stats = records.get_column_stats("value");
+  ASSERT_EQ(stats.count, (size_t) 2);
+  ASSERT_EQ(stats.min, (uint64_t) 3);
+  ASSERT_EQ(stats.max, (uint64_t) 5);
+  ASSERT_FALSE(stats.ascending);
+  ASSERT_TRUE(stats.descending);
+
+  stats = records.get_column_stats("stamp");
+  ASSERT_TRUE(stats.ascending);
+  ASSERT_FALSE(stats.strict);
+
+  records.append_column("index", {0, 1, 2});
+  stats = records.get_column_stats("index");
+  ASSERT_EQ(stats.count, (size_t) 3);
+  ASSERT_TRUE(stats.strict);
+
+  records.drop_columns({"stamp"});
+  ASSERT_EQ(records.get_column_stats("stamp").count, (size_t) 0);
+}
+
+TEST_F(RecordsVectorImplTest, test_concat_many)
+{
+  std::vector<std::vector<uint64_t>> stamps = {{1, 4, 4}, {2, 4}, {}, {0, 9}};
+  std::vector<std::unique_ptr<RecordsVectorImpl>> inputs;
+  std::vector<const RecordsBase *> input_ptrs;
+  for (size_t i = 0; i < stamps.size(); i++) {
+    inputs.emplace_back(
+      std::make_unique<RecordsVectorImpl>(std::vector<std::string>({"stamp", "input"})));
+    for (auto stamp : stamps[i]) {
+      Record record;
+      record.add("stamp", stamp);
+      record.add("input", i);
+      inputs[i]->append(record);
+    }
+    input_ptrs.push_back(inputs[i].get());
+  }
+
+  auto merged = RecordsBase::concat_many(input_ptrs, "stamp");
+  std::vector<std::pair<uint64_t, uint64_t>> expect = {
+    {0, 3}, {1, 0}, {2, 1}, {4, 0}, {4, 0}, {4, 1}, {9, 3}
+  };
+  auto data = merged->get_data();
+  ASSERT_EQ(data.size(), expect.size());
+  for (size_t i = 0; i < expect.size(); i++) {
+    EXPECT_EQ(data[i].get("stamp"), expect[i].first);
+    EXPECT_EQ(data[i].get("input"), expect[i].second);
+  }
+  EXPECT_TRUE(merged->is_sorted_on("stamp"));
+
+  auto concatenated = RecordsBase::concat_many(input_ptrs, "");
+  data = concatenated->get_data();
+  ASSERT_EQ(data.size(), expect.size());
+  EXPECT_EQ(data[0].get("stamp"), 1u);
+  EXPECT_EQ(data[6].get("stamp"), 9u);
+
+  // Unsorted inputs are sorted stably: ties keep the concatenation order.
+  RecordsVectorImpl unsorted(std::vector<std::string>({"stamp", "input"}));
+  std::vector<std::pair<uint64_t, uint64_t>> unsorted_rows = {
+    {4, 4}, {2, 4}, {4, 5}, {2, 6}, {4, 7}, {1, 8}, {4, 9}, {2, 10}
+  };
+  for (auto & row : unsorted_rows) {
+    unsorted.append(Record({{"stamp", row.first}, {"input", row.second}}));
+  }
+  input_ptrs.push_back(&unsorted);
+  expect.insert(expect.end(), unsorted_rows.begin(), unsorted_rows.end());
+  std::stable_sort(
+    expect.begin(), expect.end(), [](const auto & a, const auto & b) {
+      return a.first < b.first;
+    });
+  auto sorted = RecordsBase::concat_many(input_ptrs, "stamp");
+  data = sorted->get_data();
+  ASSERT_EQ(data.size(), expect.size());
+  for (size_t i = 0; i < expect.size(); i++) {
+    EXPECT_EQ(data[i].get("stamp"), expect[i].first) << i;
+    EXPECT_EQ(data[i].get("input"), expect[i].second) << i;
+  }
+  EXPECT_TRUE(sorted->is_sorted_on("stamp"));
+
+  // Records without the key are put last and the result is not sorted on it.
+  RecordsVectorImpl partial(std::vector<std::string>({"stamp", "value"}));
+  partial.append(Record({{"stamp", 5}}));
+  partial.append(Record({{"value", 1}}));
+  partial.append(Record({{"stamp", 3}}));
+  RecordsMapImpl partial_map({"stamp", "value"}, {"stamp"});
+  partial_map.append(Record({{"stamp", 4}}));
+  partial_map.append(Record({{"value", 2}}));
+  for (auto & partial_inputs : std::vector<std::vector<const RecordsBase *>>{
+      {&partial}, {&partial_map}, {inputs[0].get(), &partial_map}})
+  {
+    auto partial_concat = RecordsBase::concat_many(partial_inputs, "stamp");
+    EXPECT_FALSE(partial_concat->is_sorted_on("stamp"));
+    auto partial_data = partial_concat->get_data();
+    EXPECT_FALSE(partial_data.back().has_column("stamp"));
+    auto clipped = partial_concat->clip("stamp", 0, 100);
+    EXPECT_EQ(clipped->size(), partial_concat->size() - 1);
+  }
+}
+
+TEST_F(RecordsVectorImplTest, test_merge_with_index)
+{
+  std::vector<std::string> left_columns = {"stamp", "key", "left_value"};
+  std::vector<std::string> right_columns = {"sub_stamp", "key", "right_value"};
+  RecordsVectorImpl left(left_columns);
+  RecordsVectorImpl right(right_columns);
+  RecordsVectorImpl indexed_right(right_columns);
+  indexed_right.build_index("key");
+  indexed_right.build_index("sub_stamp");
+  // Records appended to a map in key order keep its indexes too.
+  RecordsMapImpl indexed_map_right(right_columns, {"right_value"});
+  indexed_map_right.build_index("key");
+  indexed_map_right.build_index("sub_stamp");
+
+  // Some records lack the key; the index is kept up to date by append().
+  for (uint64_t i = 0; i < 20; i++) {
+    Record left_record;
+    left_record.add("stamp", (i * 7) % 20);
+    left_record.add("left_value", i);
+    if (i % 5 != 0) {
+      left_record.add("key", i % 4);
+    }
+    left.append(left_record);
+
+    Record right_record;
+    right_record.add("sub_stamp", (i * 3) % 20);
+    right_record.add("right_value", i);
+    if (i % 7 != 0) {
+      right_record.add("key", (i * 5) % 6);
+    }
+    right.append(right_record);
+    indexed_right.append(right_record);
+    indexed_map_right.append(right_record);
+  }
+  EXPECT_TRUE(indexed_right.has_index("key"));
+  EXPECT_FALSE(right.has_index("key"));
+  EXPECT_TRUE(indexed_map_right.has_index("key"));
+  EXPECT_EQ(indexed_map_right.get_column_stats("right_value").max, 19u);
+
+  std::vector<std::string> columns = {"stamp", "key", "left_value", "sub_stamp", "right_value"};
+  for (std::string how : {"inner", "left", "right", "outer"}) {
+    auto expect = left.merge(right, "key", "key", columns, how);
+    auto result = left.merge(indexed_right, "key", "key", columns, how);
+    EXPECT_TRUE(result->equals(*expect)) << how;
+    result = left.merge(indexed_map_right, "key", "key", columns, how);
+    EXPECT_TRUE(result->equals(*expect)) << how;
+  }
+  for (std::string how : {"inner", "left", "right", "outer", "left_use_latest"}) {
+    auto expect = left.merge_sequential(right, "stamp", "sub_stamp", "key", "key", columns, how);
+    auto result = left.merge_sequential(
+      indexed_right, "stamp", "sub_stamp", "key", "key", columns, how);
+    EXPECT_TRUE(result->equals(*expect)) << how;
+    result = left.merge_sequential(
+      indexed_map_right, "stamp", "sub_stamp", "key", "key", columns, how);
+    EXPECT_TRUE(result->equals(*expect)) << how;
+  }
+
+  indexed_map_right.append(Record({{"sub_stamp", 0}, {"key", 1}, {"right_value", 20}}));
+  EXPECT_TRUE(indexed_map_right.has_index("key"));
+  EXPECT_EQ(indexed_map_right.get_column_stats("right_value").max, 20u);
+  indexed_map_right.append(Record({{"sub_stamp", 0}, {"key", 1}, {"right_value", 0}}));
+  EXPECT_FALSE(indexed_map_right.has_index("key"));
+
+  indexed_right.filter_if([](Record) {return true;});
+  EXPECT_FALSE(indexed_right.has_index("key"));
+}
+
+TEST_F(RecordsVectorImplTest, test_merge_composite_key)
+{
+  std::vector<std::string> left_columns = {"stamp", "pid", "tid", "left_value", "left_key"};
+  std::vector<std::string> right_columns = {"sub_stamp", "pid", "tid", "right_value", "right_key"};
+  RecordsVectorImpl left(left_columns);
+  RecordsVectorImpl right(right_columns);
+
+  // left_key and right_key encode (pid, tid) in an order-preserving way.
+  for (uint64_t i = 0; i < 24; i++) {
+    Record left_record;
+    left_record.add("stamp", (i * 5) % 24);
+    left_record.add("left_value", i);
+    left_record.add("pid", i % 3);
+    if (i % 7 != 0) {
+      left_record.add("tid", i % 2);
+      left_record.add("left_key", (i % 3) * 2 + i % 2);
+    }
+    left.append(left_record);
+
+    Record right_record;
+    right_record.add("sub_stamp", (i * 7) % 24);
+    right_record.add("right_value", i);
+    right_record.add("tid", (i / 2) % 2);
+    if (i % 5 != 0) {
+      right_record.add("pid", (i + 1) % 4);
+      right_record.add("right_key", ((i + 1) % 4) * 2 + (i / 2) % 2);
+    }
+    right.append(right_record);
+  }
+
+  std::vector<std::string> columns = {
+    "stamp", "pid", "tid", "left_value", "sub_stamp", "right_value"};
+  for (std::string how : {"inner", "left", "right", "outer"}) {
+    auto expect = left.merge(right, "left_key", "right_key", columns, how);
+    auto result = left.merge(
+      right, std::vector<std::string>({"pid", "tid"}), std::vector<std::string>({"pid", "tid"}),
+      columns, how);
+    EXPECT_TRUE(result->equals(*expect)) << how;
+  }
+  for (std::string how : {"inner", "left", "right", "outer", "left_use_latest"}) {
+    auto expect = left.merge_sequential(
+      right, "stamp", "sub_stamp", "left_key", "right_key", columns, how);
+    auto result = left.merge_sequential(
+      right, "stamp", "sub_stamp", std::vector<std::string>({"pid", "tid"}),
+      std::vector<std::string>({"pid", "tid"}), columns, how);
+    EXPECT_TRUE(result->equals(*expect)) << how;
+  }
+
+  // A UINT64_MAX component is None for merge_sequential() and a value for merge(),
+  // as with a single key.
+  RecordsVectorImpl none_left(std::vector<std::string>({"stamp", "pid", "tid"}));
+  RecordsVectorImpl none_right(std::vector<std::string>({"sub_stamp", "pid", "tid"}));
+  none_left.append(Record({{"stamp", 1}, {"pid", 1}, {"tid", UINT64_MAX}}));
+  none_right.append(Record({{"sub_stamp", 2}, {"pid", 1}, {"tid", UINT64_MAX}}));
+  std::vector<std::string> none_columns = {"stamp", "pid", "tid", "sub_stamp"};
+  std::vector<std::string> pid_tid = {"pid", "tid"};
+  EXPECT_EQ(
+    none_left.merge_sequential(
+      none_right, "stamp", "sub_stamp", "tid", "tid", none_columns, "inner")->size(), 0u);
+  EXPECT_EQ(
+    none_left.merge_sequential(
+      none_right, "stamp", "sub_stamp", pid_tid, pid_tid, none_columns, "inner")->size(), 0u);
+  EXPECT_EQ(
+    none_left.merge_sequential(
+      none_right, "stamp", "sub_stamp", pid_tid, pid_tid, none_columns, "outer")->size(), 2u);
+  EXPECT_EQ(none_left.merge(none_right, "tid", "tid", none_columns, "inner")->size(), 1u);
+  EXPECT_EQ(none_left.merge(none_right, pid_tid, pid_tid, none_columns, "inner")->size(), 1u);
+
+  std::vector<std::string> no_keys;
+  EXPECT_THROW(left.merge(right, no_keys, no_keys, columns, "inner"), std::exception);
+  EXPECT_THROW(
+    left.merge(right, std::vector<std::string>({"pid"}), no_keys, columns, "inner"),
+    std::exception);
+}
+
+TEST_F(RecordsVectorImplTest, test_merge_asof)
+{
+  RecordsVectorImpl left(std::vector<std::string>({"stamp", "key"}));
+  RecordsVectorImpl right(std::vector<std::string>({"sub_stamp", "key", "value"}));
+  std::vector<std::vector<uint64_t>> left_rows = {{10, 0}, {3, 0}, {20, 1}, {7, 1}, {15, 0}};
+  std::vector<std::vector<uint64_t>> right_rows = {
+    {2, 0, 0}, {9, 0, 1}, {12, 0, 2}, {9, 1, 3}, {21, 1, 4}, {9, 0, 5}};
+  for (auto & row : left_rows) {
+    Record record;
+    record.add("stamp", row[0]);
+    record.add("key", row[1]);
+    left.append(record);
+  }
+  for (auto & row : right_rows) {
+    Record record;
+    record.add("sub_stamp", row[0]);
+    record.add("key", row[1]);
+    record.add("value", row[2]);
+    right.append(record);
+  }
+
+  std::vector<std::string> columns = {"stamp", "key", "sub_stamp", "value"};
+  auto get_values = [](const RecordsBase & records) {
+      std::vector<uint64_t> values;
+      for (auto it = records.cbegin(); it->has_next(); it->next()) {
+        values.push_back(it->get_record().get_with_default("value", UINT64_MAX));
+      }
+      return values;
+    };
+  const uint64_t none = UINT64_MAX;
+
+  auto backward = left.merge_asof(
+    right, "stamp", "sub_stamp", "key", "key", columns, "backward", UINT64_MAX);
+  EXPECT_EQ(get_values(*backward), std::vector<uint64_t>({5, 0, 3, none, 2}));
+
+  auto forward = left.merge_asof(
+    right, "stamp", "sub_stamp", "key", "key", columns, "forward", UINT64_MAX);
+  EXPECT_EQ(get_values(*forward), std::vector<uint64_t>({2, 1, 4, 3, none}));
+
+  auto nearest = left.merge_asof(right, "stamp", "sub_stamp", "key", "key", columns, "nearest", 2);
+  EXPECT_EQ(get_values(*nearest), std::vector<uint64_t>({5, 0, 4, 3, none}));
+
+  auto without_key = left.merge_asof(right, "stamp", "sub_stamp", "", "", columns, "backward", 0);
+  EXPECT_EQ(get_values(*without_key), std::vector<uint64_t>({none, none, none, none, none}));
+}
+
+TEST_F(RecordsVectorImplTest, test_merge_projection)
+{
+  RecordsVectorImpl left(std::vector<std::string>({"stamp", "key", "left_value", "left_extra"}));
+  RecordsVectorImpl right(
+    std::vector<std::string>({"sub_stamp", "key", "right_value", "right_extra"}));
+  std::vector<std::vector<uint64_t>> left_rows = {
+    {1, 0, 10, 100}, {5, 1, 11, 101}, {8, 2, 12, 102}};
+  std::vector<std::vector<uint64_t>> right_rows = {{3, 0, 20, 200}, {6, 1, 21, 201}};
+  for (auto & row : left_rows) {
+    Record record;
+    record.add("stamp", row[0]);
+    record.add("key", row[1]);
+    record.add("left_value", row[2]);
+    record.add("left_extra", row[3]);
+    left.append(record);
+  }
+  for (auto & row : right_rows) {
+    Record record;
+    record.add("sub_stamp", row[0]);
+    record.add("key", row[1]);
+    record.add("right_value", row[2]);
+    record.add("right_extra", row[3]);
+    right.append(record);
+  }
+
+  using Row = std::map<std::string, uint64_t>;
+  auto get_rows = [](const RecordsBase & records) {
+      std::vector<Row> rows;
+      for (auto it = records.cbegin(); it->has_next(); it->next()) {
+        auto data = it->get_record().get_data();
+        rows.push_back(Row(data.begin(), data.end()));
+      }
+      std::sort(rows.begin(), rows.end());
+      return rows;
+    };
+
+  std::vector<std::string> columns = {"stamp", "key", "right_value"};
+  std::vector<Row> expect = {
+    {{"stamp", 1}, {"key", 0}, {"right_value", 20}},
+    {{"stamp", 5}, {"key", 1}, {"right_value", 21}},
+    {{"stamp", 8}, {"key", 2}},
+  };
+  EXPECT_EQ(get_rows(*left.merge(right, "key", "key", columns, "left")), expect);
+  EXPECT_EQ(
+    get_rows(*left.merge_sequential(right, "stamp", "sub_stamp", "key", "key", columns, "left")),
+    expect);
+
+  // Output columns missing from both inputs are not added.
+  columns = {"stamp", "right_value", "not_exist"};
+  expect = {
+    {{"stamp", 1}, {"right_value", 20}},
+    {{"stamp", 5}, {"right_value", 21}},
+    {{"stamp", 8}},
+  };
+  EXPECT_EQ(get_rows(*left.merge(right, "key", "key", columns, "left")), expect);
+  EXPECT_EQ(
+    get_rows(*left.merge_sequential(right, "stamp", "sub_stamp", "key", "key", columns, "left")),
+    expect);
+  EXPECT_EQ(
+    get_rows(
+      *left.merge_asof(right, "stamp", "sub_stamp", "key", "key", columns, "forward", UINT64_MAX)),
+    expect);
+
+  // Without output columns, each row is kept as an empty record.
+  columns = {};
+  expect = {Row(), Row(), Row()};
+  EXPECT_EQ(get_rows(*left.merge(right, "key", "key", columns, "left")), expect);
+  EXPECT_EQ(
+    get_rows(*left.merge_sequential(right, "stamp", "sub_stamp", "key", "key", columns, "left")),
+    expect);
+}
+
+TEST_F(RecordsVectorImplTest, test_move_append)
+{
+  RecordsVectorImpl records(std::vector<std::string>({"stamp", "value"}));
+  records.set_arena(std::make_shared<RecordArena>());
+  records.reserve(4);
+
+  Record record(Record::AllocatorT(records.get_arena().get()));
+  record.add("stamp", 1);
+  records.append(std::move(record));
+  records.emplace(std::unordered_map<std::string, uint64_t>{{"stamp", 2}, {"value", 20}});
+  auto used_size = records.get_arena()->get_used_size();
+  records.append(std::vector<Record>{Record({{"stamp", 3}}), Record({{"stamp", 4}})});
+  ASSERT_GT(records.get_arena()->get_used_size(), used_size);
+  ASSERT_EQ(records.size(), (size_t) 4);
+  ASSERT_EQ(records.get_sorted_column(), "");
+  ASSERT_EQ(records.get_column_stats("stamp").max, (uint64_t) 4);
+  ASSERT_EQ(records.at(1).get("value"), (uint64_t) 20);
+
+  auto arena = records.get_arena();
+  auto data = records.release_data();
+  ASSERT_EQ(records.size(), (size_t) 0);
+  ASSERT_EQ(data.size(), (size_t) 4);
+  // Released records are on the heap, and the arena is replaced.
+  ASSERT_NE(records.get_arena(), arena);
+  ASSERT_EQ(records.get_arena()->get_used_size(), (size_t) 0);
+  arena.reset();
+  ASSERT_EQ(data[3].get("stamp"), (uint64_t) 4);
+  ASSERT_EQ(data[1].get("value"), (uint64_t) 20);
+  records.shrink_to_fit();
+  ASSERT_EQ(records.memory_usage().vector_slack, (size_t) 0);
+
+  RecordsMapImpl map_records(std::move(data), {"stamp", "value"}, {"value"});
+  ASSERT_EQ(map_records.size(), (size_t) 4);
+  ASSERT_EQ(map_records.at(0).get("value"), (uint64_t) 20);
+}
+
+TEST_F(RecordsVectorImplTest, test_dictionary_encoding)
+{
+  std::vector<std::string> left_columns = {"stamp", "addr", "left_value"};
+  std::vector<std::string> right_columns = {"sub_stamp", "addr", "right_value"};
+  RecordsVectorImpl left(left_columns);
+  RecordsVectorImpl right(right_columns);
+  RecordsVectorImpl encoded_left(left_columns);
+  RecordsVectorImpl encoded_right(right_columns);
+  encoded_left.encode_column("addr");
+  encoded_right.encode_column("addr");
+
+  // More than 256 distinct values, some records without the column and one UINT64_MAX.
+  for (uint64_t i = 0; i < 1000; i++) {
+    Record left_record;
+    left_record.add("stamp", (i * 7) % 1000);
+    left_record.add("left_value", i);
+    if (i % 5 != 0) {
+      left_record.add("addr", i == 1 ? UINT64_MAX : 0x1000 + (i * 13) % 400);
+    }
+    left.append(left_record);
+    encoded_left.append(left_record);
+
+    Record right_record;
+    right_record.add("sub_stamp", (i * 3) % 1000);
+    right_record.add("right_value", i);
+    if (i % 7 != 0) {
+      right_record.add("addr", 0x1000 + (i * 5) % 450);
+    }
+    right.append(right_record);
+    encoded_right.append(right_record);
+  }
+  auto encoded_column = encoded_left.get_encoded_column("addr");
+  ASSERT_NE(encoded_column, nullptr);
+  EXPECT_EQ(encoded_column->get_code_width(), (size_t) 2);
+  EXPECT_EQ(encoded_column->size(), (size_t) 1000);
+  EXPECT_EQ(encoded_column->get_code(0), DictionaryColumn::missing_code);
+  EXPECT_EQ(encoded_column->get_value(encoded_column->get_code(1)), UINT64_MAX);
+
+  std::vector<std::string> columns = {"stamp", "addr", "left_value", "sub_stamp", "right_value"};
+  for (std::string how : {"inner", "left", "right", "outer"}) {
+    auto expect = left.merge(right, "addr", "addr", columns, how);
+    auto result = encoded_left.merge(encoded_right, "addr", "addr", columns, how);
+    EXPECT_TRUE(result->equals(*expect)) << how;
+  }
+  for (std::string how : {"inner", "left", "right", "outer", "left_use_latest"}) {
+    auto expect = left.merge_sequential(right, "stamp", "sub_stamp", "addr", "addr", columns, how);
+    auto result = encoded_left.merge_sequential(
+      encoded_right, "stamp", "sub_stamp", "addr", "addr", columns, how);
+    EXPECT_TRUE(result->equals(*expect)) << how;
+  }
+
+  // Codes are rebuilt after modifications other than append.
+  encoded_left.sort("stamp");
+  left.sort("stamp");
+  encoded_left.encode_column("left_value");
+  auto expect_groups = left.groupby("addr", "left_value");
+  auto groups = encoded_left.groupby("addr", "left_value");
+  ASSERT_EQ(groups.size(), expect_groups.size());
+  for (auto & pair : expect_groups) {
+    ASSERT_EQ(groups.count(pair.first), (size_t) 1);
+    EXPECT_TRUE(groups[pair.first]->equals(*pair.second));
+  }
+  auto expect_addr_groups = left.groupby("addr");
+  auto addr_groups = encoded_left.groupby("addr");
+  ASSERT_EQ(addr_groups.size(), expect_addr_groups.size());
+  for (auto & pair : expect_addr_groups) {
+    EXPECT_TRUE(addr_groups[pair.first]->equals(*pair.second));
+  }
+
+  encoded_left.rename_columns({{"addr", "callback_object"}});
+  EXPECT_FALSE(encoded_left.has_encoded_column("addr"));
+  EXPECT_TRUE(encoded_left.has_encoded_column("callback_object"));
+  EXPECT_EQ(encoded_left.get_encoded_column("callback_object")->size(), (size_t) 1000);
+  encoded_left.drop_columns({"callback_object"});
+  EXPECT_FALSE(encoded_left.has_encoded_column("callback_object"));
+}
+
+TEST_F(RecordsVectorImplTest, test_packed_column)
+{
+  std::vector<std::string> left_columns = {"stamp", "left_value"};
+  std::vector<std::string> right_columns = {"sub_stamp", "right_value"};
+  RecordsVectorImpl left(left_columns);
+  RecordsVectorImpl right(right_columns);
+  RecordsVectorImpl packed_left(left_columns);
+  RecordsVectorImpl packed_right(right_columns);
+  packed_left.pack_column("stamp");
+
+  // Nanosecond stamps with jitter, a block of equal stamps, a block with offsets wider
+  // than 32 bits and records without a stamp.
+  uint64_t base = 1600000000000000000;
+  for (uint64_t i = 0; i < 1000; i++) {
+    Record left_record;
+    left_record.add("left_value", i);
+    if (i % 11 != 0) {
+      uint64_t stamp = (256 <= i && i < 384) ? base : base + i * 1000000 + (i * 7919) % 5000;
+      if (i == 600) {
+        stamp += 10000000000;
+      }
+      left_record.add("stamp", stamp);
+    }
+    left.append(left_record);
+    packed_left.append(left_record);
+
+    Record right_record;
+    right_record.add("sub_stamp", base + i * 999983);
+    right_record.add("right_value", i);
+    right.append(right_record);
+    packed_right.append(right_record);
+  }
+  packed_right.pack_column("sub_stamp");
+
+  auto packed_column = packed_left.get_packed_column("stamp");
+  ASSERT_NE(packed_column, nullptr);
+  EXPECT_EQ(packed_column->size(), (size_t) 1000);
+  EXPECT_EQ(packed_column->get_block_count(), (size_t) 8);
+  EXPECT_FALSE(packed_column->is_ascending());
+  EXPECT_TRUE(packed_right.get_packed_column("sub_stamp")->is_ascending());
+  auto block = packed_column->get_block(2);
+  EXPECT_EQ(block.min, base);
+  EXPECT_EQ(block.max, base);
+  EXPECT_TRUE(block.has_missing);
+
+  std::vector<uint64_t> values;
+  packed_column->decode(values);
+  ASSERT_EQ(values.size(), (size_t) 1000);
+  auto data = left.get_data();
+  for (size_t i = 0; i < values.size(); i++) {
+    auto expect = data[i].has_column("stamp") ? data[i].get("stamp") : UINT64_MAX;
+    EXPECT_EQ(values[i], expect) << i;
+    EXPECT_EQ(packed_column->has_value(i), data[i].has_column("stamp")) << i;
+  }
+  EXPECT_LT(
+    packed_right.get_packed_column("sub_stamp")->memory_usage(),
+    values.size() * sizeof(uint64_t) * 2 / 3);
+
+  std::vector<std::pair<uint64_t, uint64_t>> ranges = {
+    {base, base}, {base + 100000000, base + 300000000}, {0, base + 500000000},
+    {base + 2000000000, UINT64_MAX}, {0, UINT64_MAX}};
+  for (auto & range : ranges) {
+    auto expect = left.clip("stamp", range.first, range.second);
+    auto result = packed_left.clip("stamp", range.first, range.second);
+    EXPECT_TRUE(result->equals(*expect)) << range.first << " " << range.second;
+  }
+
+  std::vector<std::string> columns = {"stamp", "left_value", "sub_stamp", "right_value"};
+  for (std::string how : {"inner", "left", "right", "outer", "left_use_latest"}) {
+    std::vector<std::string> no_keys;
+    auto expect = left.merge_sequential(
+      right, "stamp", "sub_stamp", no_keys, no_keys, columns, how);
+    auto result = packed_left.merge_sequential(
+      packed_right, "stamp", "sub_stamp", no_keys, no_keys, columns, how);
+    EXPECT_TRUE(result->equals(*expect)) << how;
+  }
+
+  // Packed columns are rebuilt after modifications other than append.
+  auto is_even = [](Record record) {
+      return record.get("left_value") % 2 == 0;
+    };
+  packed_left.filter_if(is_even);
+  left.filter_if(is_even);
+  EXPECT_EQ(packed_left.get_packed_column("stamp")->size(), (size_t) 500);
+  auto expect = left.clip("stamp", base + 100000000, base + 300000000);
+  auto result = packed_left.clip("stamp", base + 100000000, base + 300000000);
+  EXPECT_TRUE(result->equals(*expect));
+
+  packed_left.drop_columns({"stamp"});
+  EXPECT_FALSE(packed_left.has_packed_column("stamp"));
+}
+
+TEST_F(RecordsVectorImplTest, test_index_concurrent_readers)
+{
+  RecordsVectorImpl records(std::vector<std::string>({"stamp"}));
+  records.build_index("stamp");
+  const uint64_t size = 2000;
+  for (uint64_t i = 0; i < size; i++) {
+    records.append(Record({{"stamp", (i * 7919) % size}}));
+  }
+
+  // Entries appended out of order are merged by the first reader.
+  const size_t thread_count = 8;
+  std::vector<char> ok(thread_count, false);
+  std::vector<std::thread> threads;
+  for (size_t t = 0; t < thread_count; t++) {
+    threads.emplace_back(
+      [&records, &ok, size, t]() {
+        auto & entries = records.get_index("stamp")->get_entries();
+        bool is_sorted = entries.size() == size;
+        for (uint64_t i = 0; is_sorted && i < size; i++) {
+          is_sorted = entries[i].first == i;
+        }
+        ok[t] = is_sorted && records.get_column_stats("stamp").max == size - 1;
+      });
+  }
+  for (auto & thread : threads) {
+    thread.join();
+  }
+  for (size_t t = 0; t < thread_count; t++) {
+    EXPECT_TRUE(ok[t]) << t;
+  }
+}
+
+TEST_F(RecordsVectorImplTest, test_bind_drop_as_delay)
+{
+  // Reference: sort rows on all columns with missing values last, fill each missing
+  // value from the next row that has one, then sort again.
+  std::vector<std::string> columns = {"a", "b", "c"};
+  const uint64_t none = UINT64_MAX;
+  std::vector<std::vector<uint64_t>> rows;
+  for (uint64_t i = 0; i < 300; i++) {
+    rows.push_back(
+    {
+      i % 11 == 0 ? none : (i * 7) % 5,
+      i % 3 == 0 ? none : (i * 13) % 17,
+      i % 4 == 1 ? none : (i * 5) % 7,
+    });
+  }
+
+  RecordsVectorImpl records(columns);
+  for (auto & row : rows) {
+    Record record;
+    for (size_t i = 0; i < columns.size(); i++) {
+      if (row[i] != none) {
+        record.add(columns[i], row[i]);
+      }
+    }
+    records.append(record);
+  }
+  records.bind_drop_as_delay();
+
+  std::sort(rows.begin(), rows.end());
+  for (size_t i = 0; i < columns.size(); i++) {
+    uint64_t next_value = none;
+    for (auto it = rows.rbegin(); it != rows.rend(); ++it) {
+      if ((*it)[i] == none) {
+        (*it)[i] = next_value;
+      } else {
+        next_value = (*it)[i];
+      }
+    }
+  }
+  std::sort(rows.begin(), rows.end());
+
+  auto data = records.get_data();
+  ASSERT_EQ(data.size(), rows.size());
+  for (size_t row = 0; row < rows.size(); row++) {
+    for (size_t i = 0; i < columns.size(); i++) {
+      EXPECT_EQ(data[row].get_with_default(columns[i], none), rows[row][i]) << row << " " << i;
+    }
+  }
+}
+
+TEST_F(RecordsVectorImplTest, test_merge_how)
+{
+  const uint64_t none = UINT64_MAX;
+  auto add_rows = [none](
+    RecordsBase & records, const std::vector<std::string> & columns,
+    const std::vector<std::vector<uint64_t>> & rows) {
+      for (auto & row : rows) {
+        Record record;
+        for (size_t i = 0; i < columns.size(); i++) {
+          if (row[i] != none) {
+            record.add(columns[i], row[i]);
+          }
+        }
+        records.append(record);
+      }
+    };
+  auto get_rows = [none](const RecordsBase & records, const std::vector<std::string> & columns) {
+      std::vector<std::vector<uint64_t>> rows;
+      for (auto it = records.cbegin(); it->has_next(); it->next()) {
+        std::vector<uint64_t> row;
+        for (auto & column : columns) {
+          row.push_back(it->get_record().get_with_default(column, none));
+        }
+        rows.push_back(row);
+      }
+      return rows;
+    };
+
+  std::vector<std::string> left_columns = {"stamp", "key", "left_value"};
+  std::vector<std::string> right_columns = {"sub_stamp", "key", "right_value"};
+  std::vector<std::string> columns = {"stamp", "key", "left_value", "sub_stamp", "right_value"};
+  using ExpectT = std::vector<std::pair<std::string, std::vector<std::vector<uint64_t>>>>;
+
+  RecordsVectorImpl left(left_columns);
+  RecordsVectorImpl right(right_columns);
+  add_rows(left, left_columns, {{1, 0, 10}, {2, 1, 11}, {3, none, 12}, {4, 0, 13}, {5, 3, 14}});
+  add_rows(right, right_columns, {{11, 0, 20}, {12, 2, 21}, {13, none, 22}, {14, 0, 23}});
+  ExpectT merge_expect = {
+    {
+      "inner", {
+        {1, 0, 10, 11, 20}, {4, 0, 13, 11, 20}, {1, 0, 10, 14, 23}, {4, 0, 13, 14, 23}
+      }
+    },
+    {
+      "left", {
+        {1, 0, 10, 11, 20}, {4, 0, 13, 11, 20}, {1, 0, 10, 14, 23}, {4, 0, 13, 14, 23},
+        {2, 1, 11, none, none}, {3, none, 12, none, none}, {5, 3, 14, none, none}
+      }
+    },
+    {
+      "right", {
+        {1, 0, 10, 11, 20}, {4, 0, 13, 11, 20}, {1, 0, 10, 14, 23}, {4, 0, 13, 14, 23},
+        {none, 2, none, 12, 21}, {none, none, none, 13, 22}
+      }
+    },
+    {
+      "outer", {
+        {1, 0, 10, 11, 20}, {4, 0, 13, 11, 20}, {1, 0, 10, 14, 23}, {4, 0, 13, 14, 23},
+        {2, 1, 11, none, none}, {none, 2, none, 12, 21}, {3, none, 12, none, none},
+        {none, none, none, 13, 22}, {5, 3, 14, none, none}
+      }
+    },
+  };
+  for (auto & pair : merge_expect) {
+    auto merged = left.merge(right, "key", "key", columns, pair.first);
+    EXPECT_EQ(get_rows(*merged, columns), pair.second) << pair.first;
+  }
+
+  RecordsVectorImpl sequential_left(left_columns);
+  RecordsVectorImpl sequential_right(right_columns);
+  add_rows(
+    sequential_left, left_columns,
+    {{1, 0, 10}, {5, 1, 11}, {6, 0, 12}, {9, none, 13}, {12, 1, 14}, {15, 0, 16}});
+  add_rows(
+    sequential_right, right_columns,
+    {{2, 0, 20}, {3, 0, 21}, {7, 1, 22}, {8, none, 23}, {10, 0, 24}, {13, 1, 25}, {0, 0, 26}});
+  ExpectT sequential_expect = {
+    {
+      "inner", {
+        {1, 0, 10, 2, 20}, {5, 1, 11, 7, 22}, {6, 0, 12, 10, 24}, {12, 1, 14, 13, 25}
+      }
+    },
+    {
+      "left", {
+        {1, 0, 10, 2, 20}, {5, 1, 11, 7, 22}, {6, 0, 12, 10, 24}, {9, none, 13, none, none},
+        {12, 1, 14, 13, 25}, {15, 0, 16, none, none}
+      }
+    },
+    {
+      "right", {
+        {none, 0, none, 0, 26}, {1, 0, 10, 2, 20}, {none, 0, none, 3, 21}, {5, 1, 11, 7, 22},
+        {6, 0, 12, 10, 24}, {none, none, none, 8, 23}, {12, 1, 14, 13, 25}
+      }
+    },
+    {
+      "outer", {
+        {none, 0, none, 0, 26}, {1, 0, 10, 2, 20}, {none, 0, none, 3, 21}, {5, 1, 11, 7, 22},
+        {6, 0, 12, 10, 24}, {none, none, none, 8, 23}, {9, none, 13, none, none},
+        {12, 1, 14, 13, 25}, {15, 0, 16, none, none}
+      }
+    },
+    {
+      "left_use_latest", {
+        {1, 0, 10, 2, 20}, {1, 0, 10, 3, 21}, {5, 1, 11, 7, 22}, {6, 0, 12, 10, 24},
+        {9, none, 13, none, none}, {12, 1, 14, 13, 25}, {15, 0, 16, none, none}
+      }
+    },
+  };
+  for (auto & pair : sequential_expect) {
+    auto merged = sequential_left.merge_sequential(
+      sequential_right, "stamp", "sub_stamp", "key", "key", columns, pair.first);
+    EXPECT_EQ(get_rows(*merged, columns), pair.second) << pair.first;
+  }
+
+  std::vector<std::string> source_columns = {"source_stamp", "source_addr"};
+  std::vector<std::string> copy_columns = {"copy_stamp", "addr_from", "addr_to"};
+  std::vector<std::string> sink_columns = {"sink_stamp", "sink_addr"};
+  RecordsVectorImpl source(source_columns);
+  RecordsVectorImpl copy(copy_columns);
+  RecordsVectorImpl sink(sink_columns);
+  add_rows(source, source_columns, {{1, 100}, {5, 200}, {9, 100}});
+  add_rows(copy, copy_columns, {{2, 100, 300}, {6, 200, 400}});
+  add_rows(sink, sink_columns, {{3, 300}, {4, 100}, {7, 400}, {8, 300}, {10, 100}});
+  auto tracked = source.merge_sequential_for_addr_track(
+    "source_stamp", "source_addr", copy, "copy_stamp", "addr_from", "addr_to",
+    sink, "sink_stamp", "sink_addr");
+  std::vector<std::vector<uint64_t>> tracked_expect = {
+    {9, 100, 10, none}, {5, 200, 7, none}, {1, 100, 4, none}, {1, 100, 3, none}
+  };
+  EXPECT_EQ(
+    get_rows(*tracked, {"source_stamp", "source_addr", "sink_stamp", "sink_addr"}),
+    tracked_expect);
+}
@@ -0,0 +1,110 @@
+// Copyright 2021 Research Institute of Systems Planning, Inc.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include <string>
+#include <vector>
+
+#include <gtest/gtest.h>
+#include <gmock/gmock.h>
+
+#include "caret_analyze_cpp_impl/records.hpp"
+#include "caret_analyze_cpp_impl/spill_sorter.hpp"
+
+
+void check_sorted(size_t memory_budget, size_t expected_min_runs, size_t max_open_runs = 64)
+{
+  SpillSorter sorter(memory_budget, ::testing::TempDir(), max_open_runs);
+  for (uint64_t i = 0; i < 100; i++) {
+    sorter.add((i * 7) % 10, i % 2, i, Record({{"value", i}}));
+  }
+
+  uint64_t key0, key1, tag;
+  uint64_t prev_key0 = 0, prev_key1 = 0, prev_tag = 0;
+  Record record;
+  size_t count = 0;
+  while (sorter.next(key0, key1, tag, record)) {
+    ASSERT_EQ(record.get("value"), tag);
+    if (count > 0) {
+      ASSERT_TRUE(
+        std::make_tuple(prev_key0, prev_key1, prev_tag) < std::make_tuple(key0, key1, tag));
+    }
+    prev_key0 = key0;
+    prev_key1 = key1;
+    prev_tag = tag;
+    count++;
+  }
+  ASSERT_EQ(count, (size_t) 100);
+  ASSERT_GE(sorter.get_run_count(), expected_min_runs);
+}
+
+TEST(SpillSorterTest, test_in_memory)
+{
+  check_sorted(SIZE_MAX, 0);
+}
+
+TEST(SpillSorterTest, test_spilled_runs)
+{
+  check_sorted(1024, 2);
+}
+
+TEST(SpillSorterTest, test_merge_passes)
+{
+  check_sorted(1024, 5, 2);
+  check_sorted(1024, 5, 4);
+}
+
+TEST(SpillSorterTest, test_spill_per_record)
+{
+  check_sorted(0, 100, 3);
+}
+
+TEST(SpillSorterTest, test_invalid_settings)
+{
+  auto & config = OutOfCoreConfig::get_instance();
+  EXPECT_THROW(config.enable(0, ::testing::TempDir()), std::exception);
+  EXPECT_THROW(config.enable(1024, ::testing::TempDir()), std::exception);
+  EXPECT_FALSE(config.is_enabled());
+  EXPECT_THROW(SpillSorter(1024, ::testing::TempDir(), 1), std::exception);
+}
+
+TEST(SpillSorterTest, test_merge_out_of_core)
+{
+  // About 150 bytes are buffered per record, so the 20000 records of both sides
+  // spill several runs with the minimum budget.
+  RecordsVectorImpl left(std::vector<std::string>({"stamp", "key", "left_value"}));
+  RecordsVectorImpl right(std::vector<std::string>({"sub_stamp", "key", "right_value"}));
+  for (uint64_t i = 0; i < 10000; i++) {
+    Record left_record({{"stamp", i}, {"left_value", i}});
+    if (i % 11 != 0) {
+      left_record.add("key", (i * 7) % 6000);
+    }
+    left.append(left_record);
+    Record right_record({{"sub_stamp", i}, {"right_value", i}});
+    if (i % 13 != 0) {
+      right_record.add("key", (i * 3) % 8000);
+    }
+    right.append(right_record);
+  }
+
+  std::vector<std::string> columns = {"stamp", "key", "left_value", "sub_stamp", "right_value"};
+  auto & config = OutOfCoreConfig::get_instance();
+  for (std::string how : {"inner", "left", "right", "outer"}) {
+    auto expect = left.merge(right, "key", "key", columns, how);
+    config.enable(OutOfCoreConfig::min_memory_budget, ::testing::TempDir() + "merge_spill");
+    auto result = left.merge(right, "key", "key", columns, how);
+    config.disable();
+    EXPECT_GT(result->size(), 0u) << how;
+    EXPECT_TRUE(result->equals(*expect)) << how;
+  }
+}
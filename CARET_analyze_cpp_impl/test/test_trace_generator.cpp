@@ -0,0 +1,112 @@
+// Copyright 2021 Research Institute of Systems Planning, Inc.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include <string>
+#include <vector>
+
+#include <gtest/gtest.h>
+#include <gmock/gmock.h>
+
+#include "caret_analyze_cpp_impl/records.hpp"
+#include "caret_analyze_cpp_impl/trace_generator.hpp"
+
+TraceGeneratorConfig get_config()
+{
+  TraceGeneratorConfig config;
+  config.node_count = 4;
+  config.rate = 100.0;
+  config.duration = 100000000;
+  config.executor_count = 2;
+  config.seed = 1;
+  return config;
+}
+
+TEST(TraceGeneratorTest, test_deterministic)
+{
+  auto config = get_config();
+  TraceGenerator generator(config);
+  TraceGenerator same_generator(config);
+  config.seed = 2;
+  TraceGenerator other_generator(config);
+
+  bool has_difference = false;
+  for (auto & name : generator.get_record_names()) {
+    auto & records = generator.get_records(name);
+    EXPECT_TRUE(records.equals(same_generator.get_records(name)));
+    has_difference |= !records.equals(other_generator.get_records(name));
+  }
+  EXPECT_TRUE(has_difference);
+}
+
+TEST(TraceGeneratorTest, test_sizes)
+{
+  auto config = get_config();
+  TraceGenerator generator(config);
+
+  // 4 nodes publishing at 100 Hz for 0.1 s.
+  EXPECT_EQ(generator.get_records("rclcpp_intra_publish").size(), (size_t) 20);
+  EXPECT_EQ(generator.get_records("rclcpp_publish").size(), (size_t) 20);
+  EXPECT_EQ(generator.get_records("dispatch_intra_process_subscription_callback").size(),
+    (size_t) 20);
+  EXPECT_EQ(generator.get_records("dispatch_subscription_callback").size(), (size_t) 20);
+  EXPECT_EQ(generator.get_records("callback_start").size(), (size_t) 80);
+  EXPECT_EQ(generator.get_records("callback_end").size(), (size_t) 80);
+
+  config.drop_ratio = 1.0;
+  TraceGenerator dropped_generator(config);
+  EXPECT_EQ(dropped_generator.get_records("rclcpp_intra_publish").size(), (size_t) 20);
+  EXPECT_EQ(
+    dropped_generator.get_records("dispatch_intra_process_subscription_callback").size(),
+    (size_t) 0);
+  EXPECT_EQ(dropped_generator.get_records("dispatch_subscription_callback").size(), (size_t) 0);
+  EXPECT_EQ(dropped_generator.get_records("callback_start").size(), (size_t) 40);
+}
+
+TEST(TraceGeneratorTest, test_addr_track)
+{
+  auto config = get_config();
+  config.address_count = 2;
+  TraceGenerator generator(config);
+
+  auto & source = generator.get_records("rclcpp_intra_publish");
+  auto & copy = generator.get_records("message_construct");
+  auto & sink = generator.get_records("dispatch_intra_process_subscription_callback");
+  auto source_records = source.clone();
+  source_records->rename_columns({{"message", "source_message"}});
+  auto merged = source_records->merge_sequential_for_addr_track(
+    "rclcpp_intra_publish_timestamp", "source_message",
+    copy, "message_construct_timestamp", "original_message", "constructed_message",
+    sink, "dispatch_intra_process_subscription_callback_timestamp", "message");
+
+  EXPECT_EQ(merged->size(), source.size());
+  for (auto & record : merged->get_named_data()) {
+    ASSERT_EQ(record.count("dispatch_intra_process_subscription_callback_timestamp"), 1u);
+    EXPECT_LT(
+      record.at("rclcpp_intra_publish_timestamp"),
+      record.at("dispatch_intra_process_subscription_callback_timestamp"));
+  }
+}
+
+TEST(TraceGeneratorTest, test_write)
+{
+  TraceGenerator generator(get_config());
+  auto dir = ::testing::TempDir() + "trace_generator";
+  generator.write(dir);
+
+  for (auto & name : generator.get_record_names()) {
+    auto & records = generator.get_records(name);
+    RecordsVectorImpl loaded_records(dir + "/" + name + ".yaml");
+    EXPECT_EQ(loaded_records.get_named_data(), records.get_named_data());
+  }
+}